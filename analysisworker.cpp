@@ -0,0 +1,134 @@
+#include "analysisworker.h"
+
+#include <math.h>
+
+namespace {
+
+// 512 samples are about 1 s at the usual 500 Hz, a 1 Hz resolution
+const int psd_segment = 512;
+const int psd_average = 16;
+
+// step response segments have to hold a whole stick move and its settling
+const int step_segment = 1024;
+const int step_average = 32;
+const double step_length_s = 0.5;
+const float step_min_input = 0.3;   // rad/s, about 17 deg/s of stick
+
+}
+
+AnalysisWorker::AnalysisWorker(QObject *parent) :
+    QObject(parent),
+    mode(analysis_psd)
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        psd[i] = new WelchPsd(psd_segment, psd_average);
+        step[i] = new StepResponse(step_segment, step_average, step_min_input);
+    }
+    clear();
+}
+
+AnalysisWorker::~AnalysisWorker()
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        delete psd[i];
+        delete step[i];
+    }
+}
+
+void AnalysisWorker::clear()
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        psd[i]->clear();
+        step[i]->clear();
+    }
+    first_key = 0;
+    last_key = 0;
+    count = 0;
+}
+
+void AnalysisWorker::set_mode(int new_mode)
+{
+    mode = new_mode;
+    publish();
+}
+
+void AnalysisWorker::add_samples(QVector<double> samples)
+{
+    int n = samples.size() / analysis_stride;
+    int i, axis;
+
+    if ( n == 0 )
+    {
+        return;
+    }
+
+    // the plot clock was restarted
+    if ( count > 0 && samples[0] < last_key )
+    {
+        clear();
+    }
+    if ( count == 0 )
+    {
+        first_key = samples[0];
+    }
+    last_key = samples[(n - 1) * analysis_stride];
+    count += n;
+
+    for ( axis = 0; axis < 3; axis++ )
+    {
+        gyro[axis].resize(n);
+        set_point[axis].resize(n);
+        for ( i = 0; i < n; i++ )
+        {
+            gyro[axis][i] = samples[i * analysis_stride + 1 + axis];
+            set_point[axis][i] = samples[i * analysis_stride + 4 + axis];
+        }
+        psd[axis]->add(gyro[axis].data(), n);
+        step[axis]->add(set_point[axis].data(), gyro[axis].data(), n);
+    }
+
+    publish();
+}
+
+void AnalysisWorker::publish()
+{
+    QVector<double> x;
+    QVector<double> y[3];
+    double rate;
+    int i, axis, length;
+
+    if ( count < 2 || last_key <= first_key )
+    {
+        return;
+    }
+    rate = (count - 1) / (last_key - first_key);
+
+    for ( axis = 0; axis < 3; axis++ )
+    {
+        if ( mode == analysis_psd )
+        {
+            psd[axis]->psd(rate, curve);
+        }
+        else
+        {
+            length = step_length_s * rate;
+            step[axis]->response(length, curve);
+        }
+
+        // DC says nothing about the loop, it is left out of the spectrum
+        for ( i = mode == analysis_psd ? 1 : 0; i < (int) curve.size(); i++ )
+        {
+            y[axis].append(mode == analysis_psd ? 10 * log10(curve[i] + 1e-12) : curve[i]);
+        }
+    }
+
+    for ( i = 0; i < y[0].size(); i++ )
+    {
+        x.append(mode == analysis_psd ? (i + 1) * rate / psd_segment : i * 1000 / rate);
+    }
+
+    emit updated(mode, x, y[0], y[1], y[2]);
+}
@@ -0,0 +1,52 @@
+#ifndef ANALYSISWORKER_H
+#define ANALYSISWORKER_H
+
+#include <QObject>
+#include <QVector>
+#include <vector>
+
+#include "spectrum.h"
+
+enum { analysis_psd, analysis_step }; // AnalysisWorker mode
+
+// samples handed to AnalysisWorker::add_samples() are interleaved as
+// key(s), gyro roll nick gier, set point roll nick gier, rates in rad/s
+enum { analysis_stride = 7 };
+
+// Frequency and step response of the gyro data, computed in its own thread.
+//
+// The GUI thread hands over the samples that arrived since the last batch,
+// every batch only transforms the new segments (see WelchPsd, StepResponse)
+// and the curves of the selected mode are published right away.
+class AnalysisWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AnalysisWorker(QObject *parent = 0);
+    ~AnalysisWorker();
+
+public slots:
+    void add_samples(QVector<double> samples);
+    void set_mode(int mode);
+    void clear();
+
+signals:
+    // x in Hz (psd, values in dB) or ms (step), one curve per axis of x.size()
+    void updated(int mode, QVector<double> x, QVector<double> roll, QVector<double> nick, QVector<double> gier);
+
+private:
+    void publish();
+
+    WelchPsd *psd[3];
+    StepResponse *step[3];
+    int mode;
+    double first_key;
+    double last_key;
+    qint64 count;           // samples since clear()
+    std::vector<float> gyro[3];
+    std::vector<float> set_point[3];
+    std::vector<double> curve;
+};
+
+#endif // ANALYSISWORKER_H
@@ -0,0 +1,117 @@
+#include "batchflashdialog.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QProgressBar>
+#include <QLabel>
+#include <QFileInfo>
+
+BatchFlashDialog::BatchFlashDialog(const QString &dfu_util, const QString &firmware, bool leave, QWidget *parent) :
+    QDialog(parent),
+    firmware_path(firmware),
+    leave_dfu(leave)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QHBoxLayout *buttons = new QHBoxLayout;
+
+    setWindowTitle(tr("Batch flash %1").arg(QFileInfo(firmware).fileName()));
+    resize(640, 420);
+
+    flasher = new BatchFlasher(dfu_util, this);
+    connect(flasher, SIGNAL(devices_changed()), this, SLOT(devices_changed()));
+    connect(flasher, SIGNAL(device_changed(int)), this, SLOT(device_changed(int)));
+    connect(flasher, SIGNAL(finished()), this, SLOT(flash_finished()));
+
+    table = new QTableWidget(0, col_count, this);
+    table->setHorizontalHeaderLabels(QStringList() << tr("Device") << tr("Phase") << tr("Progress") << tr("Time"));
+    table->horizontalHeader()->setStretchLastSection(true);
+    table->verticalHeader()->hide();
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionMode(QAbstractItemView::NoSelection);
+    layout->addWidget(table);
+
+    find_button = new QPushButton(tr("Find devices"), this);
+    connect(find_button, SIGNAL(clicked()), flasher, SLOT(enumerate()));
+    buttons->addWidget(find_button);
+
+    // every dfu-util holds its own USB device, the limit is for hubs and the host controller
+    buttons->addWidget(new QLabel(tr("At a time"), this));
+    parallel_spinBox = new QSpinBox(this);
+    parallel_spinBox->setRange(1, 16);
+    parallel_spinBox->setValue(4);
+    buttons->addWidget(parallel_spinBox);
+    buttons->addStretch();
+
+    flash_button = new QPushButton(tr("Flash all"), this);
+    flash_button->setDisabled(true);
+    connect(flash_button, SIGNAL(clicked()), this, SLOT(flash_all()));
+    buttons->addWidget(flash_button);
+    layout->addLayout(buttons);
+
+    report_edit = new QPlainTextEdit(this);
+    report_edit->setReadOnly(true);
+    report_edit->setMaximumHeight(120);
+    layout->addWidget(report_edit);
+
+    flasher->enumerate();
+}
+
+void BatchFlashDialog::reject()
+{
+    // closing while dfu-util writes would leave the processes without their owner
+    if ( !flasher->isRunning() )
+    {
+        QDialog::reject();
+    }
+}
+
+void BatchFlashDialog::devices_changed()
+{
+    const QList<dfu_device> &devices = flasher->devices();
+    int row;
+
+    table->setRowCount(devices.size());
+    for ( row = 0; row < devices.size(); row++ )
+    {
+        QProgressBar *bar = new QProgressBar(this);
+
+        bar->setRange(0, 100);
+        table->setItem(row, col_device, new QTableWidgetItem(devices.at(row).serial.isEmpty() ? devices.at(row).path : devices.at(row).serial));
+        table->setItem(row, col_phase, new QTableWidgetItem);
+        table->setCellWidget(row, col_progress, bar);
+        table->setItem(row, col_time, new QTableWidgetItem);
+        device_changed(row);
+    }
+
+    flash_button->setDisabled(devices.isEmpty());
+    report_edit->setPlainText(tr("%1 DFU devices found").arg(devices.size()));
+}
+
+void BatchFlashDialog::device_changed(int index)
+{
+    const dfu_device &device = flasher->devices().at(index);
+
+    table->item(index, col_phase)->setText(device.status == flash_failed && !device.message.isEmpty() ? device.message : device.phase);
+    ((QProgressBar *) table->cellWidget(index, col_progress))->setValue(device.percent);
+    table->item(index, col_time)->setText(device.elapsed_ms > 0 ? tr("%1 s").arg(device.elapsed_ms / 1000.0, 0, 'f', 1) : QString());
+}
+
+void BatchFlashDialog::flash_all()
+{
+    find_button->setDisabled(true);
+    flash_button->setDisabled(true);
+    parallel_spinBox->setDisabled(true);
+    report_edit->clear();
+
+    flasher->start(firmware_path, leave_dfu, parallel_spinBox->value());
+}
+
+void BatchFlashDialog::flash_finished()
+{
+    report_edit->setPlainText(flasher->report());
+
+    find_button->setDisabled(false);
+    flash_button->setDisabled(false);
+    parallel_spinBox->setDisabled(false);
+}
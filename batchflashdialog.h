@@ -0,0 +1,45 @@
+#ifndef BATCHFLASHDIALOG_H
+#define BATCHFLASHDIALOG_H
+
+#include <QDialog>
+#include <QTableWidget>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QPlainTextEdit>
+
+#include "batchflasher.h"
+
+// Flashes the selected firmware to all connected DFU devices and shows the
+// progress of each of them, the summary ends up in the report box.
+class BatchFlashDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    BatchFlashDialog(const QString &dfu_util, const QString &firmware, bool leave, QWidget *parent = 0);
+
+    QString report() const { return report_edit->toPlainText(); }
+
+protected:
+    void reject();
+
+private slots:
+    void devices_changed();
+    void device_changed(int index);
+    void flash_all();
+    void flash_finished();
+
+private:
+    enum { col_device, col_phase, col_progress, col_time, col_count };
+
+    BatchFlasher *flasher;
+    QString firmware_path;
+    bool leave_dfu;
+    QTableWidget *table;
+    QSpinBox *parallel_spinBox;
+    QPushButton *find_button;
+    QPushButton *flash_button;
+    QPlainTextEdit *report_edit;
+};
+
+#endif // BATCHFLASHDIALOG_H
@@ -0,0 +1,270 @@
+#include "batchflasher.h"
+#include "flashdiff.h"
+
+#include <QRegExp>
+#include <QFileInfo>
+#include <QFile>
+
+namespace {
+
+// same start address as the single device flashing, the bootloader stays
+const char *flash_address = "0x08004000";
+
+}
+
+BatchFlasher::BatchFlasher(const QString &dfu_util, QObject *parent) :
+    QObject(parent),
+    dfu_util_path(dfu_util),
+    batch_ms(0),
+    leave_dfu(false),
+    parallel(1),
+    next_device(0),
+    running(0)
+{
+    connect(&list_process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(list_finished(int)));
+}
+
+void BatchFlasher::enumerate()
+{
+    if ( isRunning() || list_process.state() != QProcess::NotRunning )
+    {
+        return;
+    }
+
+    list_process.start(dfu_util_path, QStringList() << "-l");
+}
+
+QList<dfu_device> BatchFlasher::parse_list(const QString &output)
+{
+    // Found DFU: [0483:df11] ver=2200, devnum=12, cfg=1, intf=0, path="1-1.2", alt=0, name="@Internal Flash ...", serial="3276365D3234"
+    QRegExp found("Found DFU: \\[0483:df11\\].*path=\"([^\"]*)\".*alt=0,.*serial=\"([^\"]*)\"");
+    QList<dfu_device> list;
+    dfu_device device;
+
+    foreach ( const QString &line, output.split('\n') )
+    {
+        if ( found.indexIn(line) < 0 )
+        {
+            continue;
+        }
+
+        device.path = found.cap(1);
+        device.serial = found.cap(2) == "UNKNOWN" ? QString() : found.cap(2);
+        device.status = flash_waiting;
+        device.percent = 0;
+        device.elapsed_ms = 0;
+        list.append(device);
+    }
+
+    return list;
+}
+
+void BatchFlasher::list_finished(int exit_code)
+{
+    Q_UNUSED(exit_code);
+
+    device_list = parse_list(list_process.readAllStandardOutput());
+    next_device = 0;
+
+    emit devices_changed();
+}
+
+void BatchFlasher::start(const QString &firmware, bool leave, int max_parallel)
+{
+    int i;
+    QFile file(firmware);
+
+    if ( isRunning() || device_list.isEmpty() )
+    {
+        return;
+    }
+
+    firmware_path = firmware;
+    firmware_image = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    leave_dfu = leave;
+    parallel = qMax(1, max_parallel);
+    next_device = 0;
+    running = 0;
+    clocks.clear();
+
+    for ( i = 0; i < device_list.size(); i++ )
+    {
+        device_list[i].status = flash_waiting;
+        device_list[i].percent = 0;
+        device_list[i].phase.clear();
+        device_list[i].message.clear();
+        device_list[i].elapsed_ms = 0;
+        clocks.append(QElapsedTimer());
+        emit device_changed(i);
+    }
+
+    batch_clock.start();
+
+    while ( running < parallel && next_device < device_list.size() )
+    {
+        launch_next();
+    }
+}
+
+void BatchFlasher::launch_next()
+{
+    int index = next_device++;
+    dfu_device &device = device_list[index];
+    QProcess *process = new QProcess(this);
+    QStringList args;
+
+    if ( device.serial.isEmpty() )
+    {
+        args << "-p" << device.path;
+    }
+    else
+    {
+        args << "-S" << device.serial;
+    }
+    args << "-a" << "0" << "-s" << QString(flash_address) + (leave_dfu ? ":leave" : "") << "-D" << firmware_path;
+
+    // errors go to stderr, keep them in the same stream as the progress
+    process->setProcessChannelMode(QProcess::MergedChannels);
+    process->setProperty("device", index);
+    connect(process, SIGNAL(readyReadStandardOutput()), this, SLOT(process_output()));
+    connect(process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(process_finished(int,QProcess::ExitStatus)));
+    connect(process, SIGNAL(errorOccurred(QProcess::ProcessError)), this, SLOT(process_error(QProcess::ProcessError)));
+
+    device.status = flash_running;
+    device.phase = tr("starting");
+    clocks[index].start();
+    running++;
+
+    process->start(dfu_util_path, args);
+    emit device_changed(index);
+}
+
+void BatchFlasher::process_output()
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    int index = process->property("device").toInt();
+    dfu_device &device = device_list[index];
+    QRegExp percent("(\\d+)%");
+
+    // "Erase   \t[=====     ]  36%        36864 bytes\r", the bar is redrawn with \r
+    foreach ( const QString &part, QString(process->readAllStandardOutput()).split(QRegExp("[\\r\\n]"), QString::SkipEmptyParts) )
+    {
+        QString line = part.trimmed();
+
+        if ( line.startsWith("Erase") )
+        {
+            device.phase = tr("erase");
+        }
+        else if ( line.startsWith("Download") )
+        {
+            device.phase = tr("download");
+        }
+
+        if ( percent.indexIn(line) >= 0 )
+        {
+            device.percent = percent.cap(1).toInt();
+        }
+        else if ( !line.isEmpty() )
+        {
+            device.message = line;
+        }
+    }
+
+    emit device_changed(index);
+}
+
+void BatchFlasher::process_finished(int exit_code, QProcess::ExitStatus status)
+{
+    // with :leave dfu-util may fail to reset a device that already left DFU mode
+    device_finished(qobject_cast<QProcess *>(sender()), status == QProcess::NormalExit && exit_code == 0);
+}
+
+void BatchFlasher::process_error(QProcess::ProcessError error)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+
+    // a process that never started doesn't emit finished()
+    if ( error == QProcess::FailedToStart )
+    {
+        device_list[process->property("device").toInt()].message = process->errorString();
+        device_finished(process, false);
+    }
+}
+
+void BatchFlasher::device_finished(QProcess *process, bool ok)
+{
+    int index = process->property("device").toInt();
+    dfu_device &device = device_list[index];
+
+    device.status = ok ? flash_done : flash_failed;
+    device.elapsed_ms = clocks[index].elapsed();
+
+    // like a single flash, a failed one may have left anything behind
+    if ( ok && !firmware_image.isEmpty() )
+    {
+        FlashPageCache::store(device.serial, FlashPageCache::hash(firmware_image, true));
+    }
+    else
+    {
+        FlashPageCache::forget(device.serial);
+    }
+    if ( device.status == flash_done )
+    {
+        device.percent = 100;
+        device.phase = tr("done");
+    }
+    else
+    {
+        device.phase = tr("failed");
+    }
+
+    process->deleteLater();
+    running--;
+    emit device_changed(index);
+
+    if ( next_device < device_list.size() )
+    {
+        launch_next();
+    }
+    else if ( running == 0 )
+    {
+        batch_ms = batch_clock.elapsed();
+        emit finished();
+    }
+}
+
+QString BatchFlasher::report() const
+{
+    QString text;
+    qint64 sequential_ms = 0;
+    int ok = 0;
+
+    text += tr("Batch flash of %1, %2 at a time\n").arg(QFileInfo(firmware_path).fileName()).arg(parallel);
+
+    foreach ( const dfu_device &device, device_list )
+    {
+        text += QString("%1  %2  %3 s")
+                .arg(device.serial.isEmpty() ? device.path : device.serial, -16)
+                .arg(device.status == flash_done ? tr("ok") : tr("FAILED"), -6)
+                .arg(device.elapsed_ms / 1000.0, 6, 'f', 1);
+        if ( device.status != flash_done && !device.message.isEmpty() )
+        {
+            text += "  " + device.message;
+        }
+        text += '\n';
+
+        sequential_ms += device.elapsed_ms;
+        if ( device.status == flash_done )
+        {
+            ok++;
+        }
+    }
+
+    text += tr("%1 of %2 devices flashed in %3 s (%4 s one after another)\n")
+            .arg(ok)
+            .arg(device_list.size())
+            .arg(batch_ms / 1000.0, 0, 'f', 1)
+            .arg(sequential_ms / 1000.0, 0, 'f', 1);
+
+    return text;
+}
@@ -0,0 +1,73 @@
+#ifndef BATCHFLASHER_H
+#define BATCHFLASHER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QList>
+
+enum { flash_waiting, flash_running, flash_done, flash_failed }; // dfu_device status
+
+typedef struct
+{
+    QString serial;         // preferred to select the device, path if empty
+    QString path;           // USB bus-port path
+    int status;
+    int percent;
+    QString phase;          // erase, download
+    QString message;        // last output line
+    qint64 elapsed_ms;
+} dfu_device;
+
+// Flashes the same firmware to every DFU device found by dfu-util -l.
+// One dfu-util process per device, at most max_parallel at a time. The
+// progress of each process is parsed from its \r delimited progress bar.
+class BatchFlasher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchFlasher(const QString &dfu_util, QObject *parent = 0);
+
+    const QList<dfu_device> &devices() const { return device_list; }
+    bool isRunning() const { return running > 0 || next_device < device_list.size(); }
+
+    void start(const QString &firmware, bool leave, int max_parallel);
+    QString report() const;
+
+    // STM32 DFU devices in the output of dfu-util -l
+    static QList<dfu_device> parse_list(const QString &output);
+
+public slots:
+    void enumerate();
+
+signals:
+    void devices_changed();
+    void device_changed(int index);
+    void finished();
+
+private slots:
+    void list_finished(int exit_code);
+    void process_output();
+    void process_finished(int exit_code, QProcess::ExitStatus status);
+    void process_error(QProcess::ProcessError error);
+
+private:
+    void launch_next();
+    void device_finished(QProcess *process, bool ok);
+
+    QString dfu_util_path;
+    QProcess list_process;
+    QList<dfu_device> device_list;
+    QList<QElapsedTimer> clocks;
+    QElapsedTimer batch_clock;
+    qint64 batch_ms;
+    QString firmware_path;
+    QByteArray firmware_image;  // for the sector hashes of the flashed devices
+    bool leave_dfu;
+    int parallel;
+    int next_device;        // next one to launch
+    int running;
+};
+
+#endif // BATCHFLASHER_H
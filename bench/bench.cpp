@@ -0,0 +1,619 @@
+// Benchmarks of the telemetry ingest, plotting and replot paths
+//
+// usage: bench [--json FILE] [QtTest options]
+//
+// Besides the usual QtTest output the results are written as JSON to
+// FILE (default bench.json), one entry per function and data row.
+// Rows that parse input also get their input size and throughput.
+// BENCH_MAX_POINTS limits the point counts of the large data rows
+// (default 1e8, the 1e8 row needs about 4 GB of memory).
+
+#include <QtTest>
+#include <QApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QXmlStreamReader>
+#include <math.h>
+#include <random>
+
+#include "protocol.h"
+#include "serialworker.h"
+#include "sessionlog.h"
+#include "spectrum.h"
+#include "telemetrystore.h"
+#include "qcustomplot.h"
+
+namespace {
+
+const int replay_samples = 20000;
+const int samples_per_record = 4;   // about one USB packet per readyRead()
+
+// input bytes per iteration by "function/tag", for the throughput in the JSON
+QHash<QString, qint64> input_bytes;
+
+// QCPGraph keeps its line optimisation protected
+class BenchGraph : public QCPGraph
+{
+public:
+    BenchGraph(QCPAxis *key_axis, QCPAxis *value_axis) : QCPGraph(key_axis, value_axis) {}
+
+    void optimized_line_data(QVector<QCPGraphData> *line_data) const
+    {
+        getOptimizedLineData(line_data, data()->constBegin(), data()->constEnd());
+    }
+};
+
+qint64 max_points()
+{
+    bool ok;
+    qint64 points = qgetenv("BENCH_MAX_POINTS").toLongLong(&ok);
+
+    return ok ? points : 100000000;
+}
+
+double sample_value(int channel, int index)
+{
+    return sin(index * (0.01 + 0.003 * channel)) + 0.1 * sin(index * 0.7);
+}
+
+void live_sample(int index, live_frame *frame)
+{
+    int i;
+
+    for ( i = 0; i < 3; i++ )
+    {
+        frame->acc[i] = sample_value(i, index);
+        frame->gyro[i] = sample_value(i + 3, index);
+        frame->angle[i] = sample_value(i + 6, index);
+        frame->sticks[i] = 2048;
+    }
+    frame->reserved = 0;
+}
+
+// session with the host side of the live tab negotiation and then
+// replay_samples live samples as ASCII lines or binary frames
+bool write_live_session(const QString &path, bool binary)
+{
+    SessionRecorder recorder;
+    QByteArray record;
+    live_frame frame;
+    uint8_t out[frame_header_size + sizeof(live_frame) + frame_crc_size];
+    qint64 time_ns = 0;
+    int i;
+
+    if ( !recorder.open(path) )
+    {
+        return false;
+    }
+
+    recorder.record(session_out, time_ns, "live_bin_tab", 13);
+    if ( !binary )
+    {
+        recorder.record(session_out, time_ns, "live_tab", 9);
+    }
+
+    for ( i = 0; i < replay_samples; i++ )
+    {
+        live_sample(i, &frame);
+
+        if ( binary )
+        {
+            record.append((const char *) out, frame_encode(frame_live, &frame, sizeof(frame), out));
+        }
+        else
+        {
+            record.append(QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n")
+                          .arg(frame.acc[0], 0, 'f', 4).arg(frame.acc[1], 0, 'f', 4).arg(frame.acc[2], 0, 'f', 4)
+                          .arg(frame.gyro[0], 0, 'f', 4).arg(frame.gyro[1], 0, 'f', 4).arg(frame.gyro[2], 0, 'f', 4)
+                          .arg(frame.angle[0], 0, 'f', 4).arg(frame.angle[1], 0, 'f', 4).arg(frame.angle[2], 0, 'f', 4)
+                          .toLatin1());
+        }
+
+        if ( (i + 1) % samples_per_record == 0 )
+        {
+            time_ns += 2000000 * samples_per_record;
+            recorder.record(session_in, time_ns, record.constData(), record.size());
+            record.clear();
+        }
+    }
+
+    recorder.close();
+    return true;
+}
+
+void fill_graph(QCPGraph *graph, qint64 points)
+{
+    QVector<QCPGraphData> data(points);
+    qint64 i;
+
+    for ( i = 0; i < points; i++ )
+    {
+        data[i].key = i;
+        data[i].value = sample_value(0, i);
+    }
+    graph->data()->set(data, true);
+}
+
+}
+
+class Bench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void live_parse_data();
+    void live_parse();
+    void telemetry_append();
+    void telemetry_window();
+    void ascii_parse_data();
+    void ascii_parse();
+    void real_fft_data();
+    void real_fft();
+    void container_add_data();
+    void container_add();
+    void optimized_line_data_data();
+    void optimized_line_data();
+    void live_replot_data();
+    void live_replot();
+    void colorize_data();
+    void colorize();
+
+private:
+    QTemporaryDir dir;
+    QThread serial_thread;
+    SerialWorker *serial;
+};
+
+void Bench::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    QVERIFY(write_live_session(dir.filePath("ascii.c101log"), false));
+    QVERIFY(write_live_session(dir.filePath("binary.c101log"), true));
+
+    // like the configurator, the engine runs in its own thread
+    serial = new SerialWorker;
+    serial->moveToThread(&serial_thread);
+    serial_thread.start();
+}
+
+void Bench::cleanupTestCase()
+{
+    serial->close();
+    serial_thread.quit();
+    serial_thread.wait();
+    delete serial;
+}
+
+void Bench::live_parse_data()
+{
+    QTest::addColumn<QString>("session");
+
+    QTest::newRow("ascii") << QString("ascii.c101log");
+    QTest::newRow("binary") << QString("binary.c101log");
+}
+
+// serialReadyRead() fed by a replay at full speed, the GUI side drains the ring
+void Bench::live_parse()
+{
+    QFETCH(QString, session);
+    QEventLoop loop;
+    QTimer guard;
+    serial_event event;
+    int samples = 0;
+
+    guard.setSingleShot(true);
+    connect(serial, SIGNAL(replay_finished()), &loop, SLOT(quit()));
+    connect(&guard, SIGNAL(timeout()), &loop, SLOT(quit()));
+
+    QBENCHMARK
+    {
+        samples = 0;
+        QVERIFY(serial->open_replay(dir.filePath(session), 0));
+        guard.start(60000);
+        loop.exec();
+        QVERIFY(guard.isActive());
+        guard.stop();
+        serial->close();
+
+        while ( serial->events()->pop(event) )
+        {
+            samples++;
+        }
+    }
+
+    QVERIFY(samples > 0);
+}
+
+void Bench::telemetry_append()
+{
+    static TelemetryStore store;
+    double values[TelemetryStore::channels];
+    int i, j;
+
+    QBENCHMARK
+    {
+        store.clear();
+        for ( i = 0; i < 1000000; i++ )
+        {
+            for ( j = 0; j < TelemetryStore::channels; j++ )
+            {
+                values[j] = sample_value(j, i);
+            }
+            store.append(i * 0.002, values);
+        }
+    }
+}
+
+void Bench::telemetry_window()
+{
+    static TelemetryStore store;
+    QVector<QCPGraphData> points;
+    double values[TelemetryStore::channels];
+    int i, j;
+
+    // one hour at 500 Hz, plotted as an 8 s window of a 781 px wide plot
+    for ( i = 0; i < 3600 * 500; i++ )
+    {
+        for ( j = 0; j < TelemetryStore::channels; j++ )
+        {
+            values[j] = sample_value(j, i);
+        }
+        store.append(i * 0.002, values);
+    }
+
+    QBENCHMARK
+    {
+        for ( j = 0; j < TelemetryStore::channels; j++ )
+        {
+            store.window(j, 3600 - 8, 3600, 2 * 781, points);
+        }
+    }
+
+    QVERIFY(!points.isEmpty());
+}
+
+void Bench::ascii_parse_data()
+{
+    QTest::addColumn<bool>("split");
+
+    QTest::newRow("split") << true;
+    QTest::newRow("parse_numbers") << false;
+}
+
+// replay_samples live lines, split is how read_lines() used to do it
+void Bench::ascii_parse()
+{
+    QFETCH(bool, split);
+    QList<QByteArray> lines;
+    live_frame frame;
+    double values[12];
+    double sum = 0;
+    qint64 bytes = 0;
+    int i, j;
+
+    for ( i = 0; i < replay_samples; i++ )
+    {
+        live_sample(i, &frame);
+        lines << QString("%1 %2 %3 %4 %5 %6 %7 %8 %9\n")
+                 .arg(frame.acc[0], 0, 'f', 4).arg(frame.acc[1], 0, 'f', 4).arg(frame.acc[2], 0, 'f', 4)
+                 .arg(frame.gyro[0], 0, 'f', 4).arg(frame.gyro[1], 0, 'f', 4).arg(frame.gyro[2], 0, 'f', 4)
+                 .arg(frame.angle[0], 0, 'f', 4).arg(frame.angle[1], 0, 'f', 4).arg(frame.angle[2], 0, 'f', 4)
+                 .toLatin1();
+        bytes += lines.last().size();
+    }
+
+    // checked once up front, a QVERIFY in the timed loop would be measured too
+    if ( !split )
+    {
+        for ( i = 0; i < lines.size(); i++ )
+        {
+            QCOMPARE(parse_numbers(lines.at(i).constData(), lines.at(i).size(), values, 12), 9);
+        }
+    }
+
+    input_bytes[QString("%1/%2").arg(QTest::currentTestFunction(), QTest::currentDataTag())] = bytes;
+
+    QBENCHMARK
+    {
+        for ( i = 0; i < lines.size(); i++ )
+        {
+            if ( split )
+            {
+                QString line = lines.at(i);
+                QStringList list = line.trimmed().split(' ');
+                QListIterator<QString> iter(list);
+
+                for ( j = 0; j < 9; j++ )
+                {
+                    values[j] = iter.next().toDouble();
+                }
+            }
+            else
+            {
+                parse_numbers(lines.at(i).constData(), lines.at(i).size(), values, 12);
+            }
+            sum += values[8];
+        }
+    }
+
+    QVERIFY(std::isfinite(sum));
+}
+
+void Bench::real_fft_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("512") << 512;
+    QTest::newRow("1024") << 1024;
+    QTest::newRow("4096") << 4096;
+}
+
+// one transform per segment of the analysis, 10000 of them
+void Bench::real_fft()
+{
+    QFETCH(int, size);
+    RealFft fft(size);
+    std::vector<float> in(size), re(fft.bins()), im(fft.bins());
+    int i;
+
+    for ( i = 0; i < size; i++ )
+    {
+        in[i] = sample_value(0, i);
+    }
+
+    QBENCHMARK
+    {
+        for ( i = 0; i < 10000; i++ )
+        {
+            fft.forward(in.data(), re.data(), im.data());
+        }
+    }
+
+    QVERIFY(std::isfinite(re[1]));
+}
+
+void Bench::container_add_data()
+{
+    QTest::addColumn<int>("points");
+    QTest::addColumn<double>("jitter");  // key disorder in samples
+
+    QTest::newRow("append 1e3") << 1000 << 0.0;
+    QTest::newRow("append 1e5") << 100000 << 0.0;
+    QTest::newRow("append 1e6") << 1000000 << 0.0;
+    QTest::newRow("jitter 1e5") << 100000 << 4.0;
+    QTest::newRow("random 1e3") << 1000 << -1.0;
+    QTest::newRow("random 1e4") << 10000 << -1.0;
+}
+
+void Bench::container_add()
+{
+    QFETCH(int, points);
+    QFETCH(double, jitter);
+    QVector<double> keys(points);
+    std::mt19937 random(1);
+    int i;
+
+    for ( i = 0; i < points; i++ )
+    {
+        if ( jitter < 0 )
+        {
+            keys[i] = random() % points;
+        }
+        else
+        {
+            keys[i] = i + jitter * random() / random.max();
+        }
+    }
+
+    QBENCHMARK
+    {
+        QCPGraphDataContainer container;
+
+        for ( i = 0; i < points; i++ )
+        {
+            container.add(QCPGraphData(keys[i], i));
+        }
+    }
+}
+
+void Bench::optimized_line_data_data()
+{
+    QTest::addColumn<qint64>("points");
+
+    QTest::newRow("1e3") << (qint64) 1000;
+    QTest::newRow("1e4") << (qint64) 10000;
+    QTest::newRow("1e5") << (qint64) 100000;
+    QTest::newRow("1e6") << (qint64) 1000000;
+    QTest::newRow("1e7") << (qint64) 10000000;
+    QTest::newRow("1e8") << (qint64) 100000000;
+}
+
+void Bench::optimized_line_data()
+{
+    QFETCH(qint64, points);
+    QCustomPlot plot;
+    QVector<QCPGraphData> line_data;
+
+    if ( points > max_points() )
+    {
+        QSKIP("above BENCH_MAX_POINTS");
+    }
+
+    BenchGraph *graph = new BenchGraph(plot.xAxis, plot.yAxis);
+    plot.resize(781, 331);
+    fill_graph(graph, points);
+    plot.xAxis->setRange(0, points);
+    plot.replot();
+
+    QBENCHMARK
+    {
+        graph->optimized_line_data(&line_data);
+    }
+
+    QVERIFY(!line_data.isEmpty());
+}
+
+void Bench::live_replot_data()
+{
+    QTest::addColumn<int>("points");    // per graph
+
+    QTest::newRow("window") << 2 * 781;
+    QTest::newRow("raw 8 s") << 8 * 500;
+    QTest::newRow("raw 60 s") << 60 * 500;
+}
+
+// the Live plots tab: 9 graphs in a full axes box
+void Bench::live_replot()
+{
+    QFETCH(int, points);
+    QCustomPlot plot;
+    int i;
+
+    plot.resize(781, 331);
+    for ( i = 0; i < 9; i++ )
+    {
+        plot.addGraph();
+        plot.graph(i)->setPen(QPen(QColor::fromHsv(i * 40, 255, 200)));
+        fill_graph(plot.graph(i), points);
+    }
+    plot.xAxis->setRangeReversed(true);
+    plot.axisRect()->setupFullAxesBox();
+    plot.xAxis->setRange(0, points);
+    plot.yAxis->rescale(true);
+
+    QBENCHMARK
+    {
+        plot.replot();
+    }
+}
+
+void Bench::colorize_data()
+{
+    QTest::addColumn<int>("points");
+
+    QTest::newRow("1e4") << 10000;
+    QTest::newRow("1e6") << 1000000;
+}
+
+void Bench::colorize()
+{
+    QFETCH(int, points);
+    QCPColorGradient gradient(QCPColorGradient::gpJet);
+    QVector<double> data(points);
+    QVector<QRgb> scan_line(points);
+    int i;
+
+    for ( i = 0; i < points; i++ )
+    {
+        data[i] = sample_value(0, i);
+    }
+
+    QBENCHMARK
+    {
+        gradient.colorize(data.constData(), QCPRange(-1.1, 1.1), scan_line.data(), points);
+    }
+}
+
+// converts the BenchmarkResult entries of the QtTest XML log
+bool write_json(const QString &xml_path, const QString &json_path)
+{
+    QFile xml_file(xml_path);
+    QFile json_file(json_path);
+    QXmlStreamReader xml;
+    QJsonArray results;
+    QJsonObject root;
+    QString function;
+
+    if ( !xml_file.open(QIODevice::ReadOnly) || !json_file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    {
+        return false;
+    }
+
+    xml.setDevice(&xml_file);
+    while ( !xml.atEnd() )
+    {
+        if ( xml.readNext() != QXmlStreamReader::StartElement )
+        {
+            continue;
+        }
+
+        if ( xml.name() == "TestFunction" )
+        {
+            function = xml.attributes().value("name").toString();
+        }
+        else if ( xml.name() == "BenchmarkResult" )
+        {
+            QJsonObject result;
+            QXmlStreamAttributes attributes = xml.attributes();
+            QString key = function + "/" + attributes.value("tag").toString();
+            double value = attributes.value("value").toDouble();
+
+            result["function"] = function;
+            result["tag"] = attributes.value("tag").toString();
+            result["metric"] = attributes.value("metric").toString();
+            result["value"] = value;
+            result["iterations"] = attributes.value("iterations").toInt();
+
+            // the value is per iteration
+            if ( input_bytes.contains(key) && attributes.value("metric") == "WalltimeMilliseconds" && value > 0 )
+            {
+                result["bytes"] = input_bytes.value(key);
+                result["bytes_per_second"] = input_bytes.value(key) / (value / 1000);
+            }
+            results.append(result);
+        }
+    }
+
+    root["qt"] = QString(qVersion());
+    root["commit"] = QString(qgetenv("GIT_COMMIT"));
+    root["results"] = results;
+    json_file.write(QJsonDocument(root).toJson());
+
+    return !xml.hasError();
+}
+
+int main(int argc, char *argv[])
+{
+    // plots render into their buffers, no display needed
+    if ( qEnvironmentVariableIsEmpty("DISPLAY") && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") )
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+    QStringList args = app.arguments();
+    QString json_path = "bench.json";
+    QTemporaryFile xml;
+    int index = args.indexOf("--json");
+    int result;
+    Bench bench;
+
+    if ( index > 0 && index + 1 < args.size() )
+    {
+        json_path = args.at(index + 1);
+        args.removeAt(index + 1);
+        args.removeAt(index);
+    }
+
+    if ( !xml.open() )
+    {
+        return 1;
+    }
+    args << "-o" << xml.fileName() + ",xml" << "-o" << "-,txt";
+
+    result = QTest::qExec(&bench, args);
+
+    if ( !write_json(xml.fileName(), json_path) )
+    {
+        qWarning("can't write %s", qPrintable(json_path));
+        return 1;
+    }
+
+    return result;
+}
+
+#include "bench.moc"
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Benchmarks of the ingest and plot paths,
+# see bench.cpp for usage
+#
+#-------------------------------------------------
+
+QT       += core gui widgets printsupport serialport testlib
+
+TARGET = bench
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++17
+
+INCLUDEPATH += ..
+
+SOURCES += bench.cpp \
+    ../protocol.cpp \
+    ../serialworker.cpp \
+    ../sessionlog.cpp \
+    ../spectrum.cpp \
+    ../telemetrystore.cpp \
+    ../qcustomplot.cpp
+
+HEADERS  += ../protocol.h \
+    ../serialworker.h \
+    ../sessionlog.h \
+    ../spectrum.h \
+    ../spscring.h \
+    ../telemetrystore.h \
+    ../qcustomplot.h
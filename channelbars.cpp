@@ -0,0 +1,71 @@
+#include "channelbars.h"
+
+namespace {
+
+// scene coordinates, the bars start at x = 10 and are value / 10 long
+const int bar_left = 10;
+const int bar_spacing = 29;
+const int bar_height = 10;
+const int scene_height = 329;
+
+// 0, the 1400 / 2700 thresholds of the rc labels, centre and full scale
+const int grid_x[] = { 10, 150, 215, 280, 419 };
+
+}
+
+ChannelBars::ChannelBars(QWidget *parent) :
+    QGraphicsView(parent)
+{
+    QPen outline_pen(Qt::black);
+    QBrush gray_brush(Qt::gray);
+    int i;
+
+    outline_pen.setWidth(1);
+
+    scene = new QGraphicsScene(this);
+    for ( i = 0; i < (int) (sizeof(grid_x) / sizeof(grid_x[0])); i++ )
+    {
+        scene->addLine(grid_x[i], 0, grid_x[i], scene_height, outline_pen);
+    }
+    for ( i = 0; i < channels; i++ )
+    {
+        bars[i] = scene->addRect(bar_left, i * bar_spacing, 0, bar_height, outline_pen, gray_brush);
+        shown[i] = 0;
+    }
+
+    // fixed, the bars must not grow the scene and move the view
+    scene->setSceneRect(grid_x[0], 0, grid_x[4] - grid_x[0], scene_height);
+    setScene(scene);
+    setViewportUpdateMode(QGraphicsView::MinimalViewportUpdate);
+}
+
+void ChannelBars::set_values(const QList<int> &values)
+{
+    latest = values;
+
+    if ( isVisible() )
+    {
+        update_bars();
+    }
+}
+
+void ChannelBars::showEvent(QShowEvent *event)
+{
+    QGraphicsView::showEvent(event);
+    update_bars();
+}
+
+void ChannelBars::update_bars()
+{
+    int i;
+
+    for ( i = 0; i < channels && i < latest.size(); i++ )
+    {
+        // a bar is one pixel per 10, smaller changes don't show
+        if ( latest.at(i) / 10 != shown[i] / 10 )
+        {
+            bars[i]->setRect(bar_left, i * bar_spacing, latest.at(i) / 10, bar_height);
+            shown[i] = latest.at(i);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CHANNELBARS_H
+#define CHANNELBARS_H
+
+#include <QGraphicsView>
+#include <QGraphicsScene>
+#include <QGraphicsRectItem>
+#include <QList>
+
+// Bars of the 12 rc channels.
+//
+// The scene with its grid lines and bars is built once, set_values() only
+// resizes the bars whose value changed, so the view repaints just their
+// region. While hidden nothing is touched, the latest values are applied
+// when the view is shown again.
+class ChannelBars : public QGraphicsView
+{
+    Q_OBJECT
+
+public:
+    enum { channels = 12 };
+
+    explicit ChannelBars(QWidget *parent = 0);
+
+    void set_values(const QList<int> &values);
+
+protected:
+    void showEvent(QShowEvent *event);
+
+private:
+    void update_bars();
+
+    QGraphicsScene *scene;
+    QGraphicsRectItem *bars[channels];
+    int shown[channels];    // value the bar is drawn with
+    QList<int> latest;
+};
+
+#endif // CHANNELBARS_H
@@ -13,12 +13,58 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets printsupport
 TARGET = configurator101
 TEMPLATE = app
 
+# std::from_chars in protocol.cpp
+CONFIG += c++17
+
 
 SOURCES += main.cpp\
         mainwindow.cpp \
+    analysisworker.cpp \
+    batchflashdialog.cpp \
+    batchflasher.cpp \
+    channelbars.cpp \
+    devicedashboard.cpp \
+    devicesession.cpp \
+    flashdiff.cpp \
+    hdrhistogram.cpp \
+    imagestore.cpp \
+    portwatcher.cpp \
+    protocol.cpp \
+    rclinkstats.cpp \
+    rcrecorder.cpp \
+    serialworker.cpp \
+    sessionlog.cpp \
+    settings.cpp \
+    slidingrange.cpp \
+    spectrum.cpp \
+    storedialog.cpp \
+    telemetrystore.cpp \
+    tuningdialog.cpp \
     qcustomplot.cpp
 
 HEADERS  += mainwindow.h \
+    analysisworker.h \
+    batchflashdialog.h \
+    batchflasher.h \
+    channelbars.h \
+    devicedashboard.h \
+    devicesession.h \
+    flashdiff.h \
+    hdrhistogram.h \
+    imagestore.h \
+    portwatcher.h \
+    protocol.h \
+    rclinkstats.h \
+    rcrecorder.h \
+    serialworker.h \
+    sessionlog.h \
+    settings.h \
+    slidingrange.h \
+    spectrum.h \
+    spscring.h \
+    storedialog.h \
+    telemetrystore.h \
+    tuningdialog.h \
     qcustomplot.h
 
 FORMS    += mainwindow.ui
@@ -0,0 +1,254 @@
+#include "devicedashboard.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QSet>
+
+namespace {
+
+const char *state_names[state_count] = {
+    "idle",         // state_idle
+    "channels",     // state_channels
+    "negotiating",  // state_channels_negotiate
+    "channels",     // state_channels_binary
+    "motors",       // state_motors
+    "negotiating",  // state_motors_negotiate
+    "motors",       // state_motors_binary
+    "negotiating",  // state_live_negotiate
+    "live (ASCII)", // state_live_ascii
+    "live",         // state_live_binary
+    "pulling",      // state_pull_wait
+    "pulling",      // state_pull_read
+    "pushing",      // state_push_wait_ok
+    "pushing",      // state_push_write
+    "pushing",      // state_push_wait_rcvd
+    "pushing"       // state_delta_wait_rcvd
+};
+
+}
+
+DeviceDashboard::DeviceDashboard(PortWatcher *port_watcher, QWidget *parent) :
+    QDialog(parent),
+    watcher(port_watcher)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QHBoxLayout *buttons = new QHBoxLayout;
+    QPushButton *button;
+
+    setWindowTitle(tr("Devices"));
+    resize(720, 360);
+
+    manager = new DeviceManager(this);
+
+    table = new QTableWidget(0, col_count, this);
+    table->setHorizontalHeaderLabels(QStringList() << tr("Port") << tr("State") << tr("Samples/s")
+                                     << tr("Roll") << tr("Nick") << tr("Settings"));
+    table->horizontalHeader()->setStretchLastSection(true);
+    table->verticalHeader()->hide();
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionMode(QAbstractItemView::NoSelection);
+    layout->addWidget(table);
+
+    button = new QPushButton(tr("Connect"), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(connect_selected()));
+    buttons->addWidget(button);
+    button = new QPushButton(tr("Disconnect"), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(disconnect_selected()));
+    buttons->addWidget(button);
+    button = new QPushButton(tr("Live"), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(live_selected()));
+    buttons->addWidget(button);
+    button = new QPushButton(tr("Pull"), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(pull_selected()));
+    buttons->addWidget(button);
+    push_button = new QPushButton(tr("Push to selected"), this);
+    push_button->setDisabled(true);
+    connect(push_button, SIGNAL(clicked()), this, SLOT(push_selected()));
+    buttons->addWidget(push_button);
+    layout->addLayout(buttons);
+
+    settings_label = new QLabel(tr("No settings to push, pull them in the main window first"), this);
+    layout->addWidget(settings_label);
+
+    refresh_timer = new QTimer(this);
+    connect(refresh_timer, SIGNAL(timeout()), this, SLOT(refresh()));
+    refresh_timer->start(250);
+
+    connect(watcher, SIGNAL(ports_changed()), this, SLOT(ports_changed()));
+    ports_changed();
+}
+
+void DeviceDashboard::set_settings(const QByteArray &data)
+{
+    settings_data = data;
+    push_button->setDisabled(settings_data.isEmpty());
+    settings_label->setText(tr("Pushing the settings of the main window (%1 bytes)").arg(settings_data.size()));
+}
+
+void DeviceDashboard::ports_changed()
+{
+    QStringList locations = PortWatcher::forced_ports();
+    QSet<QString> checked;
+    int row;
+
+    foreach ( const QSerialPortInfo &port, watcher->ports() )
+    {
+        if ( PortWatcher::is_flight_controller(port) )
+        {
+            locations.append(port.systemLocation());
+        }
+    }
+
+    for ( row = 0; row < rows.size(); row++ )
+    {
+        if ( table->item(row, col_port)->checkState() == Qt::Checked )
+        {
+            checked.insert(rows.at(row)->location());
+        }
+    }
+
+    // gone devices are dropped once they are closed
+    foreach ( DeviceSession *session, manager->sessions() )
+    {
+        if ( !locations.contains(session->location()) && !session->isOpen() )
+        {
+            manager->remove(session->location());
+        }
+    }
+
+    foreach ( const QString &location, locations )
+    {
+        manager->session(location);
+    }
+
+    rows = manager->sessions();
+    table->setRowCount(rows.size());
+    for ( row = 0; row < rows.size(); row++ )
+    {
+        QTableWidgetItem *item = new QTableWidgetItem(rows.at(row)->location());
+
+        item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+        item->setCheckState(checked.contains(rows.at(row)->location()) ? Qt::Checked : Qt::Unchecked);
+        table->setItem(row, col_port, item);
+
+        for ( int col = col_state; col < col_count; col++ )
+        {
+            table->setItem(row, col, new QTableWidgetItem);
+        }
+    }
+
+    refresh();
+}
+
+QString DeviceDashboard::state_text(const DeviceSession *session) const
+{
+    if ( !session->error().isEmpty() )
+    {
+        return session->error();
+    }
+
+    if ( !session->isOpen() )
+    {
+        return tr("closed");
+    }
+
+    return state_names[session->state()];
+}
+
+void DeviceDashboard::refresh()
+{
+    int row;
+    DeviceSession *session;
+    QString settings;
+
+    for ( row = 0; row < rows.size(); row++ )
+    {
+        session = rows.at(row);
+        session->poll();
+
+        switch ( session->push_state() )
+        {
+        case push_running:
+            settings = tr("pushing...");
+            break;
+        case push_done:
+            settings = tr("pushed in %1 ms").arg(session->push_elapsed_us() / 1000.0, 0, 'f', 0);
+            break;
+        case push_failed:
+            settings = tr("push failed");
+            break;
+        default:
+            settings = session->settings_blob().isEmpty() ? QString() : tr("pulled");
+            break;
+        }
+
+        table->item(row, col_state)->setText(state_text(session));
+        table->item(row, col_rate)->setText(session->isOpen() ? QString::number(session->sample_rate(), 'f', 0) : QString());
+        table->item(row, col_roll)->setText(QString::number(session->last_values()[6], 'f', 1));
+        table->item(row, col_nick)->setText(QString::number(session->last_values()[7], 'f', 1));
+        table->item(row, col_settings)->setText(settings);
+    }
+}
+
+QList<DeviceSession *> DeviceDashboard::selected() const
+{
+    QList<DeviceSession *> list;
+    int row;
+
+    for ( row = 0; row < rows.size(); row++ )
+    {
+        if ( table->item(row, col_port)->checkState() == Qt::Checked )
+        {
+            list.append(rows.at(row));
+        }
+    }
+
+    return list;
+}
+
+void DeviceDashboard::connect_selected()
+{
+    foreach ( DeviceSession *session, selected() )
+    {
+        if ( !session->isOpen() )
+        {
+            session->open();
+        }
+    }
+}
+
+void DeviceDashboard::disconnect_selected()
+{
+    foreach ( DeviceSession *session, selected() )
+    {
+        session->close();
+    }
+}
+
+void DeviceDashboard::live_selected()
+{
+    foreach ( DeviceSession *session, selected() )
+    {
+        if ( session->isOpen() )
+        {
+            session->start_live();
+        }
+    }
+}
+
+void DeviceDashboard::pull_selected()
+{
+    foreach ( DeviceSession *session, selected() )
+    {
+        if ( session->isOpen() )
+        {
+            session->pull_settings();
+        }
+    }
+}
+
+void DeviceDashboard::push_selected()
+{
+    manager->push_to(selected(), settings_data);
+}
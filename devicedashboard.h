@@ -0,0 +1,51 @@
+#ifndef DEVICEDASHBOARD_H
+#define DEVICEDASHBOARD_H
+
+#include <QDialog>
+#include <QTableWidget>
+#include <QPushButton>
+#include <QLabel>
+#include <QTimer>
+
+#include "devicesession.h"
+#include "portwatcher.h"
+
+// Compact view of all connected flight controllers, one row per device.
+// Commands apply to the checked rows, the settings push runs on all of
+// them in parallel.
+class DeviceDashboard : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceDashboard(PortWatcher *watcher, QWidget *parent = 0);
+
+    // blob pushed by "Push to selected", usually the one edited in the main window
+    void set_settings(const QByteArray &data);
+
+private slots:
+    void ports_changed();
+    void refresh();
+    void connect_selected();
+    void disconnect_selected();
+    void live_selected();
+    void pull_selected();
+    void push_selected();
+
+private:
+    enum { col_port, col_state, col_rate, col_roll, col_nick, col_settings, col_count };
+
+    QList<DeviceSession *> selected() const;
+    QString state_text(const DeviceSession *session) const;
+
+    PortWatcher *watcher;
+    DeviceManager *manager;
+    QTableWidget *table;
+    QTimer *refresh_timer;
+    QPushButton *push_button;
+    QLabel *settings_label;
+    QList<DeviceSession *> rows;
+    QByteArray settings_data;
+};
+
+#endif // DEVICEDASHBOARD_H
@@ -0,0 +1,203 @@
+#include "devicesession.h"
+#include "flashdiff.h"
+
+#include <string.h>
+
+namespace {
+
+// engine threads, the work per device is small, it's mostly waiting for I/O
+const int max_threads = 4;
+
+}
+
+DeviceSession::DeviceSession(const QString &location, QThread *thread, QObject *parent) :
+    QObject(parent),
+    port_location(location),
+    start_ns(0),
+    protocol_state(state_idle),
+    push_status(push_none),
+    push_us(0),
+    samples(0),
+    rate(0)
+{
+    memset(values, 0, sizeof(values));
+
+    worker = new SerialWorker;
+    worker->moveToThread(thread);
+
+    connect(worker, SIGNAL(state_changed(int)), this, SLOT(protocol_state_changed(int)));
+    connect(worker, SIGNAL(command_finished(int,bool,qint64)), this, SLOT(command_finished(int,bool,qint64)));
+    connect(worker, SIGNAL(settings_received(QByteArray)), this, SLOT(settings_received(QByteArray)));
+    connect(worker, SIGNAL(port_error(int)), this, SLOT(port_error(int)));
+
+    rate_clock.start();
+}
+
+DeviceSession::~DeviceSession()
+{
+    worker->close();
+    // deleted in its own thread
+    worker->deleteLater();
+}
+
+bool DeviceSession::open()
+{
+    error_text.clear();
+
+    if ( !worker->open(port_location) )
+    {
+        error_text = tr("Can't open");
+        return false;
+    }
+
+    return true;
+}
+
+void DeviceSession::close()
+{
+    worker->close();
+    rate = 0;
+}
+
+void DeviceSession::start_live()
+{
+    store.clear();
+    start_ns = 0;
+    worker->enqueue(cmd_live_tab);
+}
+
+void DeviceSession::stop_live()
+{
+    worker->enqueue(cmd_fw_tab);
+}
+
+void DeviceSession::pull_settings()
+{
+    worker->enqueue(cmd_pull_settings);
+}
+
+void DeviceSession::push_settings(const QByteArray &data)
+{
+    push_status = push_running;
+    worker->enqueue(cmd_push_settings, data);
+}
+
+void DeviceSession::poll()
+{
+    serial_event event;
+
+    while ( worker->events()->pop(event) )
+    {
+        if ( event.type != event_live )
+        {
+            continue;
+        }
+
+        if ( start_ns == 0 )
+        {
+            start_ns = event.time_ns;
+        }
+        store.append((event.time_ns - start_ns) / 1e9, event.values);
+        memcpy(values, event.values, sizeof(values));
+        samples++;
+    }
+
+    if ( rate_clock.elapsed() >= 1000 )
+    {
+        rate = samples * 1000.0 / rate_clock.restart();
+        samples = 0;
+    }
+}
+
+void DeviceSession::protocol_state_changed(int state)
+{
+    protocol_state = state;
+}
+
+void DeviceSession::command_finished(int command, bool ok, qint64 elapsed_us)
+{
+    if ( command == cmd_push_settings )
+    {
+        push_status = ok ? push_done : push_failed;
+        push_us = elapsed_us;
+        emit push_finished(ok, elapsed_us);
+
+        // even a failed push may have reached the flash
+        FlashPageCache::settings_written();
+    }
+    else if ( command == cmd_pull_settings && !ok )
+    {
+        error_text = tr("Pull failed");
+    }
+}
+
+void DeviceSession::settings_received(QByteArray data)
+{
+    settings_data = data;
+    error_text.clear();
+    emit pulled();
+}
+
+void DeviceSession::port_error(int error)
+{
+    error_text = tr("Port error %1").arg(error);
+}
+
+DeviceManager::DeviceManager(QObject *parent) :
+    QObject(parent),
+    next_thread(0)
+{
+    int count = qBound(1, QThread::idealThreadCount(), max_threads);
+    int i;
+
+    for ( i = 0; i < count; i++ )
+    {
+        threads.append(new QThread(this));
+        threads.last()->start();
+    }
+}
+
+DeviceManager::~DeviceManager()
+{
+    // the workers are deleted once their threads finish
+    qDeleteAll(session_map);
+    session_map.clear();
+
+    foreach ( QThread *thread, threads )
+    {
+        thread->quit();
+        thread->wait();
+    }
+}
+
+DeviceSession *DeviceManager::session(const QString &location)
+{
+    DeviceSession *s = session_map.value(location);
+
+    if ( s == 0 )
+    {
+        // round robin over the pool
+        s = new DeviceSession(location, threads.at(next_thread), this);
+        next_thread = (next_thread + 1) % threads.size();
+        session_map.insert(location, s);
+    }
+
+    return s;
+}
+
+void DeviceManager::remove(const QString &location)
+{
+    delete session_map.take(location);
+}
+
+void DeviceManager::push_to(const QList<DeviceSession *> &targets, const QByteArray &data)
+{
+    // only queued here, each engine streams the blob on its own thread
+    foreach ( DeviceSession *s, targets )
+    {
+        if ( s->isOpen() )
+        {
+            s->push_settings(data);
+        }
+    }
+}
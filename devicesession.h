@@ -0,0 +1,98 @@
+#ifndef DEVICESESSION_H
+#define DEVICESESSION_H
+
+#include <QObject>
+#include <QThread>
+#include <QMap>
+#include <QElapsedTimer>
+
+#include "serialworker.h"
+#include "telemetrystore.h"
+
+enum { push_none, push_running, push_done, push_failed }; // DeviceSession push state
+
+// One flight controller: its port and protocol engine, the settings blob
+// last pulled from it and the telemetry it streamed.
+// The engine runs in a thread given by the DeviceManager, everything else
+// lives in the GUI thread and is updated by poll().
+class DeviceSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    DeviceSession(const QString &location, QThread *thread, QObject *parent = 0);
+    ~DeviceSession();
+
+    QString location() const { return port_location; }
+    bool open();
+    void close();
+    bool isOpen() const { return worker->isOpen(); }
+
+    void start_live();
+    void stop_live();
+    void pull_settings();
+    void push_settings(const QByteArray &data);
+
+    // takes the samples decoded meanwhile, call about once per frame
+    void poll();
+
+    int state() const { return protocol_state; }
+    int push_state() const { return push_status; }
+    qint64 push_elapsed_us() const { return push_us; }
+    const QByteArray &settings_blob() const { return settings_data; }
+    const TelemetryStore &telemetry() const { return store; }
+    double sample_rate() const { return rate; }
+    const double *last_values() const { return values; }
+    QString error() const { return error_text; }
+
+signals:
+    void pulled();
+    void push_finished(bool ok, qint64 elapsed_us);
+
+private slots:
+    void protocol_state_changed(int state);
+    void command_finished(int command, bool ok, qint64 elapsed_us);
+    void settings_received(QByteArray data);
+    void port_error(int error);
+
+private:
+    SerialWorker *worker;
+    QString port_location;
+    QByteArray settings_data;
+    TelemetryStore store;
+    QElapsedTimer rate_clock;
+    qint64 start_ns;
+    int protocol_state;
+    int push_status;
+    qint64 push_us;
+    int samples;            // since the last rate update
+    double rate;            // live samples per second
+    double values[TelemetryStore::channels];
+    QString error_text;
+};
+
+// Owns the sessions and a small pool of threads their engines run in.
+// The engines are event driven, so a few threads serve many devices and
+// commands given to several sessions run in parallel.
+class DeviceManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceManager(QObject *parent = 0);
+    ~DeviceManager();
+
+    DeviceSession *session(const QString &location);   // created on first use
+    bool contains(const QString &location) const { return session_map.contains(location); }
+    void remove(const QString &location);
+    QList<DeviceSession *> sessions() const { return session_map.values(); }
+
+    void push_to(const QList<DeviceSession *> &targets, const QByteArray &data);
+
+private:
+    QList<QThread *> threads;
+    QMap<QString, DeviceSession *> session_map;
+    int next_thread;
+};
+
+#endif // DEVICESESSION_H
@@ -0,0 +1,394 @@
+#include "flashdiff.h"
+#include "batchflasher.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QDir>
+#include <QRegExp>
+
+namespace {
+
+// STM32F405 1 MB flash, sector 0 is the bootloader
+const struct { uint32_t address; uint32_t size; } flash_sectors[] = {
+    { 0x08004000, 0x4000 },
+    { 0x08008000, 0x4000 },
+    { 0x0800c000, 0x4000 },
+    { 0x08010000, 0x10000 },
+    { 0x08020000, 0x20000 },
+    { 0x08040000, 0x20000 },
+    { 0x08060000, 0x20000 },
+    { 0x08080000, 0x20000 },
+    { 0x080a0000, 0x20000 },
+    { 0x080c0000, 0x20000 },
+    { 0x080e0000, 0x20000 }
+};
+
+const int sector_count = sizeof(flash_sectors) / sizeof(flash_sectors[0]);
+
+QString cache_path()
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+
+    QDir().mkpath(dir);
+    return dir + "/flash_pages.json";
+}
+
+QJsonObject load_cache()
+{
+    QFile file(cache_path());
+
+    if ( !file.open(QIODevice::ReadOnly) )
+    {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+void save_cache(const QJsonObject &cache)
+{
+    QFile file(cache_path());
+
+    if ( file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    {
+        file.write(QJsonDocument(cache).toJson());
+    }
+}
+
+// image size rounded up to the end of its last sector
+uint32_t sector_end(uint32_t size)
+{
+    int i;
+
+    for ( i = 0; i < sector_count; i++ )
+    {
+        if ( flash_sectors[i].address + flash_sectors[i].size - firmware_address >= size )
+        {
+            return flash_sectors[i].address + flash_sectors[i].size - firmware_address;
+        }
+    }
+    return 0;
+}
+
+}
+
+sector_hashes FlashPageCache::load(const QString &serial)
+{
+    QJsonObject sectors = load_cache().value(serial).toObject().value("sectors").toObject();
+    sector_hashes hashes;
+
+    foreach ( const QString &address, sectors.keys() )
+    {
+        hashes.insert(address.toUInt(0, 16), QByteArray::fromHex(sectors.value(address).toString().toLatin1()));
+    }
+    return hashes;
+}
+
+void FlashPageCache::store(const QString &serial, const sector_hashes &hashes)
+{
+    QJsonObject cache = load_cache();
+    QJsonObject device = cache.value(serial).toObject();
+    QJsonObject sectors = device.value("sectors").toObject();
+
+    if ( serial.isEmpty() )
+    {
+        return;
+    }
+
+    // sectors outside the flashed or read range keep their content
+    foreach ( uint32_t address, hashes.keys() )
+    {
+        sectors.insert(QString::number(address, 16), QString(hashes.value(address).toHex()));
+    }
+
+    device.insert("sectors", sectors);
+    cache.insert(serial, device);
+    save_cache(cache);
+}
+
+void FlashPageCache::forget(const QString &serial)
+{
+    QJsonObject cache = load_cache();
+
+    cache.remove(serial);
+    save_cache(cache);
+}
+
+void FlashPageCache::settings_written()
+{
+    QJsonObject cache = load_cache();
+    QJsonObject device, sectors;
+    int i;
+
+    foreach ( const QString &serial, cache.keys() )
+    {
+        device = cache.value(serial).toObject();
+        sectors = device.value("sectors").toObject();
+
+        for ( i = 0; i < sector_count; i++ )
+        {
+            if ( flash_sectors[i].address + flash_sectors[i].size > firmware_address + firmware_max_size )
+            {
+                sectors.remove(QString::number(flash_sectors[i].address, 16));
+            }
+        }
+
+        device.insert("sectors", sectors);
+        cache.insert(serial, device);
+    }
+    save_cache(cache);
+}
+
+sector_hashes FlashPageCache::hash(const QByteArray &image, bool pad)
+{
+    sector_hashes hashes;
+    QByteArray sector;
+    uint32_t offset;
+    int i;
+
+    for ( i = 0; i < sector_count; i++ )
+    {
+        offset = flash_sectors[i].address - firmware_address;
+        if ( offset >= (uint32_t) image.size() || (!pad && offset + flash_sectors[i].size > (uint32_t) image.size()) )
+        {
+            break;
+        }
+
+        sector = image.mid(offset, flash_sectors[i].size);
+        sector.append(QByteArray(flash_sectors[i].size - sector.size(), '\xff'));
+        hashes.insert(flash_sectors[i].address, QCryptographicHash::hash(sector, QCryptographicHash::Sha256));
+    }
+    return hashes;
+}
+
+QString DiffFlasher::single_serial(const QString &list)
+{
+    QList<dfu_device> devices = BatchFlasher::parse_list(list);
+
+    return devices.size() == 1 ? devices.at(0).serial : QString();
+}
+
+DiffFlasher::DiffFlasher(const QString &dfu_util, QObject *parent) :
+    QObject(parent),
+    dfu_util_path(dfu_util),
+    step(step_idle),
+    leave_dfu(false),
+    changed(0),
+    sectors(0),
+    written(0)
+{
+    write_file = QDir::temp().filePath("configurator101_sector.bin");
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    connect(&process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(process_finished(int,QProcess::ExitStatus)));
+    connect(&process, SIGNAL(errorOccurred(QProcess::ProcessError)), this, SLOT(process_error(QProcess::ProcessError)));
+}
+
+void DiffFlasher::start(const QString &firmware, bool leave)
+{
+    QFile file(firmware);
+
+    if ( isRunning() )
+    {
+        return;
+    }
+
+    if ( !file.open(QIODevice::ReadOnly) )
+    {
+        emit output(tr("'%1' cannot be read...").arg(firmware));
+        emit finished(false);
+        return;
+    }
+
+    image = file.readAll();
+    if ( image.isEmpty() || sector_end(image.size()) == 0 )
+    {
+        emit output(tr("'%1' does not fit into the flash...").arg(firmware));
+        emit finished(false);
+        return;
+    }
+    // flashing erases whole sectors, the rest of the last one ends up blank
+    image.append(QByteArray(sector_end(image.size()) - image.size(), '\xff'));
+
+    leave_dfu = leave;
+    writes.clear();
+    written = 0;
+    clock.start();
+
+    step = step_list;
+    run(QStringList() << "-l");
+}
+
+void DiffFlasher::run(const QStringList &args)
+{
+    process.start(dfu_util_path, args);
+}
+
+void DiffFlasher::process_finished(int exit_code, QProcess::ExitStatus status)
+{
+    QString out = process.readAll();
+    QStringList lines = out.split(QRegExp("[\\r\\n]"), QString::SkipEmptyParts);
+    QList<dfu_device> devices;
+    QFile file(write_file);
+
+    if ( status != QProcess::NormalExit || exit_code != 0 )
+    {
+        // what is on the device is unknown now
+        if ( step == step_write )
+        {
+            FlashPageCache::forget(serial);
+        }
+        finish(false, lines.isEmpty() ? tr("dfu-util failed...") : lines.last().trimmed());
+        return;
+    }
+
+    switch ( step )
+    {
+    case step_list:
+        devices = BatchFlasher::parse_list(out);
+        if ( devices.size() != 1 || devices.at(0).serial.isEmpty() )
+        {
+            finish(false, devices.isEmpty() ? tr("No DFU device found...")
+                                            : tr("Diff flashing needs exactly one DFU device with a serial number, use batch flashing for several..."));
+            return;
+        }
+        serial = devices.at(0).serial;
+
+        if ( FlashPageCache::load(serial).isEmpty() )
+        {
+            // nothing known about this device, read the part the image covers
+            emit output(tr("Reading back %1 KB from %2...").arg(image.size() / 1024).arg(serial));
+            file.remove();
+            step = step_read;
+            run(QStringList() << "-S" << serial << "-a" << "0"
+                << "-s" << QString("0x%1:%2").arg(firmware_address, 0, 16).arg(image.size())
+                << "-U" << write_file);
+            return;
+        }
+        compare(FlashPageCache::load(serial));
+        break;
+
+    case step_read:
+        if ( !file.open(QIODevice::ReadOnly) )
+        {
+            finish(false, tr("Reading back the flash failed..."));
+            return;
+        }
+        compare(FlashPageCache::hash(file.readAll(), false));
+        break;
+
+    case step_write:
+        written += writes.first().data.size();
+        writes.removeFirst();
+        write_next();
+        break;
+    }
+}
+
+void DiffFlasher::process_error(QProcess::ProcessError error)
+{
+    // a process that never started doesn't emit finished()
+    if ( error != QProcess::FailedToStart || step == step_idle )
+    {
+        return;
+    }
+
+    // earlier downloads of this run may have gone through
+    if ( step == step_write )
+    {
+        FlashPageCache::forget(serial);
+    }
+    finish(false, process.errorString());
+}
+
+void DiffFlasher::compare(const sector_hashes &device)
+{
+    sector_hashes wanted = FlashPageCache::hash(image, true);
+    flash_write write;
+    uint32_t address;
+    int i;
+
+    changed = 0;
+    sectors = wanted.size();
+    write.address = 0;
+
+    for ( i = 0; i < sector_count; i++ )
+    {
+        address = flash_sectors[i].address;
+        if ( !wanted.contains(address) )
+        {
+            break;
+        }
+
+        if ( device.value(address) == wanted.value(address) )
+        {
+            continue;
+        }
+
+        changed++;
+
+        // contiguous changed sectors are one download
+        if ( !writes.isEmpty() && writes.last().address + writes.last().data.size() == address )
+        {
+            writes.last().data.append(image.mid(address - firmware_address, flash_sectors[i].size));
+        }
+        else
+        {
+            write.address = address;
+            write.data = image.mid(address - firmware_address, flash_sectors[i].size);
+            writes.append(write);
+        }
+    }
+
+    // dfu-util only leaves DFU mode after a download, rewrite the first (smallest) sector for that
+    if ( writes.isEmpty() && leave_dfu )
+    {
+        write.address = firmware_address;
+        write.data = image.left(flash_sectors[0].size);
+        writes.append(write);
+    }
+
+    emit output(tr("%1 of %2 sectors changed").arg(changed).arg(sectors));
+
+    step = step_write;
+    write_next();
+}
+
+void DiffFlasher::write_next()
+{
+    QFile file(write_file);
+    const flash_write *write;
+
+    if ( writes.isEmpty() )
+    {
+        FlashPageCache::store(serial, FlashPageCache::hash(image, true));
+        finish(true, tr("Wrote %1 KB of %2 KB in %3 s")
+               .arg(written / 1024)
+               .arg(image.size() / 1024)
+               .arg(clock.elapsed() / 1000.0, 0, 'f', 1));
+        return;
+    }
+
+    write = &writes.first();
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(write->data) != write->data.size() )
+    {
+        finish(false, tr("'%1' cannot be written...").arg(write_file));
+        return;
+    }
+    file.close();
+
+    emit output(tr("Writing %1 KB at 0x%2...").arg(write->data.size() / 1024).arg(write->address, 0, 16));
+    run(QStringList() << "-S" << serial << "-a" << "0"
+        << "-s" << QString("0x%1%2").arg(write->address, 0, 16).arg(leave_dfu && writes.size() == 1 ? ":leave" : "")
+        << "-D" << write_file);
+}
+
+void DiffFlasher::finish(bool ok, const QString &text)
+{
+    QFile::remove(write_file);
+    step = step_idle;
+
+    emit output(text);
+    emit finished(ok);
+}
@@ -0,0 +1,92 @@
+#ifndef FLASHDIFF_H
+#define FLASHDIFF_H
+
+#include <QObject>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QList>
+#include <stdint.h>
+
+enum { firmware_address = 0x08004000 }; // sector 0 holds the bootloader
+enum { firmware_max_size = 102400 };     // the firmware keeps its settings in the flash behind
+
+// Hashes of the flash sectors on one device, keyed by sector address.
+// Missing sectors are unknown and always written.
+typedef QMap<uint32_t, QByteArray> sector_hashes;
+
+// Last known flash content per DFU serial, kept from the previous diff flash
+// or firmware save so the device does not have to be read back. Stored
+// hashes are merged, a sector keeps its hash until it is written again.
+class FlashPageCache
+{
+public:
+    static sector_hashes load(const QString &serial);
+    static void store(const QString &serial, const sector_hashes &hashes);
+    static void forget(const QString &serial);
+    // the settings were written over the serial port, which device is
+    // unknown, so the settings area of every device is dropped
+    static void settings_written();
+
+    // sectors completely covered by an image at firmware_address, the last
+    // one padded with 0xff if pad is set (that is what flashing leaves behind)
+    static sector_hashes hash(const QByteArray &image, bool pad);
+};
+
+// Flashes only the sectors that differ from what the device holds.
+//
+// The STM32F4 erases whole sectors (16, 64 or 128 KB), so a sector is the
+// page here. Contiguous changed sectors go out in one dfu-util download,
+// which erases exactly the sectors it touches.
+class DiffFlasher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DiffFlasher(const QString &dfu_util, QObject *parent = 0);
+
+    bool isRunning() const { return step != step_idle; }
+    QString device() const { return serial; }
+    void start(const QString &firmware, bool leave);
+
+    // serial of the only DFU device in dfu-util -l output, empty if there
+    // are none or several
+    static QString single_serial(const QString &list);
+
+signals:
+    void output(QString text);
+    void finished(bool ok);
+
+private slots:
+    void process_finished(int exit_code, QProcess::ExitStatus status);
+    void process_error(QProcess::ProcessError error);
+
+private:
+    enum { step_idle, step_list, step_read, step_write };
+
+    typedef struct
+    {
+        uint32_t address;
+        QByteArray data;
+    } flash_write;
+
+    void run(const QStringList &args);
+    void compare(const sector_hashes &device);
+    void write_next();
+    void finish(bool ok, const QString &text);
+
+    QString dfu_util_path;
+    QProcess process;
+    int step;
+    QString serial;
+    QByteArray image;       // padded to whole sectors
+    bool leave_dfu;
+    QList<flash_write> writes;
+    QString write_file;
+    int changed;
+    int sectors;
+    qint64 written;
+    QElapsedTimer clock;
+};
+
+#endif // FLASHDIFF_H
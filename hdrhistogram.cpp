@@ -0,0 +1,124 @@
+#include "hdrhistogram.h"
+
+namespace {
+
+int highest_bit(uint64_t value)
+{
+    int bit = -1;
+
+    while ( value != 0 )
+    {
+        value >>= 1;
+        bit++;
+    }
+
+    return bit;
+}
+
+}
+
+HdrHistogram::HdrHistogram(int64_t highest_value, int precision_bits) :
+    bits(precision_bits),
+    highest(highest_value)
+{
+    int sub = 1 << bits;
+
+    counts.resize(highest < sub ? sub : index_of(highest) + 1);
+    clear();
+}
+
+void HdrHistogram::clear()
+{
+    counts.assign(counts.size(), 0);
+    total = 0;
+    sum = 0;
+    lowest_seen = 0;
+    highest_seen = 0;
+}
+
+int HdrHistogram::index_of(int64_t value) const
+{
+    int sub = 1 << bits;
+    int half = sub / 2;
+    int shift;
+
+    if ( value < sub )
+    {
+        return (int) value;
+    }
+
+    // value >> shift lands in the upper half of the linear range
+    shift = highest_bit(value) - bits + 1;
+    return shift * half + (int) (value >> shift);
+}
+
+int64_t HdrHistogram::bucket_low(int index) const
+{
+    int sub = 1 << bits;
+    int half = sub / 2;
+    int shift;
+
+    if ( index < sub )
+    {
+        return index;
+    }
+
+    shift = index / half - 1;
+    return (int64_t) (index - shift * half) << shift;
+}
+
+int64_t HdrHistogram::bucket_high(int index) const
+{
+    return index + 1 < (1 << bits) ? index : bucket_low(index + 1) - 1;
+}
+
+void HdrHistogram::record(int64_t value)
+{
+    if ( value < 0 )
+    {
+        value = 0;
+    }
+
+    if ( total == 0 || value < lowest_seen )
+    {
+        lowest_seen = value;
+    }
+    if ( total == 0 || value > highest_seen )
+    {
+        highest_seen = value;
+    }
+    total++;
+    sum += value;
+
+    counts[value > highest ? counts.size() - 1 : index_of(value)]++;
+}
+
+int64_t HdrHistogram::percentile(double percent) const
+{
+    uint64_t wanted;
+    uint64_t seen = 0;
+    int i;
+
+    if ( total == 0 )
+    {
+        return 0;
+    }
+
+    wanted = (uint64_t) (percent / 100 * total + 0.5);
+    if ( wanted < 1 )
+    {
+        wanted = 1;
+    }
+
+    for ( i = 0; i < (int) counts.size(); i++ )
+    {
+        seen += counts[i];
+        if ( seen >= wanted )
+        {
+            // the last bucket also holds everything above highest
+            return bucket_high(i) < highest_seen && i + 1 < (int) counts.size() ? bucket_high(i) : highest_seen;
+        }
+    }
+
+    return highest_seen;
+}
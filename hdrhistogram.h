@@ -0,0 +1,49 @@
+#ifndef HDRHISTOGRAM_H
+#define HDRHISTOGRAM_H
+
+#include <vector>
+#include <stdint.h>
+
+// Histogram of non-negative integers with a fixed relative precision, in
+// the manner of HdrHistogram.
+//
+// Values below 2^bits have a bucket each, above that every power of two
+// range is split into 2^(bits - 1) equal buckets, so a bucket is never
+// wider than 1 / 2^(bits - 1) of its values. The counts are allocated once
+// for the whole range, recording never allocates and memory doesn't grow
+// no matter how many values are recorded. Values above highest are
+// counted in the last bucket, min() and max() stay exact.
+class HdrHistogram
+{
+public:
+    HdrHistogram(int64_t highest, int bits);
+
+    void clear();
+    void record(int64_t value);
+
+    uint64_t count() const { return total; }
+    int64_t min() const { return total > 0 ? lowest_seen : 0; }
+    int64_t max() const { return highest_seen; }
+    double mean() const { return total > 0 ? (double) sum / total : 0; }
+    // highest value of the bucket holding the given percentile (0..100)
+    int64_t percentile(double percent) const;
+
+    // non-empty buckets for export, index from 0 to buckets() - 1
+    int buckets() const { return (int) counts.size(); }
+    uint64_t bucket_count(int index) const { return counts[index]; }
+    int64_t bucket_low(int index) const;
+    int64_t bucket_high(int index) const;
+
+private:
+    int index_of(int64_t value) const;
+
+    int bits;
+    int64_t highest;
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    double sum;
+    int64_t lowest_seen;
+    int64_t highest_seen;
+};
+
+#endif // HDRHISTOGRAM_H
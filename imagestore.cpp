@@ -0,0 +1,214 @@
+#include "imagestore.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+
+namespace {
+
+const char *kind_names[] = { "firmware", "settings" };
+
+int kind_from_name(const QString &name)
+{
+    return name == kind_names[store_settings] ? store_settings : store_firmware;
+}
+
+bool newer(const store_entry &a, const store_entry &b)
+{
+    return a.time > b.time;
+}
+
+}
+
+ImageStore::ImageStore()
+{
+    root = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/store";
+    QDir().mkpath(root + "/objects");
+    load_index();
+}
+
+QString ImageStore::hash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+}
+
+QString ImageStore::path(const QString &hash) const
+{
+    return root + "/objects/" + hash.left(2) + "/" + hash.mid(2);
+}
+
+bool ImageStore::contains(const QString &hash) const
+{
+    return hash.size() == 64 && QFile::exists(path(hash));
+}
+
+QString ImageStore::put(int kind, const QByteArray &data, const QString &device, const QString &label)
+{
+    QString key = hash(data);
+    store_entry entry;
+    int i;
+
+    // a damaged object is replaced by the good copy
+    if ( get(key).isEmpty() )
+    {
+        // written under a temporary name, a crash never leaves half an object
+        QSaveFile file(path(key));
+
+        QDir().mkpath(root + "/objects/" + key.left(2));
+        if ( !file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit() )
+        {
+            return QString();
+        }
+    }
+
+    for ( i = 0; i < index.size(); i++ )
+    {
+        if ( index.at(i).hash == key && index.at(i).device == device )
+        {
+            index[i].time = QDateTime::currentDateTime();
+            if ( !label.isEmpty() )
+            {
+                index[i].label = label;
+            }
+            save_index();
+            return key;
+        }
+    }
+
+    entry.hash = key;
+    entry.kind = kind;
+    entry.size = data.size();
+    entry.device = device;
+    entry.time = QDateTime::currentDateTime();
+    entry.label = label;
+    index.append(entry);
+    save_index();
+
+    return key;
+}
+
+QString ImageStore::put_file(int kind, const QString &file_path, const QString &device, const QString &label)
+{
+    QFile file(file_path);
+    QByteArray data;
+
+    if ( !file.open(QIODevice::ReadOnly) )
+    {
+        return QString();
+    }
+    data = file.readAll();
+
+    // flashed straight out of the store, the object name is no label
+    if ( QFileInfo(file_path).absoluteFilePath() == QFileInfo(path(hash(data))).absoluteFilePath() )
+    {
+        return put(kind, data, device, QString());
+    }
+    return put(kind, data, device, label);
+}
+
+QByteArray ImageStore::get(const QString &key) const
+{
+    QFile file(path(key));
+    QByteArray data;
+
+    if ( !contains(key) || !file.open(QIODevice::ReadOnly) )
+    {
+        return QByteArray();
+    }
+
+    data = file.readAll();
+    return hash(data) == key ? data : QByteArray();
+}
+
+void ImageStore::remove(const QString &key)
+{
+    int i;
+
+    for ( i = index.size() - 1; i >= 0; i-- )
+    {
+        if ( index.at(i).hash == key )
+        {
+            index.removeAt(i);
+        }
+    }
+    QFile::remove(path(key));
+    save_index();
+}
+
+QList<store_entry> ImageStore::entries(int kind) const
+{
+    QList<store_entry> list;
+
+    foreach ( const store_entry &entry, index )
+    {
+        if ( entry.kind == kind )
+        {
+            list.append(entry);
+        }
+    }
+    std::sort(list.begin(), list.end(), newer);
+
+    return list;
+}
+
+void ImageStore::load_index()
+{
+    QFile file(root + "/index.json");
+    store_entry entry;
+
+    index.clear();
+    if ( !file.open(QIODevice::ReadOnly) )
+    {
+        return;
+    }
+
+    foreach ( const QJsonValue &value, QJsonDocument::fromJson(file.readAll()).array() )
+    {
+        QJsonObject object = value.toObject();
+
+        entry.hash = object.value("hash").toString();
+        entry.kind = kind_from_name(object.value("kind").toString());
+        entry.size = object.value("size").toVariant().toLongLong();
+        entry.device = object.value("device").toString();
+        entry.time = QDateTime::fromString(object.value("time").toString(), Qt::ISODate);
+        entry.label = object.value("label").toString();
+
+        // objects deleted by hand are dropped from the index
+        if ( contains(entry.hash) )
+        {
+            index.append(entry);
+        }
+    }
+}
+
+void ImageStore::save_index() const
+{
+    QSaveFile file(root + "/index.json");
+    QJsonArray array;
+
+    foreach ( const store_entry &entry, index )
+    {
+        QJsonObject object;
+
+        object.insert("hash", entry.hash);
+        object.insert("kind", kind_names[entry.kind]);
+        object.insert("size", entry.size);
+        object.insert("device", entry.device);
+        object.insert("time", entry.time.toString(Qt::ISODate));
+        object.insert("label", entry.label);
+        array.append(object);
+    }
+
+    if ( file.open(QIODevice::WriteOnly) )
+    {
+        file.write(QJsonDocument(array).toJson());
+        file.commit();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+
+enum { store_firmware, store_settings }; // store_entry kind
+
+typedef struct
+{
+    QString hash;       // SHA-256, hex
+    int kind;
+    qint64 size;
+    QString device;     // DFU serial or serial port, empty if unknown
+    QDateTime time;     // last stored
+    QString label;      // source file or what the image came from
+} store_entry;
+
+// Local content-addressed store for firmware images and settings blocks.
+//
+//   <AppDataLocation>/store/objects/ab/cdef...   content, named by its SHA-256
+//   <AppDataLocation>/store/index.json           one entry per image and device
+//
+// An image is written once no matter how often it is stored, storing it
+// again for the same device only refreshes the entry.
+class ImageStore
+{
+public:
+    ImageStore();
+
+    // hash of the stored image, empty on a write error
+    QString put(int kind, const QByteArray &data, const QString &device, const QString &label);
+    QString put_file(int kind, const QString &path, const QString &device, const QString &label);
+
+    bool contains(const QString &hash) const;
+    QString path(const QString &hash) const;
+    QByteArray get(const QString &hash) const;  // empty if missing or corrupt
+    void remove(const QString &hash);
+
+    QList<store_entry> entries(int kind) const; // newest first
+
+    static QString hash(const QByteArray &data);
+
+private:
+    void load_index();
+    void save_index() const;
+
+    QString root;
+    QList<store_entry> index;
+};
+
+#endif // IMAGESTORE_H
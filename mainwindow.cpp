@@ -1,5 +1,7 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include <QScreen>
+#include <math.h>
 
 namespace {
 
@@ -50,6 +52,161 @@ matrix sensor_orientation = { // Front   Left   Top
                             {     0,      1,     0  }, // y
                             {     0,      0,     1  }  // z
                             };
+
+// Widgets showing a settings field, by object name. The rc assignments are
+// edited through rc_func and bound by rc_functions below.
+constexpr struct
+{
+    const char *widget;
+    const char *field;
+    int index;
+} settings_bindings[] = {
+    { "roll_kp", "pidvars", RKp },
+    { "roll_ki", "pidvars", RKi },
+    { "roll_kd", "pidvars", RKd },
+    { "nick_kp", "pidvars", NKp },
+    { "nick_ki", "pidvars", NKi },
+    { "nick_kd", "pidvars", NKd },
+    { "gier_kp", "pidvars", GKp },
+    { "gier_ki", "pidvars", GKi },
+    { "gier_kd", "pidvars", GKd },
+    { "l_roll_kp", "l_pidvars", RKp },
+    { "l_roll_ki", "l_pidvars", RKi },
+    { "l_roll_kd", "l_pidvars", RKd },
+    { "l_nick_kp", "l_pidvars", NKp },
+    { "l_nick_ki", "l_pidvars", NKi },
+    { "l_nick_kd", "l_pidvars", NKd },
+    { "l_gier_kp", "l_pidvars", GKp },
+    { "l_gier_ki", "l_pidvars", GKi },
+    { "l_gier_kd", "l_pidvars", GKd },
+    { "roll_rate", "rate", roll },
+    { "nick_rate", "rate", nick },
+    { "gier_rate", "rate", gier },
+    { "motor1_ch_spinBox", "motor.tim_ch", 0 },
+    { "motor2_ch_spinBox", "motor.tim_ch", 1 },
+    { "motor3_ch_spinBox", "motor.tim_ch", 2 },
+    { "motor4_ch_spinBox", "motor.tim_ch", 3 },
+    { "aspect_ratio_doubleSpinBox", "aspect_ratio", 0 },
+    { "rx_select_comboBox", "receiver", 0 },
+    { "esc_select_comboBox", "esc_mode", 0 },
+    { "low_bat_volt_doubleSpinBox", "low_voltage", 0 }
+};
+
+constexpr unsigned settings_binding_count = sizeof(settings_bindings) / sizeof(settings_bindings[0]);
+
+constexpr const settings_field &settings_binding_field(unsigned b)
+{
+    return settings_current.fields[settings_field_index(settings_current, settings_bindings[b].field)];
+}
+
+constexpr bool settings_bindings_valid(unsigned b = 0)
+{
+    return b == settings_binding_count ||
+           ( settings_field_index(settings_current, settings_bindings[b].field) >= 0 && settings_bindings[b].index >= 0 &&
+             settings_bindings[b].index < settings_binding_field(b).count && settings_bindings_valid(b + 1) );
+}
+
+static_assert(settings_bindings_valid(), "settings_bindings names a field the current layout doesn't have");
+
+// Fields the configuration tab keeps in its own state instead of a widget
+constexpr int motor_direction_field = settings_field_index(settings_current, "motor.rotational_direction");
+constexpr int rc_func_number_field = settings_field_index(settings_current, "rc_func.number");
+constexpr int rc_func_rev_field = settings_field_index(settings_current, "rc_func.rev");
+constexpr int rc_ch_number_field = settings_field_index(settings_current, "rc_ch.number");
+constexpr int rc_ch_rev_field = settings_field_index(settings_current, "rc_ch.rev");
+constexpr int sensor_orient_field = settings_field_index(settings_current, "sensor_orient");
+
+static_assert(motor_direction_field >= 0 && settings_current.fields[motor_direction_field].count == 4 &&
+              rc_func_number_field >= 0 && settings_current.fields[rc_func_number_field].count == 13 &&
+              rc_func_rev_field >= 0 && settings_current.fields[rc_func_rev_field].count == 13 &&
+              rc_ch_number_field >= 0 && settings_current.fields[rc_ch_number_field].count == 13 &&
+              rc_ch_rev_field >= 0 && settings_current.fields[rc_ch_rev_field].count == 13 &&
+              sensor_orient_field >= 0 && settings_current.fields[sensor_orient_field].count == 9,
+              "the configuration tab needs a field the current layout doesn't have");
+
+// The rc functions in rc_func order. Each has the widgets rc_<name>_spinBox,
+// rc_<name>_rev_checkBox and rc_<name>_label. The label shows states[0] below
+// low, states[2] above high and states[1] in between, the two position
+// switches have no low state and flip at 2700.
+typedef struct
+{
+    int function;
+    const char *name;
+    int low;
+    int high;
+    const char *states[3];
+} rc_function_desc;
+
+constexpr rc_function_desc rc_functions[] = {
+    { r_thrust, "thrust", 1400, 2700, { "low", "middle", "high" } },
+    { r_roll, "roll", 1400, 2700, { "left", "middle", "right" } },
+    { r_nick, "nick", 1400, 2700, { "up", "middle", "down" } },
+    { r_gier, "gier", 1400, 2700, { "left", "middle", "right" } },
+    { r_arm, "arm", 0, 2699, { "", "stop", "armed" } },
+    { r_mode, "mode", 1400, 2700, { "mode 1", "mode 2", "mode 3" } },
+    { r_beep, "beep", 0, 2699, { "", "off", "beep" } },
+    { r_prog, "prog", 1400, 2700, { "off", "prog", "write" } },
+    { r_var, "var", 1400, 2700, { "low", "middle", "high" } },
+    { r_aux1, "aux1", 1400, 2700, { "low", "middle", "high" } },
+    { r_aux2, "aux2", 1400, 2700, { "low", "middle", "high" } },
+    { r_aux3, "aux3", 1400, 2700, { "low", "middle", "high" } }
+};
+
+enum { rc_state_disabled = 3 }; // function without a channel
+
+constexpr bool rc_functions_in_order(unsigned i = 0)
+{
+    return i == rc_function_count || ( rc_functions[i].function == (int) i + 1 && rc_functions_in_order(i + 1) );
+}
+
+static_assert(sizeof(rc_functions) / sizeof(rc_functions[0]) == rc_function_count, "one row per rc function");
+static_assert(rc_functions_in_order(), "rc_functions follows rc_func");
+
+constexpr int rc_classify(const rc_function_desc &desc, int value)
+{
+    return value < desc.low ? 0 : value > desc.high ? 2 : 1;
+}
+
+double widget_value(QWidget *widget)
+{
+    if ( QDoubleSpinBox *box = qobject_cast<QDoubleSpinBox *>(widget) )
+    {
+        return box->value();
+    }
+    if ( QSpinBox *box = qobject_cast<QSpinBox *>(widget) )
+    {
+        return box->value();
+    }
+    if ( QComboBox *box = qobject_cast<QComboBox *>(widget) )
+    {
+        return box->currentIndex();
+    }
+    if ( QCheckBox *box = qobject_cast<QCheckBox *>(widget) )
+    {
+        return box->isChecked();
+    }
+    return 0;
+}
+
+void set_widget_value(QWidget *widget, double value)
+{
+    if ( QDoubleSpinBox *box = qobject_cast<QDoubleSpinBox *>(widget) )
+    {
+        box->setValue(value);
+    }
+    else if ( QSpinBox *box = qobject_cast<QSpinBox *>(widget) )
+    {
+        box->setValue(value);
+    }
+    else if ( QComboBox *box = qobject_cast<QComboBox *>(widget) )
+    {
+        box->setCurrentIndex(value);
+    }
+    else if ( QCheckBox *box = qobject_cast<QCheckBox *>(widget) )
+    {
+        box->setChecked(value != 0);
+    }
+}
 }
 
 MainWindow::MainWindow(QWidget *parent) :
@@ -59,20 +216,27 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
 
     //globally used objects
-    serial = new QSerialPort(this);
+    serial_thread = new QThread(this);
+    serial = new SerialWorker;
+    serial->moveToThread(serial_thread);
+    serial_thread->start();
+    port_watcher = new PortWatcher(this);
     config_scene = new QGraphicsScene(this);
-    channels_scene = new QGraphicsScene(this);
     text = new QGraphicsTextItem;
     timer = new QTimer(this);
     timer->start(100);
-    one_shot_timer = new QTimer(this);
-    one_shot_timer->setSingleShot(true);
+    frame_timer = new QTimer(this);
+    frame_timer->start(16);
     StatusLabel = new QLabel(this);
 
     // connect any slot which can't be connected by on_NAME_SIGNAL()
     connect(timer, SIGNAL(timeout()), this, SLOT(timer_elapsed()));
-    connect(one_shot_timer, SIGNAL(timeout()), this, SLOT(update_settings_read_delay()));
-    connect(serial, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(serialPortError(QSerialPort::SerialPortError)));
+    connect(frame_timer, SIGNAL(timeout()), this, SLOT(drain_serial_events()));
+    connect(serial_thread, SIGNAL(finished()), serial, SLOT(deleteLater()));
+    connect(serial, SIGNAL(port_error(int)), this, SLOT(serialPortError(int)));
+    connect(serial, SIGNAL(settings_received(QByteArray)), this, SLOT(settings_received(QByteArray)));
+    connect(serial, SIGNAL(state_changed(int)), this, SLOT(protocol_state_changed(int)));
+    connect(serial, SIGNAL(command_finished(int,bool,qint64)), this, SLOT(command_finished(int,bool,qint64)));
     connect( ui->fw_select_pushButton, SIGNAL( released() ), this, SLOT( browseFiles() ) );
     connect( ui->fw_save_select_pushButton, SIGNAL( released() ), this, SLOT( browse_saveFile() ) );
     connect( ui->flash_pushButton, SIGNAL( released() ), this, SLOT( dfuFlashBinary() ) );
@@ -80,7 +244,8 @@ MainWindow::MainWindow(QWidget *parent) :
     connect( ui->show_dfu_pushButton, SIGNAL( released() ), this, SLOT( dfuListDevices() ) );
     connect( &dfuUtilProcess, SIGNAL( readyReadStandardOutput() ), this, SLOT( dfuCommandStatus() ) );
     connect( &dfuUtilProcess, SIGNAL( finished( int, QProcess::ExitStatus ) ), this, SLOT( dfuCommandComplete( int ) ) );
-    connect( serial, SIGNAL(readyRead() ), this, SLOT(serialReadyRead() ) );
+    connect( &dfuListProcess, SIGNAL( finished( int, QProcess::ExitStatus ) ), this, SLOT( dfuListComplete() ) );
+    connect( &dfuListProcess, SIGNAL( errorOccurred( QProcess::ProcessError ) ), this, SLOT( dfuListError( QProcess::ProcessError ) ) );
     connect( ui->sensor_set_buttonGroup, SIGNAL(buttonClicked(int)), this, SLOT( set_sensor_orientation(int) ) );
     connect( ui->rot_dir_buttonGroup, SIGNAL(buttonClicked(int)), this, SLOT(set_rotational_direction(int) ) );
     connect( ui->rev_buttonGroup, SIGNAL(buttonClicked(int)), this, SLOT(set_rev(int) ) );
@@ -88,10 +253,71 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->live_check_buttonGroup, SIGNAL(buttonClicked(int)), this, SLOT( live_graph_enable(int) ) );
     connect( ui->save_settings_pushButton, SIGNAL( released() ), this, SLOT( save_settings() ) );
     connect( ui->restore_settings_pushButton, SIGNAL( released() ), this, SLOT( restore_settings() ) );
+    connect(serial, SIGNAL(replay_finished()), this, SLOT(replay_finished()));
+    connect(serial, SIGNAL(live_settings_acked(qint64)), this, SLOT(live_settings_acked(qint64)));
+    connect(port_watcher, SIGNAL(ports_changed()), this, SLOT(refreshSerialDevices()));
+
+    // session recording and replay
+    QMenu *session_menu = ui->menuBar->addMenu(tr("&Session"));
+    record_action = session_menu->addAction(tr("&Record..."));
+    record_action->setCheckable(true);
+    connect(record_action, SIGNAL(triggered(bool)), this, SLOT(record_session(bool)));
+    connect(session_menu->addAction(tr("Re&play...")), SIGNAL(triggered()), this, SLOT(replay_session()));
+
+    QMenu *speed_menu = session_menu->addMenu(tr("Replay &speed"));
+    const double replay_speeds[] = { 1, 4, 16, 0 }; // 0 = as fast as possible
+    replay_speed_group = new QActionGroup(this);
+    for ( unsigned i = 0; i < sizeof(replay_speeds) / sizeof(replay_speeds[0]); i++ )
+    {
+        QAction *action = speed_menu->addAction(replay_speeds[i] > 0 ? tr("%1x").arg(replay_speeds[i]) : tr("Max"));
+        action->setCheckable(true);
+        action->setChecked(i == 0);
+        action->setData(replay_speeds[i]);
+        replay_speed_group->addAction(action);
+    }
+
+    // several flight controllers at once
+    QMenu *devices_menu = ui->menuBar->addMenu(tr("&Devices"));
+    connect(devices_menu->addAction(tr("&Dashboard...")), SIGNAL(triggered()), this, SLOT(show_dashboard()));
+    connect(devices_menu->addAction(tr("&Batch flash firmware...")), SIGNAL(triggered()), this, SLOT(batch_flash()));
+    connect(devices_menu->addAction(tr("Image &store...")), SIGNAL(triggered()), this, SLOT(show_store()));
+
+    QMenu *settings_menu = ui->menuBar->addMenu(tr("Se&ttings"));
+    connect(settings_menu->addAction(tr("&Export as text...")), SIGNAL(triggered()), this, SLOT(export_settings_text()));
+    connect(settings_menu->addAction(tr("&Import text...")), SIGNAL(triggered()), this, SLOT(import_settings_text()));
+    dashboard = 0;
+
+    // a spin box drag produces a burst of edits, only the last one in 20 ms is sent
+    tuning = 0;
+    tuning_timer = new QTimer(this);
+    tuning_timer->setSingleShot(true);
+    tuning_timer->setInterval(20);
+    connect(tuning_timer, SIGNAL(timeout()), this, SLOT(stream_gains()));
+
+    // spectrum and step response of the gyro data, batches of samples go to their own thread
+    qRegisterMetaType<QVector<double> >("QVector<double>");
+    analysis_thread = new QThread(this);
+    analysis = new AnalysisWorker;
+    analysis->moveToThread(analysis_thread);
+    analysis_thread->start();
+    connect(analysis_thread, SIGNAL(finished()), analysis, SLOT(deleteLater()));
+    connect(analysis, SIGNAL(updated(int,QVector<double>,QVector<double>,QVector<double>,QVector<double>)),
+            this, SLOT(analysis_updated(int,QVector<double>,QVector<double>,QVector<double>,QVector<double>)));
+    analysis_timer = new QTimer(this);
+    analysis_timer->start(250);
+    connect(analysis_timer, SIGNAL(timeout()), this, SLOT(send_analysis_samples()));
 
     // Only use the included dfu-util
     binaryPath = QFileInfo( QCoreApplication::applicationFilePath() ).dir().absolutePath();
     dfuUtilProcess.setWorkingDirectory( binaryPath );
+    dfuListProcess.setWorkingDirectory( binaryPath );
+#ifdef WIN32
+    diff_flasher = new DiffFlasher( binaryPath + "/" + "dfu-util.exe", this );
+#else
+    diff_flasher = new DiffFlasher( binaryPath + "/" + "dfu-util", this );
+#endif
+    connect( diff_flasher, SIGNAL( output( QString ) ), this, SLOT( dfuDiffOutput( QString ) ) );
+    connect( diff_flasher, SIGNAL( finished( bool ) ), this, SLOT( dfuDiffComplete( bool ) ) );
 
     // Merge the output channels? //No just stdout
     //dfuUtilProcess.setProcessChannelMode( QProcess::MergedChannels );
@@ -148,9 +374,31 @@ MainWindow::MainWindow(QWidget *parent) :
     // make left and bottom axes transfer their ranges to right and top axes:
     connect(ui->qcustomplot_widget->xAxis, SIGNAL(rangeChanged(QCPRange)), ui->qcustomplot_widget->xAxis2, SLOT(setRange(QCPRange)));
     connect(ui->qcustomplot_widget->yAxis, SIGNAL(rangeChanged(QCPRange)), ui->qcustomplot_widget->yAxis2, SLOT(setRange(QCPRange)));
+    connect(ui->qcustomplot_widget->xAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(plot_range_changed(QCPRange)));
+
+    // wheel zooms the time axis into the history
+    ui->qcustomplot_widget->setInteractions(QCP::iRangeZoom);
+    ui->qcustomplot_widget->axisRect()->setRangeZoom(Qt::Horizontal);
 
+    // refresh scheduler, ticks at the frame rate cap and replots only if something changed
     plot_timer = new QTimer(this);
+    plot_timer->setTimerType(Qt::PreciseTimer);
     connect(plot_timer, SIGNAL(timeout()), this, SLOT(realtimeDataSlot()));
+    connect(ui->qcustomplot_widget, SIGNAL(beforeReplot()), this, SLOT(plot_before_replot()));
+    connect(ui->qcustomplot_widget, SIGNAL(afterReplot()), this, SLOT(plot_after_replot()));
+
+    // analysis graphs, gy colours
+    ui->analysis_plot->addGraph();
+    ui->analysis_plot->graph(0)->setPen(QPen(QColor(0, 0, 255)));
+    ui->analysis_plot->addGraph();
+    ui->analysis_plot->graph(1)->setPen(QPen(QColor(255, 0, 0)));
+    ui->analysis_plot->addGraph();
+    ui->analysis_plot->graph(2)->setPen(QPen(QColor(0, 255, 0)));
+    ui->analysis_plot->axisRect()->setupFullAxesBox();
+
+    // old firmware streams live lines without the sticks
+    ui->analysis_comboBox->setItemData(analysis_step, tr("Needs firmware with binary live frames, they carry the sticks"), Qt::ToolTipRole);
+    on_analysis_comboBox_currentIndexChanged(ui->analysis_comboBox->currentIndex());
 
     // set IDs
     ui->sensor_set_buttonGroup->setId(ui->sensor_rot_x_plus_pushButton, 101);
@@ -163,18 +411,7 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->rot_dir_buttonGroup->setId(ui->cw_radioButton, 201);
     ui->rot_dir_buttonGroup->setId(ui->ccw_radioButton, 202);
 
-    ui->rev_buttonGroup->setId(ui->rc_thrust_rev_checkBox, 301);
-    ui->rev_buttonGroup->setId(ui->rc_roll_rev_checkBox, 302);
-    ui->rev_buttonGroup->setId(ui->rc_nick_rev_checkBox, 303);
-    ui->rev_buttonGroup->setId(ui->rc_gier_rev_checkBox, 304);
-    ui->rev_buttonGroup->setId(ui->rc_arm_rev_checkBox, 305);
-    ui->rev_buttonGroup->setId(ui->rc_mode_rev_checkBox, 306);
-    ui->rev_buttonGroup->setId(ui->rc_beep_rev_checkBox, 307);
-    ui->rev_buttonGroup->setId(ui->rc_prog_rev_checkBox, 308);
-    ui->rev_buttonGroup->setId(ui->rc_var_rev_checkBox, 309);
-    ui->rev_buttonGroup->setId(ui->rc_aux1_rev_checkBox, 310);
-    ui->rev_buttonGroup->setId(ui->rc_aux2_rev_checkBox, 311);
-    ui->rev_buttonGroup->setId(ui->rc_aux3_rev_checkBox, 312);
+    setup_rc_functions();
 
     ui->motors_min_max_buttonGroup->setId(ui->motors_min_pushButton, 401);
     ui->motors_min_max_buttonGroup->setId(ui->motors_max_pushButton, 402);
@@ -195,35 +432,53 @@ MainWindow::MainWindow(QWidget *parent) :
     }
 
     // set some globally used variables
-    settings_to_be_read = false;
-    channels_to_be_read = false;
-    live_to_be_read = false;
-    settings_to_be_write = false;
-    settings_written = false;
-    settings_saved = false;
     serial_to_be_closed = false;
     switch_state = 42;
+    protocol_state = state_idle;
     found_our_port = false;
     pulled = false;
     motors_to_be_write = false;
-    motors_receipt = false;
-    ok_push = false;
-    bytes_written = 0;
-    delay200 = false;
-    motors_write_state_counter = 0;
-    push_pending = false;
 
     rotational_direction = CW;
     rc_channels << 0 << 0 << 0 << 0 << 0 << 0 << 0 << 0 << 0 << 0 << 0 << 0;
-    live_values << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0;
-    motor_data = "4000,4000,4000,4000";
+    plot_start_ns = monotonic_ns();
+    plot_window = 8;
+    for ( int i=0; i<9; i++ )
+    {
+        plot_range_stale[i] = false;
+    }
+    plot_dirty = false;
+    plot_replot_pending = false;
+    plot_updating = false;
+    plot_feed_ns = 0;
+    plot_frame_ms = 0;
+    plot_frames = 0;
+    plot_skipped = 0;
+    plot_idle = 0;
+    plot_frames_shown = 0;
+
+    // no point in refreshing faster than the display does
+    plot_fps = 60;
+    if ( QGuiApplication::primaryScreen() )
+    {
+        plot_fps = qBound(1, qRound(QGuiApplication::primaryScreen()->refreshRate()), 60);
+    }
+    ui->plot_fps_spinBox->setValue(plot_fps);
+    serial->set_motor_rate(ui->motor_rate_spinBox->value());
 
     // will be refreshed only if changed
     display_config_scene(CW);
+    refreshSerialDevices();
 }
 
 MainWindow::~MainWindow()
 {
+    serial->close();
+    serial_thread->quit();
+    serial_thread->wait();
+    analysis_thread->quit();
+    analysis_thread->wait();
+
     delete ui;
 }
 
@@ -237,78 +492,275 @@ void MainWindow::live_graph_enable(int id)
     {
        ui->qcustomplot_widget->graph(id - 501)->setVisible(false);
     }
+    plot_dirty = true;
 }
 
 void MainWindow::realtimeDataSlot()
 {
-    // reset of lastPointKey
-    // restart of QTime plot_time (see below) and QTimer plot_timer
-    // which drives this slot will be done in state_switcher function
+    // restart of plot_start_ns, the telemetry store and QTimer plot_timer
+    // which drives this slot will be done in state_switch function
 
-    //static QTime time(QTime::currentTime());
-    // calculate two new data points:
-    double key = plot_time.elapsed()/1000.0; // time elapsed since start, in seconds
+    if ( !plot_dirty )
+    {
+        plot_idle++;
+        return;
+    }
 
-    if ( key - lastPointKey > 0.005 ) // at most add point every 5 ms
+    if ( plot_replot_pending )
     {
-        // add data to lines:
+        // last frame not rendered yet, the changes go into the next one
+        plot_skipped++;
+        return;
+    }
 
-        for ( int i=0; i<9; i++ )
+    plot_frame_clock.start();
+
+    double key = (monotonic_ns() - plot_start_ns) / 1e9; // time elapsed since start, in seconds
+    int max_points = 2 * ui->qcustomplot_widget->axisRect()->width();
+
+    // feed only the visible window, decimated to about two points per pixel
+    for ( int i=0; i<9; i++ )
+    {
+        if ( ui->qcustomplot_widget->graph(i)->visible() )
         {
-           ui->qcustomplot_widget->graph(i)->addData(key, live_values.at(i) );
+            telemetry.window(i, key - plot_window, key, max_points, plot_points);
+            ui->qcustomplot_widget->graph(i)->data()->set(plot_points, true);
+
+            if ( plot_range_stale[i] )
+            {
+                // the min/max envelope of the store is exact, refill from it
+                plot_ranges[i].clear();
+                for ( int j=0; j<plot_points.size(); j++ )
+                {
+                    plot_ranges[i].add(plot_points[j].key, plot_points[j].value);
+                }
+                plot_range_stale[i] = false;
+            }
         }
+        plot_ranges[i].expire(key - plot_window);
+    }
+
+    // scale only by values from visible graphs
+    autoscale_y();
 
-        // scale only by values from visible graphs
-        ui->qcustomplot_widget->yAxis->rescale(true);
+    // make key axis range scroll with the data (at a constant range size of plot_window seconds)
+    plot_updating = true;
+    ui->qcustomplot_widget->xAxis->setRange(key, plot_window, Qt::AlignRight);
+    plot_updating = false;
+
+    // queued, so a burst of changes ends up in a single replot
+    plot_dirty = false;
+    plot_replot_pending = true;
+    plot_feed_ns = plot_frame_clock.nsecsElapsed();
+    ui->qcustomplot_widget->replot(QCustomPlot::rpQueuedReplot);
+}
 
-       // rescale value (vertical) axis to fit the current data:
-       // ui->qcustomplot_widget->graph(0)->rescaleValueAxis();
-       // ui->qcustomplot_widget->graph(1)->rescaleValueAxis();
-       // ui->qcustomplot_widget->graph(2)->rescaleValueAxis();
+void MainWindow::start_plot_refresh()
+{
+    plot_dirty = true;
+    plot_replot_pending = false;
+    plot_frames = 0;
+    plot_skipped = 0;
+    plot_idle = 0;
+    plot_frames_shown = 0;
+    plot_stats_clock.start();
+    plot_timer->start(1000 / plot_fps);
+}
 
-        lastPointKey = key;
+void MainWindow::on_plot_fps_spinBox_valueChanged(int value)
+{
+    plot_fps = value;
+    if ( plot_timer->isActive() )
+    {
+        plot_timer->start(1000 / plot_fps);
     }
+}
+
+void MainWindow::plot_before_replot()
+{
+    plot_frame_clock.start();
+}
 
-    // make key axis range scroll with the data (at a constant range size of 8 meaning seconds here)
-    ui->qcustomplot_widget->xAxis->setRange(key, 8, Qt::AlignRight);
-    ui->qcustomplot_widget->replot();
+void MainWindow::plot_after_replot()
+{
+    // replots triggered by QCustomPlot itself (zoom) have no feed time
+    plot_frame_ms = (plot_feed_ns + plot_frame_clock.nsecsElapsed()) / 1e6;
+    plot_feed_ns = 0;
+    plot_replot_pending = false;
+    plot_frames++;
 }
 
-void MainWindow::update_settings_read_delay()
+void MainWindow::display_plot_stats()
 {
-    // After "pull_settings" sent, the device stops sending live data
-    // within 20 ms then waits > 300 ms before sending the requested
-    // settings.
-    // We are reading data continously if available but append arrived
-    // data to the cleaned settings read buffer not before a time between
-    // 200 ms has elapsed.
-    // | | | |  1. send "pull_request"
-    // | | | |     20 ms max device side reaction
-    // | | | |----------------------------------------------------------
-    // | | |    2. device has stopped sending live date
-    // | | |    3. Our Reader swallows not settings data on wire
-    // | | |    4. After 100-200 ready to begin append to settings buffer
-    // | | |------------------------------------------------------------
-    // | |      5. After > 300 ms device senda settings data
-    // | ---------------------------------------------------------------
-    // |      6. Append to settings buffer begins immediately
-    // -----------------------------------------------------------------
+    qint64 elapsed = plot_stats_clock.elapsed();
+
+    if ( elapsed < 1000 )
+    {
+        return;
+    }
 
-    delay200 = true;
+    ui->plot_stats_label->setText(tr("%1 fps   frame %2 ms   skipped %3   idle %4")
+                                  .arg((plot_frames - plot_frames_shown) * 1000.0 / elapsed, 0, 'f', 1)
+                                  .arg(plot_frame_ms, 0, 'f', 2)
+                                  .arg(plot_skipped)
+                                  .arg(plot_idle));
+    plot_frames_shown = plot_frames;
+    plot_stats_clock.restart();
 }
 
-void MainWindow::timer_elapsed() // 100 ms period
+void MainWindow::display_rc_stats()
 {
-    qint64 res;
+    QString mode = protocol_state == state_channels_binary ? tr("stream") : tr("lines");
 
-    refreshSerialDevices();
-    display_channels_scene();
+    if ( rc_stats.stale(monotonic_ns()) )
+    {
+        ui->rc_stats_label->setText(tr("No rc frames"));
+        return;
+    }
+
+    // lines have no sequence numbers, drops only show in streaming mode
+    QString text = tr("rc %1: %2 frames/s   interval %3 ms   jitter %4 ms   max %5 ms   dropped %6")
+                   .arg(mode)
+                   .arg(rc_stats.rate(), 0, 'f', 1)
+                   .arg(rc_stats.interval_ms(), 0, 'f', 2)
+                   .arg(rc_stats.jitter_ms(), 0, 'f', 2)
+                   .arg(rc_stats.max_interval_ms(), 0, 'f', 1)
+                   .arg(protocol_state == state_channels_binary ? QString::number(rc_stats.dropped()) : tr("n/a"));
+
+    if ( rc_recorder.isRecording() )
+    {
+        text += tr("   recorded %1 frames in %2 s").arg(rc_recorder.frames()).arg(rc_recorder.duration_s(), 0, 'f', 0);
+    }
+    ui->rc_stats_label->setText(text);
+}
+
+void MainWindow::on_rc_record_pushButton_toggled(bool checked)
+{
+    if ( checked )
+    {
+        // a new recording of the receiver selected now
+        rc_recorder.start(ui->rx_select_comboBox->currentText());
+    }
+    else
+    {
+        rc_recorder.stop();
+    }
+}
+
+void MainWindow::on_rc_export_pushButton_clicked()
+{
+    QString filename;
+
+    if ( rc_recorder.frames() == 0 )
+    {
+        ui->statusBar->showMessage(tr("Record RC frames first"), 5000);
+        return;
+    }
+
+    filename = QFileDialog::getSaveFileName(this, tr("Export RC histograms"), "rc_histograms.json", tr("JSON ( *.json );;All Files ( * )"));
+    if ( filename.isEmpty() )
+    {
+        return;
+    }
+
+    if ( !rc_recorder.export_json(filename) )
+    {
+        ui->statusBar->showMessage(tr("'%1' cannot be written").arg(filename), 5000);
+    }
+}
+
+void MainWindow::autoscale_y()
+{
+    // grows at once when a value leaves the axis, but only shrinks when the
+    // values use less than half of it, so the axis doesn't follow every wiggle
+    QCPRange range = ui->qcustomplot_widget->yAxis->range();
+    double low = 0;
+    double high = 0;
+    double margin;
+    bool found = false;
+
+    for ( int i=0; i<9; i++ )
+    {
+        if ( !ui->qcustomplot_widget->graph(i)->visible() || plot_ranges[i].isEmpty() )
+        {
+            continue;
+        }
+
+        if ( !found || plot_ranges[i].min() < low )
+        {
+            low = plot_ranges[i].min();
+        }
+        if ( !found || plot_ranges[i].max() > high )
+        {
+            high = plot_ranges[i].max();
+        }
+        found = true;
+    }
+
+    if ( !found )
+    {
+        return;
+    }
+
+    margin = qMax(0.1 * (high - low), 1e-3);
+    if ( low < range.lower || high > range.upper || high - low < 0.5 * range.size() )
+    {
+        ui->qcustomplot_widget->yAxis->setRange(low - margin, high + margin);
+    }
+}
+
+void MainWindow::plot_range_changed(const QCPRange &range)
+{
+    // mouse wheel zooms the history, realtimeDataSlot() keeps the right edge at now
+    double window = qBound(0.5, range.size(), 24 * 3600.0);
+
+    if ( window > plot_window )
+    {
+        // older samples than the trackers hold come into view
+        for ( int i=0; i<9; i++ )
+        {
+            plot_range_stale[i] = true;
+        }
+    }
+    plot_window = window;
+    if ( !plot_updating )
+    {
+        plot_dirty = true;
+    }
+}
+
+void MainWindow::protocol_state_changed(int state)
+{
+    protocol_state = state;
+
+    if ( state == state_motors_binary )
+    {
+        ui->motor_stream_label->setText(tr("Binary motor stream"));
+    }
+    else if ( state == state_motors )
+    {
+        ui->motor_stream_label->setText(tr("Old firmware, records every 100 ms"));
+    }
+    else if ( state != state_motors_negotiate )
+    {
+        ui->motor_stream_label->clear();
+    }
+}
+
+void MainWindow::timer_elapsed() // 100 ms period
+{
+    if ( switch_state == Configuration )
+    {
+        display_rc_stats();
+    }
+    if ( switch_state == Live_plots && plot_timer->isActive() )
+    {
+        display_plot_stats();
+    }
 
     if ( serial_to_be_closed == true)
     {
         serial->close();
-        live_values.clear();
-        live_values << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0;
         plot_timer->stop();
         StatusLabel->setText("Not Connected");
         serial_to_be_closed = false;
@@ -317,41 +769,16 @@ void MainWindow::timer_elapsed() // 100 ms period
     {
         if (serial->isOpen())
         {
-            StatusLabel->setText("Connected");
+            StatusLabel->setText(serial->isReplaying() ? "Replaying" : "Connected");
             ui->connect_pushButton->setDisabled( true );
 
-            if ( settings_to_be_write == true)
+            if ( motors_to_be_write == true)
             {
-                if ( bytes_written < 1024 )
-                {
-                    res = serial->write( settings_data.constData() +  bytes_written, 1024 - bytes_written);
-                    if (res > -1)
-                    {
-                        bytes_written += res;
-                    }
-                    else
-                    {
-                        // need error handler
-                        settings_to_be_write = false;
-                        bytes_written = 0;
-                    }
-                }
-                else
-                {
-                    settings_to_be_write = false;
-                    bytes_written = 0;
-                    settings_written = true;
-                }
+                // old firmware takes a record once the previous one is acknowledged,
+                // a binary stream sends the latest values at the motor rate anyway
+                serial->set_motors(motor1_value, motor2_value, motor3_value, motor4_value);
             }
-            else if ( motors_to_be_write == true)
-            {
-                if ( motors_receipt == true )
-                {
-                    serial->write(motor_data.constData(), 20);
-                    motors_receipt = false;
-                }
-            }
-            else if (settings_to_be_read == false && push_pending == false)
+            else if ( protocol_state < state_pull_wait ) // no pull or push running
             {
                 ui->start_bootloader_pushButton->setDisabled( false );
                 ui->reboot_pushButton->setDisabled( false );
@@ -360,7 +787,7 @@ void MainWindow::timer_elapsed() // 100 ms period
                 //ui->motors_enable_checkBox->setDisabled( false );
                 ui->disconnect_pushButton->setDisabled( false );
 
-                if ( live_to_be_read == false )
+                if ( switch_state != Live_plots )
                 {
                     ui->default_settings_pushButton->setDisabled( false );
                     ui->pull_settings_pushButton->setDisabled( false );
@@ -370,7 +797,7 @@ void MainWindow::timer_elapsed() // 100 ms period
                         ui->push_settings_pushButton->setDisabled( false );
                         ui->save_settings_pushButton->setDisabled( false );
                     }
-                    if ( settings_saved )
+                    if ( !saved_settings.isEmpty() )
                     {
                         ui->restore_settings_pushButton->setDisabled( false );
                     }
@@ -404,22 +831,29 @@ void MainWindow::timer_elapsed() // 100 ms period
 
 void MainWindow::refreshSerialDevices()
 {
+    // called by the port watcher only when ports come or go
+    QString selected = ui->availports_comboBox->currentData().toString();
+    int index;
+
     ui->availports_comboBox->clear();
     found_our_port = false;
 
-    QList<QSerialPortInfo> ports = QSerialPortInfo::availablePorts();
-    foreach(const QSerialPortInfo &port, ports) {
-        QString name = port.portName();
-        int index = ui->availports_comboBox->count();
-        // put STMicroelectronics device first in list
-        if(port.manufacturer() == "STMicroelectronics" && port.productIdentifier() == 0x5740 ) {
-            name.insert(0, "");
-            index = 0;
+    // the watcher puts the STMicroelectronics device first in list
+    foreach(const QSerialPortInfo &port, port_watcher->ports()) {
+        if ( PortWatcher::is_flight_controller(port) ) {
             found_our_port = true;
         }
-        ui->availports_comboBox->insertItem(index, name, port.systemLocation());
+        ui->availports_comboBox->addItem(port.portName(), port.systemLocation());
+    }
+
+    foreach(const QString &forced_port, PortWatcher::forced_ports()) {
+        ui->availports_comboBox->insertItem(0, forced_port, forced_port);
+        found_our_port = true;
     }
-    ui->availports_comboBox->setCurrentIndex(0);
+
+    // keep the user's choice while that port is still there
+    index = ui->availports_comboBox->findData(selected);
+    ui->availports_comboBox->setCurrentIndex(index >= 0 ? index : 0);
 
     if ( found_our_port )
     {
@@ -439,33 +873,22 @@ void MainWindow::refreshSerialDevices()
 void MainWindow::state_switch(int state)
 {
 
-    live_values.clear();
-    live_values << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0;
-    serial->clear();
-
     switch (state)
     {
 
     case Firmware:
-        serial->write("fw_tab", 7);
-        channels_to_be_read = false;
         motors_to_be_write = false;
-        live_to_be_read = false;
         plot_timer->stop();
         break;
 
     case Configuration:
-        serial->write("config_tab", 11);
-        channels_to_be_read = true;
         motors_to_be_write = false;
-        live_to_be_read = false;
         plot_timer->stop();
+        rc_stats.clear();
+        rc_recorder.break_stream();
         break;
 
     case Motor_test:
-        serial->write("motors_tab", 11);
-        channels_to_be_read = false;
-        live_to_be_read = false;
         plot_timer->stop();
         if ( ui->motors_enable_checkBox->isChecked() )
         {
@@ -474,44 +897,45 @@ void MainWindow::state_switch(int state)
         break;
 
     case Flight_setup:
-        serial->write("flight_tab", 11);
-        channels_to_be_read = false;
         motors_to_be_write = false;
-        live_to_be_read = false;
         plot_timer->stop();
         break;
 
     case Live_plots:
-        serial->write("live_tab", 9);
-
         ui->pull_settings_pushButton->setDisabled( true );
         ui->default_settings_pushButton->setDisabled( true );
         ui->save_settings_pushButton->setDisabled( true );
         ui->restore_settings_pushButton->setDisabled( true );
         ui->push_settings_pushButton->setDisabled( true );
 
-        channels_to_be_read = false;
         motors_to_be_write = false;
-        live_to_be_read = true;
         for ( int i=0; i<9; i++ )
         {
             ui->qcustomplot_widget->graph(i)->data().data()->clear();
         }
-        lastPointKey = 0;
-        plot_timer->start(0);
-        plot_time.start();
+        telemetry.clear();
+        analysis_samples.clear();
+        QMetaObject::invokeMethod(analysis, "clear", Qt::QueuedConnection);
+        for ( int i=0; i<9; i++ )
+        {
+            plot_ranges[i].clear();
+            plot_range_stale[i] = false;
+        }
+        plot_start_ns = monotonic_ns();
+        start_plot_refresh();
         break;
 
     // not used jet
     case suspend:
-        serial->write("suspend", 8);
-        channels_to_be_read = false;
         motors_to_be_write = false;
-        live_to_be_read = false;
         plot_timer->stop();
         break;
     }
 
+    // the tab commands are numbered like the tabs,
+    // the worker tries binary live frames first and falls back to ASCII
+    serial->enqueue(state);
+
     switch_state = state;
 }
 
@@ -522,31 +946,14 @@ void MainWindow::on_connect_pushButton_clicked()
         return;
     }
 
-    serial->setPortName(ui->availports_comboBox->currentData().toString());
-
-    // for testing with socat as proxy
-    //QString qstr;
-    //qstr.append("/dev/ttyACM5");
-    //serial->setPortName(qstr);
-
-    // usage (as root):
-    // socat -x -v PTY,link=/dev/ttyACM5 /dev/ttyACM0,raw
-    // prepare in other terminal: chmod 666 /dev/ttyACM5
-    // and stty "1:0:18b2:0:3:1c:7f:15:4:5:1:0:11:13:1a:0:12:f:17:16:0:0:0:0:0:0:0:0:0:0:0:0:0:0:0:0" -F /dev/ttyACM5
-    // after connection traffic in both directions in hex will be shown in the terminal where socat have been started
+    // the traffic in both directions can be captured with Session > Record
+    // and played back without hardware with Session > Replay
 
-    serial->open(QIODevice::ReadWrite);
-
-    if(!serial->isOpen()) {
+    // port is opened and configured in the serial thread
+    if ( !serial->open(ui->availports_comboBox->currentData().toString()) ) {
         return;
     }
 
-    serial->setBaudRate(QSerialPort::Baud115200);
-    serial->setDataBits(QSerialPort::Data8);
-    serial->setParity(QSerialPort::NoParity);
-    serial->setStopBits(QSerialPort::OneStop);
-    serial->setFlowControl(QSerialPort::NoFlowControl);
-
     ui->motors_enable_checkBox->setDisabled( false );
 
     state_switch(ui->tab->currentIndex());
@@ -554,9 +961,6 @@ void MainWindow::on_connect_pushButton_clicked()
 
 void MainWindow::on_disconnect_pushButton_clicked()
 {
-    live_values.clear();
-    live_values << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0;
-
     plot_timer->stop();
     if (serial->isOpen()) {
 
@@ -572,7 +976,6 @@ void MainWindow::on_tab_currentChanged(int index)
 {
     if (serial->isOpen())
     {
-        serial->clear();
         state_switch(index);
     }
 }
@@ -580,7 +983,7 @@ void MainWindow::on_tab_currentChanged(int index)
 void MainWindow::set_rev(int index)
 {
     int status, i;
-    int func = index - 300;
+    int func = index - rc_rev_id;
 
     // find status of current clicked channel reverse checkbox
     status = ui->rev_buttonGroup->button(index)->isChecked();
@@ -596,86 +999,44 @@ void MainWindow::set_rev(int index)
         if ( rc_func[i].number ==  rc_func[func].number )
         {
              rc_func[i].rev = status;
-             ui->rev_buttonGroup->button(300 + i)->setChecked( status );
+             ui->rev_buttonGroup->button(rc_rev_id + i)->setChecked( status );
         }
     }
 }
 
-// in each of this functions assign the changed channel number value
-// to the corresponding position in the rc_func array
-// this sets also the reverse field in rc_func from rc_ch
-// then check or uncheck the corresponding reverse checkbox
-// memorized at the corresponding rc_ch position by the rev field
-void MainWindow::on_rc_thrust_spinBox_valueChanged(int value)
-{
-    rc_func[r_thrust] = rc_ch[value];
-    ui->rc_thrust_rev_checkBox->setChecked( rc_ch[value].rev );
-}
-
-void MainWindow::on_rc_roll_spinBox_valueChanged(int value)
-{
-    rc_func[r_roll] = rc_ch[value];
-    ui->rc_roll_rev_checkBox->setChecked( rc_ch[value].rev );
-}
-
-void MainWindow::on_rc_nick_spinBox_valueChanged(int value)
-{
-    rc_func[r_nick] = rc_ch[value];
-    ui->rc_nick_rev_checkBox->setChecked( rc_ch[value].rev );
-}
-
-void MainWindow::on_rc_gier_spinBox_valueChanged(int value)
+void MainWindow::setup_rc_functions()
 {
-    rc_func[r_gier] = rc_ch[value];
-    ui->rc_gier_rev_checkBox->setChecked( rc_ch[value].rev );
-}
-
-void MainWindow::on_rc_arm_spinBox_valueChanged(int value)
-{
-    rc_func[r_arm] = rc_ch[value];
-    ui->rc_arm_rev_checkBox->setChecked( rc_ch[value].rev );
-}
+    const rc_function_desc *desc;
+    QSpinBox *box;
+    unsigned i;
 
-void MainWindow::on_rc_mode_spinBox_valueChanged(int value)
-{
-    rc_func[r_mode] = rc_ch[value];
-    ui->rc_mode_rev_checkBox->setChecked( rc_ch[value].rev );
-}
+    for ( i = 0; i < rc_function_count; i++ )
+    {
+        desc = &rc_functions[i];
 
-void MainWindow::on_rc_beep_spinBox_valueChanged(int value)
-{
-    rc_func[r_beep] = rc_ch[value];
-     ui->rc_beep_rev_checkBox->setChecked( rc_ch[value].rev );
-}
+        box = findChild<QSpinBox *>(QString("rc_%1_spinBox").arg(desc->name));
+        box->setProperty("rc_function", desc->function);
+        connect(box, SIGNAL(valueChanged(int)), this, SLOT(rc_function_changed(int)));
 
-void MainWindow::on_rc_prog_spinBox_valueChanged(int value)
-{
-    rc_func[r_prog] = rc_ch[value];
-    ui->rc_prog_rev_checkBox->setChecked( rc_ch[value].rev );
-}
+        ui->rev_buttonGroup->setId(findChild<QAbstractButton *>(QString("rc_%1_rev_checkBox").arg(desc->name)),
+                                   rc_rev_id + desc->function);
 
-void MainWindow::on_rc_var_spinBox_valueChanged(int value)
-{
-    rc_func[r_var] = rc_ch[value];
-    ui->rc_var_rev_checkBox->setChecked( rc_ch[value].rev );
-}
+        rc_state_labels[desc->function] = findChild<QLabel *>(QString("rc_%1_label").arg(desc->name));
+        rc_states_shown[desc->function] = -1;
 
-void MainWindow::on_rc_aux1_spinBox_valueChanged(int value)
-{
-    rc_func[r_aux1] = rc_ch[value];
-    ui->rc_aux1_rev_checkBox->setChecked( rc_ch[value].rev );
+        rc_value_labels[i] = findChild<QLabel *>(QString("rc_ch_%1_label").arg(i + 1, 2, 10, QChar('0')));
+        rc_values_shown[i] = -1;
+    }
 }
 
-void MainWindow::on_rc_aux2_spinBox_valueChanged(int value)
+// assign the changed channel number to the spin box's position in rc_func,
+// this takes the reverse field from rc_ch too, the reverse checkbox follows
+void MainWindow::rc_function_changed(int value)
 {
-    rc_func[r_aux2] = rc_ch[value];
-    ui->rc_aux2_rev_checkBox->setChecked(  rc_ch[value].rev );
-}
+    int func = sender()->property("rc_function").toInt();
 
-void MainWindow::on_rc_aux3_spinBox_valueChanged(int value)
-{
-    rc_func[r_aux3] = rc_ch[value];
-    ui->rc_aux3_rev_checkBox->setChecked( rc_ch[value].rev );
+    rc_func[func] = rc_ch[value];
+    ui->rev_buttonGroup->button(rc_rev_id + func)->setChecked( rc_ch[value].rev );
 }
 
 void MainWindow::motors_set_master_slider(int id)
@@ -741,7 +1102,7 @@ void MainWindow::on_motors_enable_checkBox_clicked(bool checked)
         ui->disconnect_pushButton->setDisabled( true );
 
         motors_to_be_write = true;
-        motors_receipt = true;
+        serial->start_motors();
     }
 }
 
@@ -770,12 +1131,7 @@ void MainWindow::on_motor_value_master_verticalSlider_valueChanged(int value)
     ui->motor3_value_label->setText(motor3_data_string);
     ui->motor4_value_label->setText(motor4_data_string);
 
-    QString motor_data_string;
-
-    QTextStream(&motor_data_string) << motor1_value << "," <<  motor2_value <<  "," << motor3_value <<  "," << motor4_value;
-
-    motor_data.clear();
-    motor_data.append(motor_data_string.toLocal8Bit());
+    serial->set_motors(motor1_value, motor2_value, motor3_value, motor4_value);
 }
 
 void MainWindow::on_motor1_value_verticalSlider_valueChanged(int value)
@@ -785,11 +1141,7 @@ void MainWindow::on_motor1_value_verticalSlider_valueChanged(int value)
     QTextStream(&motor1_data_string) << motor1_value / 4;
     ui->motor1_value_label->setText(motor1_data_string);
 
-    QString motor_data_string;
-    QTextStream(&motor_data_string) << motor1_value << "," <<  motor2_value <<  "," << motor3_value <<  "," << motor4_value;
-
-    motor_data.clear();
-    motor_data.append(motor_data_string.toLocal8Bit());
+    serial->set_motors(motor1_value, motor2_value, motor3_value, motor4_value);
 }
 
 void MainWindow::on_motor2_value_verticalSlider_valueChanged(int value)
@@ -799,11 +1151,7 @@ void MainWindow::on_motor2_value_verticalSlider_valueChanged(int value)
     QTextStream(&motor2_data_string) << motor2_value / 4;
     ui->motor2_value_label->setText(motor2_data_string);
 
-    QString motor_data_string;
-    QTextStream(&motor_data_string) << motor1_value << "," <<  motor2_value <<  "," << motor3_value <<  "," << motor4_value;
-
-    motor_data.clear();
-    motor_data.append(motor_data_string.toLocal8Bit());
+    serial->set_motors(motor1_value, motor2_value, motor3_value, motor4_value);
 }
 
 void MainWindow::on_motor3_value_verticalSlider_valueChanged(int value)
@@ -813,11 +1161,7 @@ void MainWindow::on_motor3_value_verticalSlider_valueChanged(int value)
     QTextStream(&motor3_data_string) << motor3_value / 4;
     ui->motor3_value_label->setText(motor3_data_string);
 
-    QString motor_data_string;
-    QTextStream(&motor_data_string) << motor1_value << "," <<  motor2_value <<  "," << motor3_value <<  "," << motor4_value;
-
-    motor_data.clear();
-    motor_data.append(motor_data_string.toLocal8Bit());
+    serial->set_motors(motor1_value, motor2_value, motor3_value, motor4_value);
 }
 
 void MainWindow::on_motor4_value_verticalSlider_valueChanged(int value)
@@ -827,203 +1171,204 @@ void MainWindow::on_motor4_value_verticalSlider_valueChanged(int value)
     QTextStream(&motor4_data_string) << motor4_value / 4;
     ui->motor4_value_label->setText(motor4_data_string);
 
-    QString motor_data_string;
-    QTextStream(&motor_data_string) << motor1_value << "," <<  motor2_value <<  "," << motor3_value <<  "," << motor4_value;
+    serial->set_motors(motor1_value, motor2_value, motor3_value, motor4_value);
+}
 
-    motor_data.clear();
-    motor_data.append(motor_data_string.toLocal8Bit());
+void MainWindow::on_motor_rate_spinBox_valueChanged(int value)
+{
+    // a running stream switches after its next frame
+    serial->set_motor_rate(value);
 }
 
 void MainWindow::ui_to_settings_data()
 {
-    settings *ps;
+    const settings_field *fields = settings_current.fields;
+    char *block;
+    int direction;
+    unsigned b;
     int i,j;
 
-    ps = (settings*) settings_data.data();
-
-    ps->pidvars[RKp] = ui->roll_kp->value();
-    ps->pidvars[RKi] = ui->roll_ki->value();
-    ps->pidvars[RKd] = ui->roll_kd->value();
-
-    ps->pidvars[NKp] = ui->nick_kp->value();
-    ps->pidvars[NKi] = ui->nick_ki->value();
-    ps->pidvars[NKd] = ui->nick_kd->value();
-
-    ps->pidvars[GKp] = ui->gier_kp->value();
-    ps->pidvars[GKi] = ui->gier_ki->value();
-    ps->pidvars[GKd] = ui->gier_kd->value();
-
-    ps->l_pidvars[RKp] = ui->l_roll_kp->value();
-    ps->l_pidvars[RKi] = ui->l_roll_ki->value();
-    ps->l_pidvars[RKd] = ui->l_roll_kd->value();
-
-    ps->l_pidvars[NKp] = ui->l_nick_kp->value();
-    ps->l_pidvars[NKi] = ui->l_nick_ki->value();
-    ps->l_pidvars[NKd] = ui->l_nick_kd->value();
-
-    ps->l_pidvars[GKp] = ui->l_gier_kp->value();
-    ps->l_pidvars[GKi] = ui->l_gier_ki->value();
-    ps->l_pidvars[GKd] = ui->l_gier_kd->value();
-
-    ps->rate[roll] = ui->roll_rate->value();
-    ps->rate[nick] = ui->nick_rate->value();
-    ps->rate[gier] = ui->gier_rate->value();
-
-    ps->motor_1.tim_ch = ui->motor1_ch_spinBox->value();
-    ps->motor_2.tim_ch = ui->motor2_ch_spinBox->value();
-    ps->motor_3.tim_ch = ui->motor3_ch_spinBox->value();
-    ps->motor_4.tim_ch = ui->motor4_ch_spinBox->value();
+    if ( settings_data.size() < settings_block_size )
+    {
+        settings_data.append(QByteArray(settings_block_size - settings_data.size(), 0));
+    }
 
-    if (rotational_direction == CW)
+    // the block is edited in place, the fields not on the UI keep what was pulled
+    for ( b = 0; b < settings_binding_count; b++ )
     {
-        ps->motor_1.rotational_direction = CCW;
-        ps->motor_2.rotational_direction = CW;
-        ps->motor_3.rotational_direction = CW;
-        ps->motor_4.rotational_direction = CCW;
+        settings_set(settings_data.data(), settings_binding_field(b), settings_bindings[b].index,
+                     widget_value(findChild<QWidget *>(settings_bindings[b].widget)));
     }
-    else
+
+    block = settings_data.data();
+
+    // motors 2 and 3 turn in rotational_direction, 1 and 4 against it
+    direction = rotational_direction == CW ? CW : CCW;
+    for ( i = 0; i < 4; i++ )
     {
-        ps->motor_1.rotational_direction = CW;
-        ps->motor_2.rotational_direction = CCW;
-        ps->motor_3.rotational_direction = CCW;
-        ps->motor_4.rotational_direction = CW;
+        settings_set(block, fields[motor_direction_field], i, i == 1 || i == 2 ? direction : -direction);
     }
 
     for ( i = 0; i < 13; i++ )
     {
-        ps->rc_func[i] = rc_func[i];
-        ps->rc_ch[i] = rc_ch[i];
+        settings_set(block, fields[rc_func_number_field], i, rc_func[i].number);
+        settings_set(block, fields[rc_func_rev_field], i, rc_func[i].rev);
+        settings_set(block, fields[rc_ch_number_field], i, rc_ch[i].number);
+        settings_set(block, fields[rc_ch_rev_field], i, rc_ch[i].rev);
     }
 
     for(i=0; i<3; ++i)
         for(j=0; j<3; ++j)
         {
-            ps->sensor_orient[i][j] = sensor_orientation[i][j];
+            settings_set(block, fields[sensor_orient_field], i * 3 + j, sensor_orientation[i][j]);
         }
-
-    ps->aspect_ratio = ui->aspect_ratio_doubleSpinBox->value();
-
-    ps->receiver = ui->rx_select_comboBox->currentIndex();
-
-    ps->esc_mode = ui->esc_select_comboBox->currentIndex();
-
-    ps->low_voltage = ui->low_bat_volt_doubleSpinBox->value();
 }
 
 bool MainWindow::settings_data_to_ui()
 {
-    settings *ps;
+    const settings_field *fields = settings_current.fields;
+    const settings_layout *layout;
+    const char *block;
+    QByteArray migrated;
+    unsigned b;
     int i,j;
 
-    ps = (settings*) settings_data.data();
-
-    if ( ps->magic == 0xdb )
-    {
-
-        ui->roll_kp->setValue(ps->pidvars[RKp]);
-        ui->roll_ki->setValue(ps->pidvars[RKi]);
-        ui->roll_kd->setValue(ps->pidvars[RKd]);
-        ui->nick_kp->setValue(ps->pidvars[NKp]);
-        ui->nick_ki->setValue(ps->pidvars[NKi]);
-        ui->nick_kd->setValue(ps->pidvars[NKd]);
-        ui->gier_kp->setValue(ps->pidvars[GKp]);
-        ui->gier_ki->setValue(ps->pidvars[GKi]);
-        ui->gier_kd->setValue(ps->pidvars[GKd]);
-
-        ui->l_roll_kp->setValue(ps->l_pidvars[RKp]);
-        ui->l_roll_ki->setValue(ps->l_pidvars[RKi]);
-        ui->l_roll_kd->setValue(ps->l_pidvars[RKd]);
-        ui->l_nick_kp->setValue(ps->l_pidvars[NKp]);
-        ui->l_nick_ki->setValue(ps->l_pidvars[NKi]);
-        ui->l_nick_kd->setValue(ps->l_pidvars[NKd]);
-        ui->l_gier_kp->setValue(ps->l_pidvars[GKp]);
-        ui->l_gier_ki->setValue(ps->l_pidvars[GKi]);
-        ui->l_gier_kd->setValue(ps->l_pidvars[GKd]);
-
-        ui->roll_rate->setValue(ps->rate[roll]);
-        ui->nick_rate->setValue(ps->rate[nick]);
-        ui->gier_rate->setValue(ps->rate[gier]);
-
-        ui->motor1_ch_spinBox->setValue( ps->motor_1.tim_ch);
-        ui->motor2_ch_spinBox->setValue( ps->motor_2.tim_ch);
-        ui->motor3_ch_spinBox->setValue( ps->motor_3.tim_ch);
-        ui->motor4_ch_spinBox->setValue( ps->motor_4.tim_ch);
-
-        if (ps->motor_2.rotational_direction == CW)
-        {
-            ui->cw_radioButton->setChecked(true);
-            ui->ccw_radioButton->setChecked(false);
-        }
-        else
-        {
-            ui->ccw_radioButton->setChecked(true);
-            ui->cw_radioButton->setChecked(false);
-        }
-
-        ui->aspect_ratio_doubleSpinBox->setValue(ps->aspect_ratio);
+    layout = settings_find_layout(settings_data.constData(), settings_data.size());
+    if ( layout == 0 )
+    {
+        return false;
+    }
 
-        ui->rx_select_comboBox->setCurrentIndex(ps->receiver);
+    // blocks of older firmware are carried over field by field
+    if ( layout != &settings_current )
+    {
+        migrated = QByteArray(settings_block_size, 0);
+        settings_migrate(settings_data.constData(), *layout, migrated.data(), settings_current);
+        settings_data = migrated;
+    }
 
-        ui->esc_select_comboBox->setCurrentIndex(ps->esc_mode);
+    for ( b = 0; b < settings_binding_count; b++ )
+    {
+        set_widget_value(findChild<QWidget *>(settings_bindings[b].widget),
+                         settings_get(settings_data.constData(), settings_binding_field(b), settings_bindings[b].index));
+    }
 
-        for(i=0; i<3; ++i)
-            for(j=0; j<3; ++j)
-            {
-                sensor_orientation[i][j] = ps->sensor_orient[i][j];
-            }
+    block = settings_data.constData();
 
-        ui->rc_thrust_spinBox->setValue(ps->rc_func[r_thrust].number);
-        ui->rc_roll_spinBox->setValue(ps->rc_func[r_roll].number);
-        ui->rc_nick_spinBox->setValue(ps->rc_func[r_nick].number);
-        ui->rc_gier_spinBox->setValue(ps->rc_func[r_gier].number);
-        ui->rc_arm_spinBox->setValue(ps->rc_func[r_arm].number);
-        ui->rc_mode_spinBox->setValue(ps->rc_func[r_mode].number);
-        ui->rc_beep_spinBox->setValue(ps->rc_func[r_beep].number);
-        ui->rc_prog_spinBox->setValue(ps->rc_func[r_prog].number);
-        ui->rc_var_spinBox->setValue(ps->rc_func[r_var].number);
-        ui->rc_aux1_spinBox->setValue(ps->rc_func[r_aux1].number);
-        ui->rc_aux2_spinBox->setValue(ps->rc_func[r_aux2].number);
-        ui->rc_aux3_spinBox->setValue(ps->rc_func[r_aux3].number);
-
-        ui->rc_thrust_rev_checkBox->setChecked( ps->rc_func[r_thrust].rev );
-        ui->rc_roll_rev_checkBox->setChecked( ps->rc_func[r_roll].rev );
-        ui->rc_nick_rev_checkBox->setChecked( ps->rc_func[r_nick].rev );
-        ui->rc_gier_rev_checkBox->setChecked( ps->rc_func[r_gier].rev );
-        ui->rc_arm_rev_checkBox->setChecked( ps->rc_func[r_arm].rev );
-        ui->rc_mode_rev_checkBox->setChecked( ps->rc_func[r_mode].rev );
-        ui->rc_beep_rev_checkBox->setChecked( ps->rc_func[r_beep].rev );
-        ui->rc_prog_rev_checkBox->setChecked( ps->rc_func[r_prog].rev );
-        ui->rc_var_rev_checkBox->setChecked( ps->rc_func[r_var].rev );
-        ui->rc_aux1_rev_checkBox->setChecked( ps->rc_func[r_aux1].rev );
-        ui->rc_aux2_rev_checkBox->setChecked( ps->rc_func[r_aux2].rev );
-        ui->rc_aux3_rev_checkBox->setChecked( ps->rc_func[r_aux3].rev );
-
-        for ( i = 0; i < 13; i++ )
-        {
-            rc_func[i] = ps->rc_func[i];
-            rc_ch[i] = ps->rc_ch[i];
+    // the spin boxes copy from rc_ch until rc_func is taken over below
+    for ( i = 0; i < rc_function_count; i++ )
+    {
+        findChild<QSpinBox *>(QString("rc_%1_spinBox").arg(rc_functions[i].name))
+            ->setValue(settings_get(block, fields[rc_func_number_field], rc_functions[i].function));
+    }
+    for ( i = 0; i < rc_function_count; i++ )
+    {
+        ui->rev_buttonGroup->button(rc_rev_id + rc_functions[i].function)
+            ->setChecked(settings_get(block, fields[rc_func_rev_field], rc_functions[i].function) != 0);
+    }
+
+    rotational_direction = settings_get(block, fields[motor_direction_field], 1);
+
+    if (rotational_direction == CW)
+    {
+        ui->cw_radioButton->setChecked(true);
+        ui->ccw_radioButton->setChecked(false);
+    }
+    else
+    {
+        ui->ccw_radioButton->setChecked(true);
+        ui->cw_radioButton->setChecked(false);
+    }
+
+    for(i=0; i<3; ++i)
+        for(j=0; j<3; ++j)
+        {
+            sensor_orientation[i][j] = settings_get(block, fields[sensor_orient_field], i * 3 + j);
         }
 
-        ui->low_bat_volt_doubleSpinBox->setValue(ps->low_voltage);
+    for ( i = 0; i < 13; i++ )
+    {
+        rc_func[i].number = settings_get(block, fields[rc_func_number_field], i);
+        rc_func[i].rev = settings_get(block, fields[rc_func_rev_field], i);
+        rc_ch[i].number = settings_get(block, fields[rc_ch_number_field], i);
+        rc_ch[i].rev = settings_get(block, fields[rc_ch_rev_field], i);
+    }
+
+    display_config_scene(rotational_direction);
+
+    return true;
+}
+
+void MainWindow::export_settings_text()
+{
+    QString filename;
+    QFile file;
 
-        rotational_direction = ps->motor_2.rotational_direction;
+    if ( settings_data.size() < settings_block_size )
+    {
+        ui->statusBar->showMessage(tr("Pull or restore the settings first"), 5000);
+        return;
+    }
+
+    filename = QFileDialog::getSaveFileName(this, tr("Export settings"), "settings.txt", tr("Text ( *.txt );;All Files ( * )"));
+    if ( filename.isEmpty() )
+    {
+        return;
+    }
 
-        display_config_scene(rotational_direction);
+    ui_to_settings_data();
 
-        return true;
+    file.setFileName(filename);
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) )
+    {
+        ui->statusBar->showMessage(tr("'%1' cannot be written").arg(filename), 5000);
+        return;
     }
-    return false;
+    file.write(settings_to_text(settings_data.constData(), settings_current).c_str());
+}
+
+void MainWindow::import_settings_text()
+{
+    QString filename;
+    QFile file;
+    QByteArray block = settings_data;
+
+    filename = QFileDialog::getOpenFileName(this, tr("Import settings"), QString(), tr("Text ( *.txt );;All Files ( * )"));
+    if ( filename.isEmpty() )
+    {
+        return;
+    }
+
+    file.setFileName(filename);
+    if ( !file.open(QIODevice::ReadOnly | QIODevice::Text) )
+    {
+        ui->statusBar->showMessage(tr("'%1' cannot be read").arg(filename), 5000);
+        return;
+    }
+
+    // fields missing from the file keep their current value
+    if ( block.size() < settings_block_size )
+    {
+        block = QByteArray(settings_block_size, 0);
+    }
+    if ( !settings_from_text(block.data(), settings_current, file.readAll().toStdString()) )
+    {
+        ui->statusBar->showMessage(tr("'%1' is no settings export").arg(filename), 5000);
+        return;
+    }
+    block[0] = settings_current.magic;
+
+    settings_data = block;
+    settings_data_to_ui();
 }
 
 void MainWindow::on_pull_settings_pushButton_clicked()
 {
-    serial->clear();
     settings_data.clear();
-    serial->write("pull_settings", 14);
-
-    channels_to_be_read = false;
 
-    one_shot_timer->start(150);
+    // the worker skips stream leftovers until the settings magic byte arrives
+    serial->enqueue(cmd_pull_settings);
+    protocol_state = state_pull_wait;
 
     ui->pull_settings_pushButton->setDisabled( true );
     ui->push_settings_pushButton->setDisabled( true );
@@ -1032,8 +1377,6 @@ void MainWindow::on_pull_settings_pushButton_clicked()
     ui->restore_settings_pushButton->setDisabled( true );
     ui->reboot_pushButton->setDisabled( true );
     ui->disconnect_pushButton->setDisabled( true );
-
-    settings_to_be_read = true;
 }
 
 void MainWindow::on_push_settings_pushButton_clicked()
@@ -1046,88 +1389,56 @@ void MainWindow::on_push_settings_pushButton_clicked()
     ui->pull_settings_pushButton->setDisabled( true );
     ui->disconnect_pushButton->setDisabled( true );
 
-    serial->clear();
-    serial->write("push_settings", 14);
-
-    channels_to_be_read = false;
-
-    //state_switch(suspend);
-
     ui_to_settings_data();
 
-    push_pending = true;
-
+    // only the fields changed since the last pull or push go out,
+    // the worker falls back to the whole blob for old firmware
+    serial->enqueue(cmd_push_delta, settings_data.left(1024));
+    protocol_state = state_push_wait_ok;
 }
 
 void MainWindow::on_default_settings_pushButton_clicked()
 {
-    serial->write("load_defaults", 14);
+    serial->enqueue(cmd_load_defaults);
     pulled = false;
     ui->push_settings_pushButton->setDisabled( true );
 }
 
 void MainWindow::on_cal_acc_pushButton_clicked()
 {
-    serial->write("cal_acc", 8);
-    serial->flush();
-    QThread::msleep(50);
-    //MainWindow::msleep(50);
+    // queued, the next command waits until this one is on the wire
+    serial->enqueue(cmd_cal_acc);
 }
 
 void MainWindow::save_settings()
 {
-    QFile settings_file;
-    QString filename = "settings.bin";
-    settings_file.setFileName(filename);
+    ui_to_settings_data();
 
-    settings_saved = false;
+    // every snapshot is kept in the store, Devices > Image store exports one to a file
+    saved_settings = image_store.put(store_settings, settings_data.left(1024), ui->availports_comboBox->currentText(), tr("saved"));
 
-    if ( settings_file.open(QIODevice::WriteOnly) == true )
+    if ( !saved_settings.isEmpty() )
     {
-        ui_to_settings_data();
-
-        if ( settings_file.write(settings_data.data(), 1024) == 1024 )
-        {
-            settings_saved = true;
-            ui->restore_settings_pushButton->setText("Restore Settings");
-        }
-
-        settings_file.close();
+        ui->restore_settings_pushButton->setText("Restore Settings");
     }
     else
     {
-        ui->save_settings_pushButton->setText("failed open settings.bin");
+        ui->save_settings_pushButton->setText("failed Save Settings");
     }
 }
 
 void MainWindow::restore_settings()
 {
+    // empty if the snapshot went missing or is damaged
+    settings_data = image_store.get(saved_settings);
 
-    QFile settings_file;
-    QString filename = "settings.bin";
-    settings_file.setFileName(filename);
-
-    if ( settings_file.open(QIODevice::ReadOnly) )
+    if ( settings_data_to_ui() == true )
     {
-
-        settings_data.clear();
-
-        settings_data = settings_file.readAll();
-
-        if ( settings_data_to_ui() == true )
-        {
-            ui->restore_settings_pushButton->setText("Restore Settings");
-        }
-        else
-        {
-            ui->restore_settings_pushButton->setText("failed Settings invalid");
-        }
-
-        settings_file.close();
+        ui->restore_settings_pushButton->setText("Restore Settings");
     }
     else
     {
-        ui->restore_settings_pushButton->setText("failed open settings.bin");
+        ui->restore_settings_pushButton->setText("failed Settings invalid");
     }
 }
 
@@ -1138,11 +1449,8 @@ void MainWindow::on_reboot_pushButton_clicked()
         ui->motors_enable_checkBox->click();
     }
 
-    serial->write("reboot", 7);
-    live_to_be_read = 0;
+    serial->enqueue(cmd_reboot);
     plot_timer->stop();
-    live_values.clear();
-    live_values << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0 << 0.0;
     pulled = false;
 }
 
@@ -1154,7 +1462,7 @@ void MainWindow::on_start_bootloader_pushButton_clicked()
         ui->motors_enable_checkBox->click();
     }
     ui->connect_pushButton->setDisabled( true );
-    serial->write("bootloader", 11);
+    serial->enqueue(cmd_bootloader);
 }
 
 void MainWindow::set_rotational_direction(int id)
@@ -1247,206 +1555,151 @@ void MainWindow::set_sensor_orientation(int id)
     display_config_scene(rotational_direction);
 }
 
-void MainWindow::serialReadyRead()
+void MainWindow::settings_received(QByteArray data)
 {
-//    settings *ps;
-//    int i,j;
-    int i;
+    settings_data = data;
 
-    /*
-    // Alternative Version
-    // This slot is connected to QSerialPort::readyRead()
-    void QSerialPortClass::readyReadSlot()
+    if ( settings_data_to_ui() == true)
     {
-        while (!port.atEnd()) {
-            QByteArray data = port.read(100);
-            ....
-        }
-    }
-    */
+        pulled = true;
+        ui->pull_settings_pushButton->setText("Pull Settings");
 
-    if ( settings_to_be_read && delay200 )
+        // every pull is a snapshot, unchanged settings are not stored twice
+        image_store.put(store_settings, settings_data.left(1024), ui->availports_comboBox->currentText(), tr("pulled"));
+    }
+    else
     {
-        settings_data.append(serial->read(1024));
+        pulled = false;
+        ui->pull_settings_pushButton->setText("failed Pull Settings again!");
+    }
+}
 
-        if ( settings_data.size() >= 1024 )
+void MainWindow::command_finished(int command, bool ok, qint64 elapsed_us)
+{
+    switch ( command )
+    {
+    case cmd_pull_settings:
+        if ( !ok )
         {
-            //ps = (settings*) settings_data.data();
-
-            if ( settings_data_to_ui() == true)
-            {
-                delay200 = 0;
-                settings_to_be_read = false;
-
-                pulled = true;
-                ui->pull_settings_pushButton->setText("Pull Settings");
+            // device did not send the settings in time
+            pulled = false;
+            ui->pull_settings_pushButton->setText("failed Pull Settings again!");
+        }
+        break;
 
-                state_switch(switch_state);
-            }
-            else
-            {
-                delay200 = 0;
-                settings_to_be_read = false;
-                pulled = false;
-                ui->pull_settings_pushButton->setText("failed Pull Settings again!");
-            }
+    case cmd_push_settings:
+    case cmd_push_delta:
+        ui->push_settings_pushButton->setText( ok ? "Push Settings" : "failed Push Settings again!" );
+        if ( ok )
+        {
+            // from sending push_settings or push_delta until settings_rcvd or delta_rcvd
+            ui->statusBar->showMessage(tr("Settings pushed in %1 ms").arg(elapsed_us / 1000.0, 0, 'f', 1), 5000);
         }
+        break;
     }
-    else if (channels_to_be_read == 1)
+
+    // the device saves its settings to flash, a copy of the flash incl Settings is outdated
+    if ( command == cmd_push_settings || command == cmd_push_delta || command == cmd_load_defaults || command == cmd_cal_acc )
     {
-        QString rc_data_string = serial->readLine(61);
-        QStringList list = rc_data_string.trimmed().split(' ');
+        FlashPageCache::settings_written();
+    }
+}
+
+void MainWindow::drain_serial_events()
+{
+    // called once per frame, takes whatever the serial thread decoded meanwhile
+    serial_event event;
+    bool channels_changed = false;
+    double key;
+    int i;
 
-        if ( list.count() == 12 )
+    while ( serial->events()->pop(event) )
+    {
+        switch ( event.type )
         {
-            ui->rc_ch_01_label->setText(list.at(0));
-            ui->rc_ch_02_label->setText(list.at(1));
-            ui->rc_ch_03_label->setText(list.at(2));
-            ui->rc_ch_04_label->setText(list.at(3));
-            ui->rc_ch_05_label->setText(list.at(4));
-            ui->rc_ch_06_label->setText(list.at(5));
-            ui->rc_ch_07_label->setText(list.at(6));
-            ui->rc_ch_08_label->setText(list.at(7));
-            ui->rc_ch_09_label->setText(list.at(8));
-            ui->rc_ch_10_label->setText(list.at(9));
-            ui->rc_ch_11_label->setText(list.at(10));
-            ui->rc_ch_12_label->setText(list.at(11));
-
-            QListIterator<QString> iter(list);
-            for (i=0; i<12; i++)
+        case event_live:
+            if ( switch_state != Live_plots )
             {
-                rc_channels.replace(i, iter.next().toInt() );
+                break;
             }
 
-            QString labetext;
-
-            //labetext = rc_func[r_thrust].number == 0 ? "disabled" : rc_channels.at(0) < 2048 ? "low    " : "high   ";
-            labetext = rc_func[r_thrust].number == 0 ? "disabled" : rc_channels.at(0) < 1400 ? "low    " : rc_channels.at(0) > 2700 ? "high   " : "middle ";
-            ui->rc_thrust_label->setText(labetext);
-
-            //labetext = rc_func[r_roll].number == 0 ? "disabled" :  rc_channels.at(1) < 2048 ? "left   " : "right  ";
-            labetext = rc_func[r_roll].number == 0 ? "disabled" : rc_channels.at(1) < 1400 ? "left   " : rc_channels.at(1) > 2700 ? "right  " : "middle ";
-            ui->rc_roll_label->setText(labetext);
-
-            //labetext = rc_func[r_nick].number == 0 ? "disabled" : rc_channels.at(2) < 2048 ? "up     " : "down   ";
-            labetext = rc_func[r_nick].number == 0 ? "disabled" : rc_channels.at(2) < 1400 ? "up     " : rc_channels.at(2) > 2700 ? "down   " : "middle ";
-            ui->rc_nick_label->setText(labetext);
-
-            //labetext = rc_func[r_gier].number == 0 ? "disabled" : rc_channels.at(3) < 2048 ? "left   " : "right  ";
-            labetext = rc_func[r_gier].number == 0 ? "disabled" : rc_channels.at(3) < 1400 ? "left   " : rc_channels.at(3) > 2700 ? "right  " : "middle ";
-            ui->rc_gier_label->setText(labetext);
-
-            labetext = rc_func[r_arm].number == 0 ? "disabled" : rc_channels.at(4) < 2700 ? "stop   " : "armed  ";
-            ui->rc_arm_label->setText(labetext);
-
-            labetext = rc_func[r_mode].number == 0 ? "disabled" : rc_channels.at(5) < 1400 ? "mode 1 " : rc_channels.at(5) > 2700 ? "mode 3 " : "mode 2 ";
-            ui->rc_mode_label->setText(labetext);
-
-            labetext = rc_func[r_beep].number == 0 ? "disabled" : rc_channels.at(6) < 2700 ? "off    " : "beep   ";
-            ui->rc_beep_label->setText(labetext);
-
-            labetext = rc_func[r_prog].number == 0 ? "disabled" : rc_channels.at(7) < 1400 ? "off    " : rc_channels.at(7) > 2700 ? "write  " : "prog   ";
-            ui->rc_prog_label->setText(labetext);
-
-            //labetext = rc_func[r_var].number == 0 ? "disabled" : rc_channels.at(8) < 2048 ? "low    " : "high   ";
-            labetext = rc_func[r_var].number == 0 ? "disabled" : rc_channels.at(8) < 1400 ? "low    " : rc_channels.at(8) > 2700 ? "high   " : "middle ";
-            ui->rc_var_label->setText(labetext);
-
-            //labetext = rc_func[r_aux1].number == 0 ? "disabled" : rc_channels.at(9) < 2048 ? "low    " : "high   ";
-            labetext = rc_func[r_aux1].number == 0 ? "disabled" : rc_channels.at(9) < 1400 ? "low    " : rc_channels.at(9) > 2700 ? "high   " : "middle ";
-            ui->rc_aux1_label->setText(labetext);
-
-            //labetext = rc_func[r_aux2].number == 0 ? "disabled" : rc_channels.at(10) < 2048 ? "low    " : "high   ";
-            labetext = rc_func[r_aux2].number == 0 ? "disabled" : rc_channels.at(10) < 1400 ? "low    " : rc_channels.at(10) > 2700 ? "high   " : "middle ";
-            ui->rc_aux2_label->setText(labetext);
-
-            //labetext = rc_func[r_aux3].number == 0 ? "disabled" : rc_channels.at(11) < 2048 ? "low    " : "high   ";
-            labetext = rc_func[r_aux3].number == 0 ? "disabled" : rc_channels.at(11) < 1400 ? "low    " : rc_channels.at(11) > 2700 ? "high   " : "middle ";
-            ui->rc_aux3_label->setText(labetext);
-
-
-            if ( channels_to_be_read == 1 ) // stop ASAP
+            // every sample goes into the history, not just the latest per frame
+            key = (event.time_ns - plot_start_ns) / 1e9;
+            telemetry.append(key, event.values);
+            for (i=0; i<9; i++)
             {
-                serial->write("channels_receipt", 17);
+                plot_ranges[i].add(key, event.values[i]);
             }
-        }
-    }
-    else if (live_to_be_read == 1)
-    {
-        QString live_data_string = serial->readLine(100);
-        QStringList live_list = live_data_string.trimmed().split(' ');
 
-        if ( live_list.count() == 9 )
-        {
-            QListIterator<QString> iter(live_list);
-            for (i=0; i<9; i++)
+            // gy roll nick gier and the stick set points
+            analysis_samples.append(key);
+            for (i=0; i<3; i++)
             {
-                if ( i >= 6 )
-                {
-                    live_values.replace(i, iter.next().toDouble() * 180/M_PI );
-                }
-                else
-                {
-                    live_values.replace(i, iter.next().toDouble() );
-                }
+                analysis_samples.append(event.values[3 + i]);
             }
+            for (i=0; i<3; i++)
+            {
+                analysis_samples.append(stick_set_point(i, event.values[9 + i]));
+            }
+            plot_dirty = true;
+            break;
 
-            serial->write("live_receipt", 13);
-
-            //qDebug(live_data_string.toLatin1() );
-
-            //printf("%1.3f  %1.3f  %1.3f  %4.3f  %4.3f  %4.3f\n",
-            //live_values.at(0), live_values.at(1), live_values.at(2),
-            //live_values.at(3), live_values.at(4), live_values.at(5) );
+        case event_channels:
+            if ( switch_state != Configuration )
+            {
+                break;
+            }
 
+            for (i=0; i<12; i++)
+            {
+                rc_channels[i] = (int) event.values[i];
+            }
+            rc_stats.add(event.time_ns, event.seq);
+            rc_recorder.add(event.time_ns, event.seq, event.values);
+            channels_changed = true;
+            break;
         }
-        else
-        {
-            printf("%d\n",live_list.count() );
-        }
-
     }
-    else if (motors_to_be_write == 1)
-    {
-        // This also eats up spurious lines from channels_to_be_read state after such transition
-        // So it have to read up to the channels line length
-        QString receipt_string = serial->readLine(61).trimmed();
 
-        if (strcmp( receipt_string.toStdString().c_str(), (const char *) "motors_receipt") == 0 )
-        {
-            motors_receipt = 1;
-        }
-        else
-        {
-            //printf ("unrelated input: %s\n", motors_receipt_string.toStdString().c_str() );
-        }
+    // only the latest line of this frame is shown
+    if ( channels_changed )
+    {
+        display_rc_labels();
+        ui->rc_channels_graphicsView->set_values(rc_channels);
     }
-    else if (push_pending == true)
+}
+
+void MainWindow::display_rc_labels()
+{
+    const rc_function_desc *desc;
+    int i, state;
+
+    // a frame mostly moves one stick a little, only labels that change are set
+    for ( i = 0; i < rc_function_count; i++ )
     {
-        QString receipt_string = serial->readLine(61).trimmed();
-        if (strcmp( receipt_string.toStdString().c_str(), (const char *) "ok_push") == 0 )
+        if ( rc_channels.at(i) != rc_values_shown[i] )
         {
-            push_pending = false;
-            settings_to_be_write = 1;
+            rc_values_shown[i] = rc_channels.at(i);
+            rc_value_labels[i]->setText(QString::number(rc_values_shown[i]));
         }
     }
-    else if ( settings_written == true)
+
+    for ( i = 0; i < rc_function_count; i++ )
     {
-        QString receipt_string = serial->readLine(61).trimmed();
-        if (strcmp( receipt_string.toStdString().c_str(), (const char *) "settings_rcvd") == 0 )
+        desc = &rc_functions[i];
+
+        state = rc_func[desc->function].number == 0 ? rc_state_disabled : rc_classify(*desc, rc_channels.at(desc->function - 1));
+        if ( state == rc_states_shown[desc->function] )
         {
-            settings_written = false;
-            state_switch(switch_state);
+            continue;
         }
-    }
-    else
-    {
-        // printf ("swallow\n");
-        serial->readAll();
+
+        rc_states_shown[desc->function] = state;
+        rc_state_labels[desc->function]->setText(state == rc_state_disabled ? QString("disabled") : QString(desc->states[state]).leftJustified(7));
     }
 }
 
-void MainWindow::serialPortError(QSerialPort::SerialPortError error)
+void MainWindow::serialPortError(int error)
 {
     QString message;
     switch (error) {
@@ -1476,11 +1729,281 @@ void MainWindow::serialPortError(QSerialPort::SerialPortError error)
     {
         showStatusInfo(message);
 
-        // crash if closed in this slot
+        // closed by timer_elapsed(), not from within the error signal
         serial_to_be_closed = true;
     }
 }
 
+void MainWindow::record_session(bool checked)
+{
+    QString path;
+
+    if ( !checked )
+    {
+        serial->stop_recording();
+        ui->statusBar->showMessage(tr("Recording stopped"), 5000);
+        return;
+    }
+
+    // an existing session log is appended to
+    path = QFileDialog::getSaveFileName(
+                this,
+                tr("Record Session"),
+                QString(),
+                tr("Session Log ( *.c101log );;All Files ( * )"),
+                0,
+                QFileDialog::DontConfirmOverwrite
+                );
+
+    if ( path.isEmpty() )
+    {
+        record_action->setChecked(false);
+        return;
+    }
+
+    if ( !serial->start_recording(path) )
+    {
+        record_action->setChecked(false);
+        ui->statusBar->showMessage(tr("Can't record to %1").arg(path), 5000);
+    }
+}
+
+void MainWindow::replay_session()
+{
+    QString path;
+
+    if ( serial->isOpen() )
+    {
+        ui->statusBar->showMessage(tr("Disconnect before replaying a session"), 5000);
+        return;
+    }
+
+    path = QFileDialog::getOpenFileName(
+                this,
+                tr("Replay Session"),
+                QString(),
+                tr("Session Log ( *.c101log );;All Files ( * )")
+                );
+
+    if ( path.isEmpty() )
+    {
+        return;
+    }
+
+    if ( !serial->open_replay(path, replay_speed_group->checkedAction()->data().toDouble()) )
+    {
+        ui->statusBar->showMessage(tr("Can't replay %1").arg(path), 5000);
+        return;
+    }
+
+    state_switch(ui->tab->currentIndex());
+}
+
+void MainWindow::replay_finished()
+{
+    ui->statusBar->showMessage(tr("Replay finished"), 5000);
+}
+
+void MainWindow::show_dashboard()
+{
+    if ( dashboard == 0 )
+    {
+        dashboard = new DeviceDashboard(port_watcher, this);
+    }
+
+    // the settings edited here are the ones pushed to the selected devices
+    if ( pulled )
+    {
+        ui_to_settings_data();
+        dashboard->set_settings(settings_data.left(1024));
+    }
+
+    dashboard->show();
+    dashboard->raise();
+    dashboard->activateWindow();
+}
+
+void MainWindow::batch_flash()
+{
+    QFile flashFile( ui->fw_select_lineEdit->text() );
+
+    if ( !flashFile.exists() || flashFile.fileName() == QString() )
+    {
+        ui->tab->setCurrentWidget( ui->firmware );
+        ui->result_textEdit->appendPlainText( tr("Select the Firmware to flash to all DFU devices first...") );
+        return;
+    }
+
+#ifdef WIN32
+    QFile dfuUtil( binaryPath + "/" + "dfu-util.exe");
+#else
+    QFile dfuUtil( binaryPath + "/" + "dfu-util" );
+#endif
+
+    if ( !checkDFU( &dfuUtil ) || dfuUtilProcess.state() != QProcess::NotRunning || dfuListProcess.state() != QProcess::NotRunning ||
+         diff_flasher->isRunning() )
+    {
+        return;
+    }
+
+    BatchFlashDialog dialog( dfuUtil.fileName(), flashFile.fileName(), ui->restart_checkBox->isChecked(), this );
+    dialog.exec();
+
+    ui->result_textEdit->appendPlainText( dialog.report() );
+}
+
+void MainWindow::show_store()
+{
+    StoreDialog dialog( &image_store, this );
+
+    connect( &dialog, SIGNAL( flash( QString ) ), this, SLOT( flash_stored( QString ) ) );
+    connect( &dialog, SIGNAL( load_settings( QByteArray ) ), this, SLOT( load_stored_settings( QByteArray ) ) );
+    dialog.exec();
+}
+
+void MainWindow::flash_stored( QString path )
+{
+    ui->tab->setCurrentWidget( ui->firmware );
+    ui->fw_select_lineEdit->setText( path );
+    dfuFlashBinary();
+}
+
+void MainWindow::load_stored_settings( QByteArray data )
+{
+    settings_data = data;
+
+    if ( !settings_data_to_ui() )
+    {
+        ui->restore_settings_pushButton->setText("failed Settings invalid");
+    }
+}
+
+void MainWindow::on_tuning_pushButton_clicked()
+{
+    if ( tuning == 0 )
+    {
+        QList<QDoubleSpinBox *> gains;
+
+        gains << ui->roll_kp << ui->roll_ki << ui->roll_kd
+              << ui->nick_kp << ui->nick_ki << ui->nick_kd
+              << ui->gier_kp << ui->gier_ki << ui->gier_kd
+              << ui->l_roll_kp << ui->l_roll_ki << ui->l_roll_kd
+              << ui->l_nick_kp << ui->l_nick_ki << ui->l_nick_kd
+              << ui->l_gier_kp << ui->l_gier_ki << ui->l_gier_kd;
+
+        tuning = new TuningDialog(gains, this);
+        connect(tuning, SIGNAL(gains_changed()), tuning_timer, SLOT(start()));
+    }
+
+    tuning->set_status(pulled ? tr("Edits are applied while the plots run, Push Settings saves them")
+                              : tr("Pull the settings first"));
+    tuning->show();
+    tuning->raise();
+    tuning->activateWindow();
+}
+
+void MainWindow::stream_gains()
+{
+    if ( !pulled )
+    {
+        tuning->set_status(tr("Pull the settings first"));
+        return;
+    }
+
+    if ( switch_state != Live_plots || protocol_state != state_live_binary )
+    {
+        // ASCII live lines have no room for frames from the host
+        tuning->set_status(tr("Live tuning needs the Live Plots tab with binary frames"));
+        return;
+    }
+
+    ui_to_settings_data();
+    serial->stream_settings(settings_data.left(1024));
+}
+
+void MainWindow::live_settings_acked(qint64 elapsed_us)
+{
+    if ( tuning != 0 )
+    {
+        tuning->set_status(tr("Applied in %1 ms").arg(elapsed_us / 1000.0, 0, 'f', 1));
+    }
+}
+
+double MainWindow::stick_set_point(int axis, double stick) const
+{
+    const int funcs[3] = { r_roll, r_nick, r_gier };
+    const QDoubleSpinBox *rates[3] = { ui->roll_rate, ui->nick_rate, ui->gier_rate };
+
+    // the device sends the sticks by function, already mapped and reversed
+    if ( rc_func[funcs[axis]].number == 0 )
+    {
+        return 0;
+    }
+
+    // rc values are centred on 2048, full stick is the configured rate in
+    // deg/s and the gyro is plotted in rad/s
+    return (stick - 2048) / 2048.0 * rates[axis]->value() * M_PI / 180;
+}
+
+void MainWindow::send_analysis_samples()
+{
+    if ( analysis_samples.isEmpty() )
+    {
+        return;
+    }
+
+    QMetaObject::invokeMethod(analysis, "add_samples", Qt::QueuedConnection, Q_ARG(QVector<double>, analysis_samples));
+    analysis_samples.clear();
+}
+
+void MainWindow::analysis_updated(int mode, QVector<double> x, QVector<double> roll, QVector<double> nick, QVector<double> gier)
+{
+    // a result of the mode before a switch may still be queued
+    if ( mode != ui->analysis_comboBox->currentIndex() )
+    {
+        return;
+    }
+
+    ui->analysis_plot->graph(0)->setData(x, roll, true);
+    ui->analysis_plot->graph(1)->setData(x, nick, true);
+    ui->analysis_plot->graph(2)->setData(x, gier, true);
+
+    if ( mode == analysis_step && x.isEmpty() )
+    {
+        ui->analysis_label->setText(tr("Waiting for stick moves"));
+    }
+    else
+    {
+        ui->analysis_label->setText(mode == analysis_psd ? tr("Gyro PSD\nroll nick gier") : tr("Rate step\nroll nick gier"));
+    }
+
+    ui->analysis_plot->xAxis->rescale();
+    if ( mode == analysis_psd )
+    {
+        ui->analysis_plot->yAxis->rescale();
+    }
+    ui->analysis_plot->replot(QCustomPlot::rpQueuedReplot);
+}
+
+void MainWindow::on_analysis_comboBox_currentIndexChanged(int index)
+{
+    ui->analysis_plot->xAxis->setLabel(index == analysis_psd ? tr("Hz") : tr("ms"));
+    ui->analysis_plot->yAxis->setLabel(index == analysis_psd ? tr("dB") : tr("response"));
+    if ( index == analysis_step )
+    {
+        // 1 is the set point, a good tune settles there
+        ui->analysis_plot->yAxis->setRange(0, 1.5);
+    }
+    for ( int i = 0; i < 3; i++ )
+    {
+        ui->analysis_plot->graph(i)->data()->clear();
+    }
+    ui->analysis_label->clear();
+    ui->analysis_plot->replot(QCustomPlot::rpQueuedReplot);
+
+    QMetaObject::invokeMethod(analysis, "set_mode", Qt::QueuedConnection, Q_ARG(int, index));
+}
+
 void MainWindow::showStatusInfo(QString info)
 {
     StatusLabel->setText(info);
@@ -1554,6 +2077,11 @@ void MainWindow::dfuSaveBinary()
         saveFile.remove();
     }
 
+    dfu_serial.clear();
+    dfu_image = saveFile.fileName();
+    dfu_image_flashed = false;
+    dfu_incl_settings = ui->incl_settings_checkBox->isChecked();
+
     // Run dfu-util command
     if (ui->restart_checkBox->isChecked())
     {
@@ -1578,7 +2106,9 @@ void MainWindow::dfuSaveBinary()
         }
     }
 
-    dfuUtilProcess.start( dfuCmd );
+    // the device serial first, dfuListComplete() runs the command
+    dfu_command = dfuCmd;
+    dfuListProcess.start( dfuUtil.fileName(), QStringList() << "-l" );
 
     // Disable the flash button while command is running
     ui->flash_pushButton->setDisabled( true );
@@ -1623,7 +2153,21 @@ void MainWindow::dfuFlashBinary()
         return;
     }
 
-    // Run dfu-util command
+    // Only the sectors that differ from the device
+    if ( ui->diff_flash_checkBox->isChecked() )
+    {
+        ui->flash_pushButton->setDisabled( true );
+        ui->fw_save_pushButton->setDisabled( true );
+        ui->show_dfu_pushButton->setDisabled( true );
+        diff_flasher->start( flashFile.fileName(), ui->restart_checkBox->isChecked() );
+        return;
+    }
+
+    // remember what ends up on the device for the next diff flash
+    dfu_serial.clear();
+    dfu_image = flashFile.fileName();
+    dfu_image_flashed = true;
+
     if (ui->restart_checkBox->isChecked())
     {
         dfuCmd = QString("%1 -s %2 -D %3").arg( dfuUtil.fileName(), "0x08004000:leave", flashFile.fileName() );
@@ -1633,7 +2177,9 @@ void MainWindow::dfuFlashBinary()
         dfuCmd = QString("%1 -s %2 -D %3").arg( dfuUtil.fileName(), "0x08004000", flashFile.fileName() );
     }
 
-    dfuUtilProcess.start( dfuCmd );
+    // the device serial first, dfuListComplete() runs the command
+    dfu_command = dfuCmd;
+    dfuListProcess.start( dfuUtil.fileName(), QStringList() << "-l" );
 
     // Disable the flash button while command is running
     ui->flash_pushButton->setDisabled( true );
@@ -1723,43 +2269,79 @@ void MainWindow::dfuCommandStatus()
     ui->result_textEdit->verticalScrollBar()->setValue( ui->result_textEdit->verticalScrollBar()->maximum() );
 }
 
+void MainWindow::dfuListComplete()
+{
+    // the serial keys the flash cache and the store, unknown with several devices
+    dfu_serial = DiffFlasher::single_serial( dfuListProcess.readAllStandardOutput() );
+    dfuUtilProcess.start( dfu_command );
+}
+
+void MainWindow::dfuListError( QProcess::ProcessError error )
+{
+    // no finished() then, the command reports the failure itself
+    if ( error == QProcess::FailedToStart )
+    {
+        dfuListComplete();
+    }
+}
+
 void MainWindow::dfuCommandComplete( int exitCode )
 {
     // Re-enable button after command completes
     ui->flash_pushButton->setDisabled( false );
     ui->show_dfu_pushButton->setDisabled( false );
 
+    // the flashed or saved image is what the device holds now
+    if ( !dfu_image.isEmpty() )
+    {
+        QFile image( dfu_image );
+        QByteArray data;
+
+        if ( exitCode == 0 && image.open( QIODevice::ReadOnly ) )
+        {
+            data = image.readAll();
+
+            if ( dfu_image_flashed )
+            {
+                image_store.put_file( store_firmware, dfu_image, dfu_serial, QFileInfo( dfu_image ).fileName() );
+                FlashPageCache::store( dfu_serial, FlashPageCache::hash( data, true ) );
+            }
+            else
+            {
+                // always read from the device, the store only keeps one copy of it
+                image_store.put( store_firmware, data, dfu_serial, dfu_incl_settings ? tr("saved incl Settings") : tr("saved") );
+                FlashPageCache::store( dfu_serial, FlashPageCache::hash( data, false ) );
+            }
+        }
+        else if ( dfu_image_flashed )
+        {
+            FlashPageCache::forget( dfu_serial );
+        }
+        dfu_serial.clear();
+        dfu_image.clear();
+    }
+
     // Append return code ?
     // no don't bother the user
     //QString output = tr("Return Code: %1").arg( exitCode );
     //ui->result_textEdit->appendPlainText( output );
 }
 
-void MainWindow::display_channels_scene()
+void MainWindow::dfuDiffOutput( QString text )
 {
-    int i;
-    int ch;
-
-    channels_scene->clear();
-
-    ui->rc_channels_graphicsView->setScene(channels_scene);
-    QPen outlinePen(Qt::black);
-    outlinePen.setWidth(1);
-    QBrush grayBrush(Qt::gray);
-
-    line = channels_scene->addLine( 10, 0, 10, 329, outlinePen);
-    line = channels_scene->addLine( 215, 0, 215, 329, outlinePen);
-    line = channels_scene->addLine( 419, 0, 419, 329, outlinePen);
-
-    line = channels_scene->addLine( 150, 0, 150, 329, outlinePen);
-    line = channels_scene->addLine( 280, 0, 280, 329, outlinePen);
+    ui->result_textEdit->appendPlainText( text );
+    ui->result_textEdit->verticalScrollBar()->setValue( ui->result_textEdit->verticalScrollBar()->maximum() );
+}
 
-    ch = 0;
-    for (i=0; i<320; i+=29)
+void MainWindow::dfuDiffComplete( bool ok )
+{
+    if ( ok )
     {
-        rectangle = channels_scene->addRect( 10, i, rc_channels.at(ch) / 10, 10, outlinePen, grayBrush );
-        ch++;
+        image_store.put_file( store_firmware, ui->fw_select_lineEdit->text(), diff_flasher->device(),
+                              QFileInfo( ui->fw_select_lineEdit->text() ).fileName() );
     }
+
+    dfuCommandComplete( ok ? 0 : 1 );
 }
 
 // Helper for display_config_scene
@@ -5,6 +5,7 @@
 #include <QtSerialPort/QtSerialPort>
 #include <QLabel>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QThread>
 #include <QFileDialog>
 #include <QScrollBar>
@@ -16,72 +17,22 @@
 #include <QButtonGroup>
 #include <QtCharts>
 
-typedef struct
-{
-    int8_t  rotational_direction;
-    uint8_t tim_ch;
-} motor;
+#include "serialworker.h"
+#include "telemetrystore.h"
+#include "slidingrange.h"
+#include "rclinkstats.h"
+#include "rcrecorder.h"
+#include "settings.h"
+#include "portwatcher.h"
+#include "devicedashboard.h"
+#include "batchflashdialog.h"
+#include "flashdiff.h"
+#include "imagestore.h"
+#include "storedialog.h"
+#include "tuningdialog.h"
+#include "analysisworker.h"
 
-typedef struct
-{
-    uint8_t number;
-    uint8_t rev;
-} rc_channel;
-
-typedef int8_t matrix[3][3];
-
-typedef struct {
-    uint8_t magic;
-    uint8_t pad1[7];    // 1 + 7 = 8
-    float pidvars[9];
-    uint8_t pad2[4];	// 9 * 4 + 4 = 40
-    float l_pidvars[9];
-    uint8_t pad3[4];    // 9 * 4 + 4 = 40
-    float rate[3];      // 3 * 4 + 4 = 16
-    uint8_t pad4[4];
-    motor motor_1;
-    motor motor_2;
-    motor motor_3;
-    motor motor_4;      // 4 * 2 = 8
-    matrix sensor_orient;
-    uint8_t pad5[7];    // 3 * 3 + 7 = 16
-    float aspect_ratio;
-    uint8_t pad6[4];    // 4 + 4 = 8
-    rc_channel rc_func[13];
-    uint8_t pad7[6];    // 2 * 13 + 6 = 32
-    rc_channel rc_ch[13];
-    int8_t pad8[6];     // 2 * 13 + 6 = 32
-    uint8_t receiver;
-    int8_t pad9[7];     // 1 + 7 = 8
-    float low_voltage;
-    int8_t pad10[4];    // 4 + 4 = 8
-    int32_t acc_offset[3];
-    int8_t pad11[4];    // 3 * 4 + 4 = 16
-    uint8_t esc_mode;
-    int8_t pad12[7];    // 1 + 7 = 8
-
-} settings;
-
-enum { RKp, RKi, RKd, NKp, NKi, NKd, GKp, GKi, GKd }; // pidvars index
-enum { th, ro, ni, gi }; // motor index
-enum { roll, nick, gier }; // rate axis index
-enum { SBUS, SRXL };
 enum { cw_radioButton = 201, ccw_radioButton = 202};
-enum { CW = 1, CCW = -1 };
-enum { STD, ONES }; // ESC type index
-enum { r_thrust = 1,
-       r_roll = 2,
-       r_nick = 3,
-       r_gier = 4,
-       r_arm = 5,
-       r_mode = 6,
-       r_beep = 7,
-       r_prog = 8,
-       r_var = 9,
-       r_aux1 = 10,
-       r_aux2 = 11,
-       r_aux3 = 12
-     };
 
 enum { // for sensor orientation rotation
     sensor_rot_x_plus_pushButton = 101,
@@ -92,20 +43,9 @@ enum { // for sensor orientation rotation
     sensor_rot_z_minus_pushButton = 106
 };
 
-enum {
-    thrust_rev = 301,
-    roll_rev = 302,
-    nick_rev = 303,
-    gier_rev = 304,
-    arm_rev = 305,
-    mode_rev = 306,
-    beep_rev = 307,
-    prog_rev = 308,
-    var_rev = 309,
-    aux1_rev = 310,
-    aux2_rev = 311,
-    aux3_rev = 312
-};
+enum { rc_function_count = r_aux3 }; // r_thrust .. r_aux3
+
+enum { rc_rev_id = 300 }; // rev_buttonGroup id of rc function f is rc_rev_id + f
 
 enum { Firmware, Configuration, Motor_test, Flight_setup, Live_plots, suspend };
 
@@ -143,18 +83,7 @@ private slots:
     void on_push_settings_pushButton_clicked();
     void on_default_settings_pushButton_clicked();
     void on_cal_acc_pushButton_clicked();
-    void on_rc_thrust_spinBox_valueChanged(int value);
-    void on_rc_roll_spinBox_valueChanged(int value);
-    void on_rc_nick_spinBox_valueChanged(int value);
-    void on_rc_gier_spinBox_valueChanged(int value);
-    void on_rc_arm_spinBox_valueChanged(int value);
-    void on_rc_mode_spinBox_valueChanged(int value);
-    void on_rc_beep_spinBox_valueChanged(int value);
-    void on_rc_prog_spinBox_valueChanged(int value);
-    void on_rc_var_spinBox_valueChanged(int value);
-    void on_rc_aux1_spinBox_valueChanged(int value);
-    void on_rc_aux2_spinBox_valueChanged(int value);
-    void on_rc_aux3_spinBox_valueChanged(int value);
+    void rc_function_changed(int value);
     void on_motors_enable_checkBox_clicked(bool checked);
     void on_motor_value_master_verticalSlider_valueChanged(int value);
     void on_motor1_value_verticalSlider_valueChanged(int value);
@@ -166,7 +95,8 @@ private slots:
     void on_tab_currentChanged(int index);
     void on_reboot_pushButton_clicked();
     void timer_elapsed();
-    void serialPortError(QSerialPort::SerialPortError error);
+    void refreshSerialDevices();
+    void serialPortError(int error);
     void browseFiles();
     void browse_saveFile();
     void save_settings();
@@ -175,19 +105,56 @@ private slots:
     void dfuSaveBinary();
     void dfuListDevices();
     void dfuCommandStatus();
+    void dfuListComplete();
+    void dfuListError( QProcess::ProcessError error );
     void dfuCommandComplete( int exitCode );
-    void serialReadyRead();
+    void dfuDiffOutput( QString text );
+    void dfuDiffComplete( bool ok );
+    void settings_received(QByteArray data);
+    void drain_serial_events();
     void set_sensor_orientation(int id);
     void set_rotational_direction(int id);
     void realtimeDataSlot();
-    void update_settings_read_delay();
+    void protocol_state_changed(int state);
+    void command_finished(int command, bool ok, qint64 elapsed_us);
     void live_graph_enable(int);
+    void plot_range_changed(const QCPRange &range);
+    void record_session(bool checked);
+    void replay_session();
+    void replay_finished();
+    void show_dashboard();
+    void batch_flash();
+    void show_store();
+    void flash_stored( QString path );
+    void load_stored_settings( QByteArray data );
+    void export_settings_text();
+    void import_settings_text();
+    void on_tuning_pushButton_clicked();
+    void stream_gains();
+    void live_settings_acked(qint64 elapsed_us);
+    void plot_before_replot();
+    void plot_after_replot();
+    void on_plot_fps_spinBox_valueChanged(int value);
+    void on_motor_rate_spinBox_valueChanged(int value);
+    void send_analysis_samples();
+    void analysis_updated(int mode, QVector<double> x, QVector<double> roll, QVector<double> nick, QVector<double> gier);
+    void on_analysis_comboBox_currentIndexChanged(int index);
+    void on_rc_record_pushButton_toggled(bool checked);
+    void on_rc_export_pushButton_clicked();
 
 private:
     Ui::MainWindow *ui;
-    QSerialPort *serial;
+    SerialWorker *serial;
+    QThread *serial_thread;
+    PortWatcher *port_watcher;
+    DeviceDashboard *dashboard;
+    TuningDialog *tuning;
+    QTimer *tuning_timer;   // debounces gain edits
+    AnalysisWorker *analysis;
+    QThread *analysis_thread;
+    QTimer *analysis_timer;
+    QVector<double> analysis_samples;   // not handed to the analysis yet, analysis_stride per sample
     QGraphicsScene *config_scene;
-    QGraphicsScene *channels_scene;
     QGraphicsScene *plot_scene;
     QGraphicsRectItem *rectangle;
     QGraphicsEllipseItem *ellipse;
@@ -195,48 +162,75 @@ private:
     QGraphicsLineItem *line;
     QGraphicsPolygonItem *arrow;
     QTimer *timer;
+    QTimer *frame_timer;
     QTimer *plot_timer;
-    QTimer *one_shot_timer;
     QLabel *StatusLabel;
+    QAction *record_action;
+    QActionGroup *replay_speed_group;
     QProcess dfuUtilProcess;
+    QProcess dfuListProcess;    // dfu-util -l ahead of a flash or save, for the device serial
+    QString dfu_command;        // the flash or save, started once the list is in
     QString binaryPath;
+    DiffFlasher *diff_flasher;
+    QString dfu_serial;         // device of the running flash or save
+    QString dfu_image;
+    bool dfu_image_flashed;     // dfu_image written to, not read from the device
+    bool dfu_incl_settings;     // a save of the whole flash, firmware and settings
+    ImageStore image_store;
     QByteArray settings_data;
-    QTime plot_time;
-    QByteArray motor_data;
-    QList<double> live_values;
+    qint64 plot_start_ns;
+    double plot_window;     // visible seconds
+    TelemetryStore telemetry;
+    QVector<QCPGraphData> plot_points;
+    SlidingRange plot_ranges[9];    // min/max of the visible window per graph
+    bool plot_range_stale[9];       // window grew past the tracked samples
+    int plot_fps;                   // refresh cap
+    bool plot_dirty;                // new samples or view change since the last replot
+    bool plot_replot_pending;       // queued replot not rendered yet
+    bool plot_updating;             // our own axis changes, not a view change
+    QElapsedTimer plot_frame_clock;
+    QElapsedTimer plot_stats_clock;
+    qint64 plot_feed_ns;            // time spent feeding the graphs this frame
+    double plot_frame_ms;           // feed plus render time of the last frame
+    unsigned plot_frames;           // rendered
+    unsigned plot_skipped;          // ticks with changes while the last replot was still queued
+    unsigned plot_idle;             // ticks without changes
+    unsigned plot_frames_shown;     // plot_frames at the last stats update
     QList<int> rc_channels;
+    QLabel *rc_value_labels[rc_function_count];
+    QLabel *rc_state_labels[rc_function_count + 1];  // by rc function like rc_func
+    int rc_values_shown[rc_function_count];         // on the labels, -1 before the first frame
+    int rc_states_shown[rc_function_count + 1];
+    RcLinkStats rc_stats;
+    RcRecorder rc_recorder;
 
     //static void msleep(unsigned long msecs){QThread::msleep(msecs);}
 
-    void refreshSerialDevices();
     void showStatusInfo(QString info);
     void display_config_scene(int rotation);
-    void display_channels_scene();
     void displayVector(int direction);
     void state_switch(int state);
+    void setup_rc_functions();
+    void display_rc_labels();
+    void display_plot_stats();
+    void display_rc_stats();
+    void autoscale_y();
+    void start_plot_refresh();
+    double stick_set_point(int axis, double stick) const;
 
     void ui_to_settings_data();
     bool settings_data_to_ui();
 
     int switch_state;
+    int protocol_state;
 
     bool checkDFU( QFile *dfuUtil );
     bool serial_to_be_closed;
-    bool settings_to_be_read;
-    bool channels_to_be_read;
-    bool push_pending;
-    bool live_to_be_read;
-    bool settings_to_be_write;
-    bool settings_written;
-    bool settings_saved;
+    QString saved_settings;     // store hash of the snapshot Restore Settings loads
     bool found_our_port;
     bool pulled;
-    bool delay200;
     bool motors_to_be_write;
-    bool motors_receipt;
-    bool ok_push;
 
-    qint64 bytes_written;
     motor motor_1;
     motor motor_2;
     motor motor_3;
@@ -248,8 +242,6 @@ private:
     uint16_t motor2_value = 4000;
     uint16_t motor3_value = 4000;
     uint16_t motor4_value = 4000;
-    int motors_write_state_counter;
-    double lastPointKey = 0;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,168 @@
+#include "portwatcher.h"
+
+#include <QSet>
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// udev needs a moment after the kernel event until the device node
+// and its properties are there
+const int settle_ms = 300;
+const int poll_ms = 1000;
+
+bool port_less(const QSerialPortInfo &a, const QSerialPortInfo &b)
+{
+    bool a_ours = PortWatcher::is_flight_controller(a);
+    bool b_ours = PortWatcher::is_flight_controller(b);
+
+    if ( a_ours != b_ours )
+    {
+        return a_ours;
+    }
+
+    return a.systemLocation() < b.systemLocation();
+}
+
+QSet<QString> locations(const QList<QSerialPortInfo> &ports)
+{
+    QSet<QString> set;
+
+    foreach ( const QSerialPortInfo &port, ports )
+    {
+        set.insert(port.systemLocation());
+    }
+
+    return set;
+}
+
+}
+
+PortWatcher::PortWatcher(QObject *parent) :
+    QObject(parent),
+    notifier(0),
+    uevent_fd(-1)
+{
+    scan_timer = new QTimer(this);
+    connect(scan_timer, SIGNAL(timeout()), this, SLOT(rescan()));
+
+    if ( open_uevent_socket() )
+    {
+        scan_timer->setSingleShot(true);
+        scan_timer->setInterval(settle_ms);
+    }
+    else
+    {
+        scan_timer->start(poll_ms);
+    }
+
+    rescan();
+}
+
+PortWatcher::~PortWatcher()
+{
+#ifdef Q_OS_LINUX
+    if ( uevent_fd >= 0 )
+    {
+        ::close(uevent_fd);
+    }
+#endif
+}
+
+bool PortWatcher::is_flight_controller(const QSerialPortInfo &port)
+{
+    return port.manufacturer() == "STMicroelectronics" && port.productIdentifier() == 0x5740;
+}
+
+QStringList PortWatcher::forced_ports()
+{
+    return QString(qgetenv("CONFIGURATOR101_PORT")).split(',', QString::SkipEmptyParts);
+}
+
+bool PortWatcher::open_uevent_socket()
+{
+#ifdef Q_OS_LINUX
+    struct sockaddr_nl address;
+
+    uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if ( uevent_fd < 0 )
+    {
+        return false;
+    }
+
+    // group 1 are the kernel events, readable without privileges
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1;
+
+    if ( bind(uevent_fd, (struct sockaddr *) &address, sizeof(address)) < 0 )
+    {
+        ::close(uevent_fd);
+        uevent_fd = -1;
+        return false;
+    }
+
+    notifier = new QSocketNotifier(uevent_fd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(uevent_ready()));
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PortWatcher::uevent_ready()
+{
+#ifdef Q_OS_LINUX
+    char buffer[4096];
+    ssize_t length;
+    ssize_t i;
+
+    // "ACTION@DEVPATH" followed by NUL separated KEY=VALUE pairs
+    while ( (length = recv(uevent_fd, buffer, sizeof(buffer) - 1, 0)) > 0 )
+    {
+        buffer[length] = 0;
+
+        for ( i = 0; i < length; i += strlen(buffer + i) + 1 )
+        {
+            if ( strcmp(buffer + i, "SUBSYSTEM=tty") == 0 )
+            {
+                // restarted by every event, so a burst ends in one rescan
+                scan_timer->start();
+                break;
+            }
+        }
+    }
+#endif
+}
+
+void PortWatcher::rescan()
+{
+    QList<QSerialPortInfo> ports = QSerialPortInfo::availablePorts();
+    QSet<QString> old_locations = locations(port_list);
+    QSet<QString> new_locations = locations(ports);
+
+    if ( old_locations == new_locations )
+    {
+        return;
+    }
+
+    std::sort(ports.begin(), ports.end(), port_less);
+    port_list = ports;
+
+    foreach ( const QString &location, old_locations - new_locations )
+    {
+        emit port_removed(location);
+    }
+    foreach ( const QString &location, new_locations - old_locations )
+    {
+        emit port_added(location);
+    }
+    emit ports_changed();
+}
@@ -0,0 +1,53 @@
+#ifndef PORTWATCHER_H
+#define PORTWATCHER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QtSerialPort/QSerialPortInfo>
+
+// Keeps the list of serial ports up to date without enumerating them all the time.
+//
+// On Linux the kernel hotplug events (netlink uevents) of the tty subsystem
+// trigger a rescan once the burst of events has settled. Elsewhere, or if
+// the socket can't be opened, the ports are polled once a second. Either way
+// the new list is diffed against the cached one and signals are only emitted
+// on a change. The flight controller is listed first.
+class PortWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PortWatcher(QObject *parent = 0);
+    ~PortWatcher();
+
+    const QList<QSerialPortInfo> &ports() const { return port_list; }
+
+    static bool is_flight_controller(const QSerialPortInfo &port);
+
+    // pseudo terminals like the ones of simulator/ aren't enumerated,
+    // they can be given comma separated in CONFIGURATOR101_PORT
+    static QStringList forced_ports();
+
+public slots:
+    void rescan();
+
+signals:
+    void port_added(QString location);
+    void port_removed(QString location);
+    void ports_changed();
+
+private slots:
+    void uevent_ready();
+
+private:
+    bool open_uevent_socket();
+
+    QList<QSerialPortInfo> port_list;
+    QTimer *scan_timer;         // settle delay after uevents, or the poll period
+    QSocketNotifier *notifier;
+    int uevent_fd;
+};
+
+#endif // PORTWATCHER_H
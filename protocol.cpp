@@ -0,0 +1,321 @@
+#include "protocol.h"
+
+#include <string.h>
+#include <charconv>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PROTOCOL_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+inline bool is_delimiter(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline int lowest_bit(unsigned bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+// bit i set if text[i] is a delimiter, for the 16 bytes at text
+// (or the count < 16 left at the end of the line)
+unsigned delimiter_mask(const char *text, int count)
+{
+    unsigned mask = 0;
+    int i;
+
+#ifdef PROTOCOL_SSE2
+    if ( count >= 16 )
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) text);
+        __m128i d = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        return _mm_movemask_epi8(d);
+    }
+#endif
+
+    for ( i = 0; i < count && i < 16; i++ )
+    {
+        mask |= (unsigned) is_delimiter(text[i]) << i;
+    }
+
+    return mask;
+}
+
+bool parse_number(const char *first, const char *last, double *value)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    std::from_chars_result result = std::from_chars(first, last, *value);
+
+    return result.ec == std::errc() && result.ptr == last;
+#else
+    // no floating point from_chars in this library, the firmware only prints
+    // [-]digits[.digits], which is exact enough this way (strtod is locale dependent)
+    const char *p = first;
+    double number = 0;
+    double scale = 1;
+    bool negative = false;
+    bool digits = false;
+
+    if ( p < last && (*p == '-' || *p == '+') )
+    {
+        negative = *p++ == '-';
+    }
+    for ( ; p < last && *p >= '0' && *p <= '9'; p++ )
+    {
+        number = number * 10 + (*p - '0');
+        digits = true;
+    }
+    if ( p < last && *p == '.' )
+    {
+        for ( p++; p < last && *p >= '0' && *p <= '9'; p++ )
+        {
+            number = number * 10 + (*p - '0');
+            scale *= 10;
+            digits = true;
+        }
+    }
+
+    *value = negative ? -number / scale : number / scale;
+    return digits && p == last;
+#endif
+}
+
+}
+
+uint16_t crc16_ccitt(const uint8_t *data, int length, uint16_t crc)
+{
+    int i;
+
+    while ( length-- > 0 )
+    {
+        crc ^= (uint16_t) (*data++) << 8;
+        for ( i = 0; i < 8; i++ )
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+int frame_encode(uint8_t type, const void *payload, int length, uint8_t *out)
+{
+    uint16_t crc;
+
+    out[0] = frame_sync1;
+    out[1] = frame_sync2;
+    out[2] = type;
+    out[3] = length;
+    memcpy(out + frame_header_size, payload, length);
+
+    crc = crc16_ccitt(out + 2, length + 2);
+    out[frame_header_size + length] = crc & 0xff;
+    out[frame_header_size + length + 1] = crc >> 8;
+
+    return frame_header_size + length + frame_crc_size;
+}
+
+int delta_encode(const uint8_t *from, const uint8_t *to, int size, uint8_t *out, int out_size)
+{
+    enum { max_ranges = 16 };
+    // equal bytes up to one frame overhead apart are cheaper sent along
+    const int gap = delta_header_size + frame_header_size + frame_crc_size;
+    const int max_data = sizeof(((delta_frame *) 0)->data);
+    int starts[max_ranges];
+    int lengths[max_ranges];
+    int count = 0;
+    int used = 0;
+    int i = 0;
+    int j, end;
+    delta_frame frame;
+
+    while ( i < size )
+    {
+        if ( from[i] == to[i] )
+        {
+            i++;
+            continue;
+        }
+
+        if ( count == max_ranges )
+        {
+            return -1;
+        }
+
+        end = i + 1;
+        for ( j = end; j < size && j - end < gap && j - i < max_data; j++ )
+        {
+            if ( from[j] != to[j] )
+            {
+                end = j + 1;
+            }
+        }
+
+        starts[count] = i;
+        lengths[count] = end - i;
+        count++;
+        i = end;
+    }
+
+    for ( i = 0; i < count; i++ )
+    {
+        if ( used + frame_header_size + delta_header_size + lengths[i] + frame_crc_size > out_size )
+        {
+            return -1;
+        }
+
+        frame.offset = starts[i];
+        frame.length = lengths[i];
+        frame.last = i == count - 1;
+        memcpy(frame.data, to + starts[i], lengths[i]);
+        used += frame_encode(frame_settings_delta, &frame, delta_header_size + lengths[i], out + used);
+    }
+
+    return used;
+}
+
+FrameDecoder::FrameDecoder()
+{
+    reset();
+}
+
+void FrameDecoder::reset()
+{
+    head = 0;
+    tail = 0;
+    crc_errors = 0;
+}
+
+void FrameDecoder::compact()
+{
+    // move the unparsed rest to the start so the next read has room
+    if ( head > 0 )
+    {
+        memmove(buffer, buffer + head, tail - head);
+        tail -= head;
+        head = 0;
+    }
+}
+
+int FrameDecoder::next_frame(const uint8_t **payload, int *length)
+{
+    int size;
+    uint16_t crc;
+
+    for (;;)
+    {
+        // hunt for sync
+        while ( tail - head >= 2 && ( buffer[head] != frame_sync1 || buffer[head + 1] != frame_sync2 ) )
+        {
+            head++;
+        }
+
+        if ( tail - head < frame_header_size )
+        {
+            break;
+        }
+
+        if ( buffer[head + 3] > frame_max_payload )
+        {
+            // can't be a header, resync behind this sync byte
+            head++;
+            continue;
+        }
+
+        size = frame_header_size + buffer[head + 3] + frame_crc_size;
+        if ( tail - head < size )
+        {
+            break;
+        }
+
+        crc = buffer[head + size - 2] | buffer[head + size - 1] << 8;
+        if ( crc16_ccitt(buffer + head + 2, size - 4) != crc )
+        {
+            crc_errors++;
+            head++;
+            continue;
+        }
+
+        *payload = buffer + head + frame_header_size;
+        *length = buffer[head + 3];
+        head += size;
+        return buffer[head - size + 2];
+    }
+
+    compact();
+
+    // a full buffer without a frame is garbage
+    if ( free_space() == 0 )
+    {
+        head = tail = 0;
+    }
+
+    return 0;
+}
+
+int parse_numbers(const char *line, int length, double *values, int max_values)
+{
+    int count = 0;
+    int start = -1;     // of the field being scanned, -1 between fields
+    int base, position;
+    unsigned delimiters, edges, previous = 1;
+
+    // 16 bytes at a time, only the edges between fields and delimiters are visited
+    for ( base = 0; base < length; base += 16 )
+    {
+        delimiters = delimiter_mask(line + base, length - base);
+        if ( length - base < 16 )
+        {
+            // past the end counts as delimiter
+            delimiters |= ~0u << (length - base);
+        }
+        delimiters &= 0xffff;
+
+        edges = (delimiters ^ ((delimiters << 1) | previous)) & 0xffff;
+        previous = delimiters >> 15;
+
+        while ( edges != 0 )
+        {
+            position = base + lowest_bit(edges);
+            edges &= edges - 1;
+
+            if ( start < 0 )
+            {
+                start = position;
+                continue;
+            }
+
+            if ( count == max_values || !parse_number(line + start, line + position, &values[count]) )
+            {
+                return -1;
+            }
+            count++;
+            start = -1;
+        }
+    }
+
+    if ( start >= 0 )
+    {
+        // the line ends with a field at a 16 byte boundary
+        if ( count == max_values || !parse_number(line + start, line + length, &values[count]) )
+        {
+            return -1;
+        }
+        count++;
+    }
+
+    return count;
+}
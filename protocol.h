@@ -0,0 +1,131 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+// Binary frames as sent by the firmware in binary mode
+//
+// | 0xa5 | 0x5a | type | length | payload (length bytes) | crc lo | crc hi |
+//
+// All multi byte values are little endian as stored by the STM32.
+// The crc is CRC-16/CCITT-FALSE over type, length and payload.
+
+enum { frame_sync1 = 0xa5, frame_sync2 = 0x5a };
+enum { frame_header_size = 4, frame_crc_size = 2, frame_max_payload = 64 };
+
+enum { // frame types
+    frame_live = 0x01,
+    frame_settings_delta = 0x02,    // host to device, after push_delta or while live
+    frame_delta_ack = 0x03,         // device to host, live settings delta applied
+    frame_rc = 0x04,                // device to host, rc channels after rc_bin_tab
+    frame_rc_subscribe = 0x05,      // host to device, rc stream rate after rc_bin_tab
+    frame_motor = 0x06,             // host to device, motor command after motors_bin_tab
+    frame_motor_ack = 0x07          // device to host, motors_bin_tab accepted
+};
+
+typedef struct
+{
+    float acc[3];
+    float gyro[3];
+    float angle[3];     // rad
+    uint16_t sticks[3]; // roll nick gier as in rc_frame, mapped and reversed
+    uint16_t reserved;
+} live_frame;           // 9 * 4 + 4 * 2 = 44
+
+// Changed bytes of the settings block. push_delta is followed by one frame
+// per changed range, the device applies them and answers delta_rcvd after
+// the frame marked last.
+typedef struct
+{
+    uint16_t offset;    // into the settings block
+    uint8_t length;
+    uint8_t last;
+    uint8_t data[frame_max_payload - 4];
+} delta_frame;          // 4 + length are sent
+
+enum { delta_header_size = 4 };
+
+// While binary live frames stream, delta frames may also be sent without
+// push_delta. The device applies them to the running settings right away,
+// without saving them, and acks each one in the live stream.
+typedef struct
+{
+    uint16_t offset;
+    uint8_t length;
+    uint8_t reserved;
+} delta_ack;
+
+// rc_bin_tab is followed by a subscribe frame, from then on the device
+// streams rc frames at that rate without waiting for receipts. A gap in
+// seq means frames were dropped on the way.
+typedef struct
+{
+    uint16_t rate_hz;
+    uint16_t reserved;
+} rc_subscribe;
+
+typedef struct
+{
+    uint32_t seq;
+    uint16_t channels[12];
+} rc_frame;             // 4 + 12 * 2 = 28
+
+// motors_bin_tab is answered with one motor_ack frame, from then on the
+// host streams motor frames at its own rate and the device applies each
+// one as it comes in, without a receipt. A gap in seq means frames were
+// lost on the way.
+typedef struct
+{
+    uint16_t max_rate_hz;   // highest motor frame rate the device takes
+    uint16_t reserved;
+} motor_ack;
+
+typedef struct
+{
+    uint32_t seq;
+    uint16_t value[4];  // motor 1 to 4, 4000 stop .. 8000 full
+} motor_frame;          // 4 + 4 * 2 = 12
+
+uint16_t crc16_ccitt(const uint8_t *data, int length, uint16_t crc = 0xffff);
+
+// Builds a complete frame into out, returns its size
+// out must hold frame_header_size + length + frame_crc_size bytes
+int frame_encode(uint8_t type, const void *payload, int length, uint8_t *out);
+
+// Delta frames turning from into to, returns their size, 0 if the blocks
+// are equal or -1 if they don't fit into out (a full push is cheaper then)
+int delta_encode(const uint8_t *from, const uint8_t *to, int size, uint8_t *out, int out_size);
+
+// Whitespace separated numbers of an ASCII live or rc line, as sent before
+// binary mode. Returns the number of fields stored into values or -1 if a
+// field isn't a number or there are more than max_values. Doesn't allocate.
+int parse_numbers(const char *line, int length, double *values, int max_values);
+
+// Reassembles frames from a byte stream.
+// Bytes are read directly into the decoder's fixed buffer (write_ptr/commit)
+// and frames are returned as pointers into that buffer, so decoding never allocates.
+class FrameDecoder
+{
+public:
+    FrameDecoder();
+
+    char *write_ptr() { return (char *) buffer + tail; }
+    int free_space() const { return (int) sizeof(buffer) - tail; }
+    void commit(int count) { tail += count; }
+    void reset();
+
+    // Returns the type of the next valid frame or 0 if no complete frame is buffered.
+    // *payload stays valid until the next call.
+    int next_frame(const uint8_t **payload, int *length);
+
+    uint32_t crc_errors;
+
+private:
+    void compact();
+
+    uint8_t buffer[1024];
+    int head;   // first unparsed byte
+    int tail;   // end of received bytes
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,70 @@
+#include "rclinkstats.h"
+
+#include <math.h>
+
+void RcLinkStats::clear()
+{
+    window_start = -1;
+    last_time = -1;
+    last_seq = -1;
+    intervals = 0;
+    sum = 0;
+    sum_squares = 0;
+    max = 0;
+    total_dropped = 0;
+    shown_rate = 0;
+    shown_interval = 0;
+    shown_jitter = 0;
+    shown_max = 0;
+}
+
+void RcLinkStats::add(qint64 time_ns, qint64 seq)
+{
+    double interval, mean;
+    quint32 gap;
+
+    if ( window_start < 0 )
+    {
+        window_start = time_ns;
+    }
+
+    if ( seq >= 0 && last_seq >= 0 )
+    {
+        // seq is 32 bit on the wire, a step back is a restarted stream, not a drop
+        gap = (quint32) (seq - last_seq);
+        if ( gap > 1 && gap < 0x80000000u )
+        {
+            total_dropped += gap - 1;
+        }
+    }
+    last_seq = seq;
+
+    if ( last_time >= 0 )
+    {
+        interval = (time_ns - last_time) / 1e6;
+        intervals++;
+        sum += interval;
+        sum_squares += interval * interval;
+        if ( interval > max )
+        {
+            max = interval;
+        }
+    }
+    last_time = time_ns;
+
+    if ( time_ns - window_start >= 1000000000 )
+    {
+        // window_start is the arrival of a frame, so the intervals fill the window exactly
+        shown_rate = intervals * 1e9 / (time_ns - window_start);
+        mean = intervals > 0 ? sum / intervals : 0;
+        shown_interval = mean;
+        shown_jitter = intervals > 1 ? sqrt(qMax(0.0, sum_squares / intervals - mean * mean)) : 0;
+        shown_max = max;
+
+        window_start = time_ns;
+        intervals = 0;
+        sum = 0;
+        sum_squares = 0;
+        max = 0;
+    }
+}
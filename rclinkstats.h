@@ -0,0 +1,44 @@
+#ifndef RCLINKSTATS_H
+#define RCLINKSTATS_H
+
+#include <QtGlobal>
+
+// Frame rate, drops and timing jitter of the rc channel stream.
+//
+// Frames are added with their arrival time and sequence number, the
+// figures are taken over one second windows so they follow the link in
+// real time without keeping the frames.
+class RcLinkStats
+{
+public:
+    RcLinkStats() { clear(); }
+
+    void clear();
+    // seq < 0 for rc lines, they can't tell about drops
+    void add(qint64 time_ns, qint64 seq);
+
+    // of the last complete window, 0 before the first one
+    double rate() const { return shown_rate; }
+    double interval_ms() const { return shown_interval; }
+    double jitter_ms() const { return shown_jitter; }   // standard deviation of the interval
+    double max_interval_ms() const { return shown_max; }
+    quint64 dropped() const { return total_dropped; }  // since clear()
+    // no frame for a second, the figures are out of date
+    bool stale(qint64 now_ns) const { return last_time < 0 || now_ns - last_time > 1000000000; }
+
+private:
+    qint64 window_start;
+    qint64 last_time;
+    qint64 last_seq;
+    int intervals;          // in the current window
+    double sum;             // of the intervals in ms
+    double sum_squares;
+    double max;
+    quint64 total_dropped;
+    double shown_rate;
+    double shown_interval;
+    double shown_jitter;
+    double shown_max;
+};
+
+#endif // RCLINKSTATS_H
@@ -0,0 +1,163 @@
+#include "rcrecorder.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSaveFile>
+#include <math.h>
+
+namespace {
+
+// 1 us up to 10 s and the full 12 bit channel range, both within 1.6 %
+const int64_t interval_highest_us = 10000000;
+const int64_t noise_highest = 4096;
+const int precision_bits = 7;
+
+QJsonObject histogram_json(const HdrHistogram &histogram)
+{
+    QJsonObject object;
+    QJsonArray buckets;
+    int i;
+
+    object["count"] = (double) histogram.count();
+    object["min"] = (double) histogram.min();
+    object["max"] = (double) histogram.max();
+    object["mean"] = histogram.mean();
+    object["p50"] = (double) histogram.percentile(50);
+    object["p90"] = (double) histogram.percentile(90);
+    object["p99"] = (double) histogram.percentile(99);
+    object["p99_9"] = (double) histogram.percentile(99.9);
+
+    // [low, high, count] of the buckets in use
+    for ( i = 0; i < histogram.buckets(); i++ )
+    {
+        if ( histogram.bucket_count(i) > 0 )
+        {
+            buckets.append(QJsonArray() << (double) histogram.bucket_low(i) << (double) histogram.bucket_high(i)
+                                        << (double) histogram.bucket_count(i));
+        }
+    }
+    object["buckets"] = buckets;
+
+    return object;
+}
+
+}
+
+RcRecorder::RcRecorder() :
+    interval(interval_highest_us, precision_bits),
+    noise(channels, HdrHistogram(noise_highest, precision_bits)),
+    recording(false),
+    stream_open(false),
+    first_ns(0),
+    last_ns(0),
+    last_seq(-1),
+    frame_count(0),
+    dropped(0)
+{
+}
+
+void RcRecorder::start(const QString &receiver)
+{
+    int i;
+
+    interval.clear();
+    for ( i = 0; i < channels; i++ )
+    {
+        noise[i].clear();
+    }
+    receiver_name = receiver;
+    started = QDateTime::currentDateTime();
+    stream_open = false;
+    first_ns = 0;
+    last_ns = 0;
+    frame_count = 0;
+    dropped = 0;
+    recording = true;
+}
+
+void RcRecorder::stop()
+{
+    recording = false;
+}
+
+void RcRecorder::break_stream()
+{
+    stream_open = false;
+}
+
+void RcRecorder::add(qint64 time_ns, qint64 seq, const double *values)
+{
+    quint32 gap;
+    int i;
+
+    if ( !recording )
+    {
+        return;
+    }
+
+    if ( frame_count == 0 )
+    {
+        first_ns = time_ns;
+    }
+
+    if ( stream_open )
+    {
+        interval.record((time_ns - last_ns) / 1000);
+        for ( i = 0; i < channels; i++ )
+        {
+            noise[i].record((int64_t) fabs(values[i] - last_values[i]));
+        }
+
+        if ( seq >= 0 && last_seq >= 0 )
+        {
+            gap = (quint32) (seq - last_seq);
+            if ( gap > 1 && gap < 0x80000000u )
+            {
+                dropped += gap - 1;
+            }
+        }
+    }
+
+    last_ns = time_ns;
+    last_seq = seq;
+    for ( i = 0; i < channels; i++ )
+    {
+        last_values[i] = values[i];
+    }
+    stream_open = true;
+    frame_count++;
+}
+
+bool RcRecorder::export_json(const QString &path) const
+{
+    QJsonObject root;
+    QJsonArray channel_list;
+    QSaveFile file(path);
+    int i;
+
+    root["receiver"] = receiver_name;
+    root["started"] = started.toString(Qt::ISODate);
+    root["duration_s"] = duration_s();
+    root["frames"] = (double) frame_count;
+    root["dropped"] = (double) dropped;
+    // one frame carries all channels, they share the interval
+    root["interval_us"] = histogram_json(interval);
+
+    for ( i = 0; i < channels; i++ )
+    {
+        QJsonObject channel;
+
+        channel["channel"] = i + 1;
+        channel["noise"] = histogram_json(noise[i]);
+        channel_list.append(channel);
+    }
+    root["channels"] = channel_list;
+
+    if ( !file.open(QIODevice::WriteOnly) )
+    {
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson());
+    return file.commit();
+}
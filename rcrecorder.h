@@ -0,0 +1,54 @@
+#ifndef RCRECORDER_H
+#define RCRECORDER_H
+
+#include <QString>
+#include <QDateTime>
+#include <vector>
+
+#include "hdrhistogram.h"
+
+// Receiver qualification, e.g. SBUS against SRXL.
+//
+// Every rc frame is recorded with its monotonic arrival time into a
+// histogram of the frame interval and, per channel, a histogram of the
+// value change against the previous frame (the noise while the sticks are
+// held still). The histograms have a fixed size, so a recording can run
+// for hours at constant memory. export_json() writes them with their
+// percentiles.
+class RcRecorder
+{
+public:
+    enum { channels = 12 };
+
+    RcRecorder();
+
+    void start(const QString &receiver);
+    void stop();
+    bool isRecording() const { return recording; }
+
+    // seq < 0 for rc lines
+    void add(qint64 time_ns, qint64 seq, const double *values);
+    // the stream paused (tab switch), the next interval isn't one
+    void break_stream();
+
+    quint64 frames() const { return frame_count; }
+    double duration_s() const { return last_ns > first_ns ? (last_ns - first_ns) / 1e9 : 0; }
+
+    bool export_json(const QString &path) const;
+
+private:
+    HdrHistogram interval;          // us
+    std::vector<HdrHistogram> noise;
+    QString receiver_name;
+    QDateTime started;
+    bool recording;
+    bool stream_open;               // last_ns and last_values belong to the running stream
+    qint64 first_ns;
+    qint64 last_ns;
+    qint64 last_seq;
+    double last_values[channels];
+    quint64 frame_count;
+    quint64 dropped;
+};
+
+#endif // RCRECORDER_H
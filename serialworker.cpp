@@ -0,0 +1,1265 @@
+#include "serialworker.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+namespace {
+
+enum { // engine inputs
+    input_timeout,
+    input_magic,
+    input_settings_done,
+    input_ok_push,
+    input_settings_rcvd,
+    input_delta_rcvd,
+    input_motors_receipt,
+    input_frame,
+    input_written,
+    input_write_error
+};
+
+enum { // transition actions
+    act_none,
+    act_pulled,
+    act_pull_failed,
+    act_write_settings,
+    act_pushed,
+    act_push_failed,
+    act_delta_pushed,
+    act_delta_ignored,
+    act_binary,
+    act_live_ascii,
+    act_channels_ascii,
+    act_motors_receipt,
+    act_motors_binary,
+    act_motors_ascii
+};
+
+typedef struct
+{
+    const char *request;
+    int length;         // the firmware expects the trailing NUL
+    bool clear;         // drop stale port data before sending
+    int state;          // state once sent, -1 keeps the current one
+    bool response;      // finished by a transition, otherwise once written
+} command_desc;
+
+const command_desc commands[cmd_count] = {
+    // request         length clear  state                  response
+    { "fw_tab",         7,    true,  state_idle,            false },
+    { "rc_bin_tab",    11,    true,  state_channels_negotiate, false },
+    { "motors_bin_tab", 15,   true,  state_motors_negotiate, false },
+    { "flight_tab",    11,    true,  state_idle,            false },
+    { "live_bin_tab",  13,    true,  state_live_negotiate,  false },
+    { "suspend",        8,    true,  state_idle,            false },
+    { "pull_settings", 14,    true,  state_pull_wait,       true  },
+    { "push_settings", 14,    true,  state_push_wait_ok,    true  },
+    { "push_delta",    11,    true,  state_delta_wait_rcvd, true  },
+    { "load_defaults", 14,    false, -1,                    false },
+    { "cal_acc",        8,    false, -1,                    false },
+    { "reboot",         7,    false, state_idle,            false },
+    { "bootloader",    11,    false, state_idle,            false }
+};
+
+// ms the device gets to answer in a state, 0 = no limit
+const int state_timeouts[state_count] = {
+    0,      // state_idle
+    0,      // state_channels
+    300,    // state_channels_negotiate, old firmware ignores rc_bin_tab
+    0,      // state_channels_binary
+    0,      // state_motors
+    300,    // state_motors_negotiate, old firmware ignores motors_bin_tab
+    0,      // state_motors_binary
+    300,    // state_live_negotiate, old firmware ignores live_bin_tab
+    0,      // state_live_ascii
+    0,      // state_live_binary
+    1000,   // state_pull_wait, device pauses > 300 ms before sending
+    500,    // state_pull_read
+    1000,   // state_push_wait_ok
+    1000,   // state_push_write
+    1000,   // state_push_wait_rcvd
+    200     // state_delta_wait_rcvd, plus link_us_per_byte for the frames
+};
+
+typedef struct
+{
+    int state;
+    int input;
+    int next;
+    int action;
+} transition;
+
+const transition transitions[] = {
+    // state                 input                  next                   action
+    { state_pull_wait,       input_magic,           state_pull_read,       act_none },
+    { state_pull_wait,       input_timeout,         state_idle,            act_pull_failed },
+    { state_pull_read,       input_settings_done,   state_idle,            act_pulled },
+    { state_pull_read,       input_timeout,         state_idle,            act_pull_failed },
+    { state_push_wait_ok,    input_ok_push,         state_push_write,      act_write_settings },
+    { state_push_wait_ok,    input_timeout,         state_idle,            act_push_failed },
+    { state_push_write,      input_written,         state_push_wait_rcvd,  act_none },
+    { state_push_write,      input_settings_rcvd,   state_idle,            act_pushed },
+    { state_push_write,      input_write_error,     state_idle,            act_push_failed },
+    { state_push_write,      input_timeout,         state_idle,            act_push_failed },
+    { state_push_wait_rcvd,  input_settings_rcvd,   state_idle,            act_pushed },
+    { state_push_wait_rcvd,  input_timeout,         state_idle,            act_push_failed },
+    { state_delta_wait_rcvd, input_delta_rcvd,      state_idle,            act_delta_pushed },
+    { state_delta_wait_rcvd, input_timeout,         state_idle,            act_delta_ignored },
+    { state_live_negotiate,  input_frame,           state_live_binary,     act_binary },
+    { state_live_negotiate,  input_timeout,         state_live_ascii,      act_live_ascii },
+    { state_channels_negotiate, input_frame,        state_channels_binary, act_binary },
+    { state_channels_negotiate, input_timeout,      state_channels,        act_channels_ascii },
+    { state_motors,          input_motors_receipt,  state_motors,          act_motors_receipt },
+    { state_motors_negotiate, input_frame,          state_motors_binary,   act_motors_binary },
+    { state_motors_negotiate, input_timeout,        state_motors,          act_motors_ascii }
+};
+
+const uint8_t settings_magic = 0xdb;
+
+// the device stops streaming within 20 ms of pull_settings and then stays
+// quiet for > 300 ms before the block, stream data may hold the magic byte
+const qint64 pull_gap_ns = 200000000;
+
+// one full speed USB packet, two are kept in flight
+const int push_chunk = 64;
+
+// what a byte may take on the slowest link (telemetry radios at 9600 baud),
+// the delta frames can still be queued in the OS and the radio when written
+const int link_us_per_byte = 1000;
+
+// a live delta frame not acked within this is written again, after the last
+// try its range is left to the next diff
+const int live_resend_ms = 100;
+const int live_resend_tries = 5;
+
+// rc frames per second asked for with rc_bin_tab, the receivers send every 7 to 22 ms
+const int rc_stream_rate = 100;
+
+// Qt timers have 1 ms resolution, a motor frame due within this is sent
+// early, the schedule keeps the exact period so the average rate holds
+const qint64 motor_tick_slack_ns = 500000;
+
+}
+
+SerialWorker::SerialWorker(QObject *parent) :
+    QObject(parent),
+    recorded_input(0),
+    pull_input_ns(0),
+    delta_supported(true),
+    port_open(false),
+    replaying(false),
+    command_active(false),
+    waiting_response(false),
+    push_offset(0),
+    state(state_idle),
+    tab_command(cmd_fw_tab),
+    motors_receipt(false),
+    motors_enabled(false),
+    motor_seq(0),
+    motor_rate(200),
+    motor_rate_limit(motor_rate_max),
+    motor_due_ns(0)
+{
+    // children of the worker, so moveToThread() takes them along
+    serial = new QSerialPort(this);
+    replay = new SessionReplay(this);
+    port = serial;
+    timeout_timer = new QTimer(this);
+    timeout_timer->setSingleShot(true);
+    motor_timer = new QTimer(this);
+    motor_timer->setSingleShot(true);
+    motor_timer->setTimerType(Qt::PreciseTimer);
+    live_resend_timer = new QTimer(this);
+    live_resend_timer->setSingleShot(true);
+
+    connect(serial, SIGNAL(readyRead()), this, SLOT(serialReadyRead()));
+    connect(serial, SIGNAL(bytesWritten(qint64)), this, SLOT(serialBytesWritten(qint64)));
+    connect(serial, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(serialPortError(QSerialPort::SerialPortError)));
+    connect(replay, SIGNAL(readyRead()), this, SLOT(serialReadyRead()));
+    connect(replay, SIGNAL(bytesWritten(qint64)), this, SLOT(serialBytesWritten(qint64)));
+    connect(replay, SIGNAL(outbound(QByteArray)), this, SLOT(replay_outbound(QByteArray)));
+    connect(replay, SIGNAL(finished()), this, SIGNAL(replay_finished()));
+    connect(timeout_timer, SIGNAL(timeout()), this, SLOT(state_timeout()));
+    connect(motor_timer, SIGNAL(timeout()), this, SLOT(motor_tick()));
+    connect(live_resend_timer, SIGNAL(timeout()), this, SLOT(resend_live_deltas()));
+
+    for ( int i = 0; i < 4; i++ )
+    {
+        motor_values[i] = 4000;
+    }
+}
+
+bool SerialWorker::open(const QString &port_name)
+{
+    bool ok = false;
+
+    QMetaObject::invokeMethod(this, "open_port", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok), Q_ARG(QString, port_name));
+    return ok;
+}
+
+void SerialWorker::close()
+{
+    QMetaObject::invokeMethod(this, "close_port", Qt::BlockingQueuedConnection);
+}
+
+bool SerialWorker::open_replay(const QString &path, double speed)
+{
+    bool ok = false;
+
+    QMetaObject::invokeMethod(this, "open_replay_port", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok), Q_ARG(QString, path), Q_ARG(double, speed));
+    return ok;
+}
+
+bool SerialWorker::start_recording(const QString &path)
+{
+    bool ok = false;
+
+    QMetaObject::invokeMethod(this, "start_recorder", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, ok), Q_ARG(QString, path));
+    return ok;
+}
+
+void SerialWorker::stop_recording()
+{
+    QMetaObject::invokeMethod(this, "stop_recorder", Qt::BlockingQueuedConnection);
+}
+
+void SerialWorker::enqueue(int command, const QByteArray &data)
+{
+    QMetaObject::invokeMethod(this, "add_command", Qt::QueuedConnection,
+                              Q_ARG(int, command), Q_ARG(QByteArray, data));
+}
+
+void SerialWorker::start_motors()
+{
+    QMetaObject::invokeMethod(this, "enable_motors", Qt::QueuedConnection);
+}
+
+void SerialWorker::set_motors(int motor1, int motor2, int motor3, int motor4)
+{
+    QMetaObject::invokeMethod(this, "update_motors", Qt::QueuedConnection,
+                              Q_ARG(int, motor1), Q_ARG(int, motor2), Q_ARG(int, motor3), Q_ARG(int, motor4));
+}
+
+void SerialWorker::set_motor_rate(int rate_hz)
+{
+    QMetaObject::invokeMethod(this, "update_motor_rate", Qt::QueuedConnection, Q_ARG(int, rate_hz));
+}
+
+void SerialWorker::stream_settings(const QByteArray &data)
+{
+    QMetaObject::invokeMethod(this, "write_live_settings", Qt::QueuedConnection, Q_ARG(QByteArray, data));
+}
+
+bool SerialWorker::open_port(QString port_name)
+{
+    if ( serial->isOpen() )
+    {
+        return true;
+    }
+
+    if ( replaying )
+    {
+        return false;
+    }
+
+    serial->setPortName(port_name);
+    serial->open(QIODevice::ReadWrite);
+
+    if ( !serial->isOpen() )
+    {
+        return false;
+    }
+
+    serial->setBaudRate(QSerialPort::Baud115200);
+    serial->setDataBits(QSerialPort::Data8);
+    serial->setParity(QSerialPort::NoParity);
+    serial->setStopBits(QSerialPort::OneStop);
+    serial->setFlowControl(QSerialPort::NoFlowControl);
+
+    port = serial;
+    recorded_input = 0;
+    device_settings.clear();
+    live_settings.clear();
+    delta_supported = true;
+    queue.clear();
+    command_active = false;
+    waiting_response = false;
+    set_state(state_idle);
+    port_open = true;
+
+    return true;
+}
+
+void SerialWorker::close_port()
+{
+    if ( replaying )
+    {
+        replay->stop();
+        port = serial;
+        replaying = false;
+    }
+    else
+    {
+        serial->close();
+    }
+    port_open = false;
+
+    queue.clear();
+    command_active = false;
+    waiting_response = false;
+    set_state(state_idle);
+}
+
+bool SerialWorker::open_replay_port(QString path, double speed)
+{
+    if ( port_open || !replay->start(path, speed) )
+    {
+        return false;
+    }
+
+    port = replay;
+    recorded_input = 0;
+    device_settings.clear();
+    live_settings.clear();
+    delta_supported = true;
+    queue.clear();
+    command_active = false;
+    waiting_response = false;
+    set_state(state_idle);
+    replaying = true;
+    port_open = true;
+
+    return true;
+}
+
+void SerialWorker::replay_outbound(QByteArray data)
+{
+    int i;
+
+    // repeat the recorded host commands, so the device bytes
+    // of the session meet the states they were recorded in
+    for ( i = 0; i < cmd_count; i++ )
+    {
+        if ( data == QByteArray::fromRawData(commands[i].request, commands[i].length) )
+        {
+            add_command(i, QByteArray());
+            return;
+        }
+    }
+
+    // the recorded host fell back to ASCII, its timeout doesn't line up at other speeds
+    if ( (state == state_live_negotiate && data == QByteArray::fromRawData("live_tab", 9)) ||
+         (state == state_channels_negotiate && data == QByteArray::fromRawData("config_tab", 11)) ||
+         (state == state_motors_negotiate && data == QByteArray::fromRawData("motors_tab", 11)) )
+    {
+        handle_input(input_timeout);
+    }
+    else if ( data == QByteArray::fromRawData("config_tab", 11) )
+    {
+        // sessions from before rc_bin_tab
+        add_command(cmd_config_tab, QByteArray());
+    }
+    else if ( data == QByteArray::fromRawData("motors_tab", 11) )
+    {
+        // sessions from before motors_bin_tab
+        add_command(cmd_motors_tab, QByteArray());
+    }
+}
+
+bool SerialWorker::start_recorder(QString path)
+{
+    recorded_input = port->isOpen() ? port->bytesAvailable() : 0;
+    return recorder.open(path);
+}
+
+void SerialWorker::stop_recorder()
+{
+    recorder.close();
+}
+
+void SerialWorker::clear_port()
+{
+    // a replay has nothing stale, the session holds what was read after the clear
+    if ( !replaying )
+    {
+        serial->clear();
+    }
+    recorded_input = 0;
+    frame_decoder.reset();
+}
+
+qint64 SerialWorker::write_port(const char *data, qint64 length)
+{
+    qint64 count = port->write(data, length);
+
+    if ( count > 0 && recorder.isOpen() )
+    {
+        recorder.record(session_out, monotonic_ns(), data, count);
+    }
+
+    return count;
+}
+
+void SerialWorker::record_input()
+{
+    qint64 available = port->bytesAvailable();
+    QByteArray data;
+
+    // only what arrived since the last call, unread leftovers are recorded already
+    if ( recorder.isOpen() && available > recorded_input )
+    {
+        data = port->peek(available);
+        recorder.record(session_in, monotonic_ns(), data.constData() + recorded_input, data.size() - recorded_input);
+    }
+}
+
+qint64 SerialWorker::input_ns() const
+{
+    // a replay hands out the input at its own pace, the gaps are those recorded
+    return replaying ? replay->time_ns() : monotonic_ns();
+}
+
+void SerialWorker::add_command(int command, QByteArray data)
+{
+    queued_command item;
+
+    item.command = command;
+    item.data = data;
+    queue.enqueue(item);
+
+    start_next_command();
+}
+
+void SerialWorker::enable_motors()
+{
+    // the first motor record goes out without waiting for a receipt
+    motors_receipt = true;
+    motors_enabled = true;
+
+    if ( state == state_motors_binary && !motor_timer->isActive() )
+    {
+        motor_due_ns = monotonic_ns();
+        motor_tick();
+    }
+}
+
+void SerialWorker::update_motors(int motor1, int motor2, int motor3, int motor4)
+{
+    char record[20];
+
+    motor_values[0] = motor1;
+    motor_values[1] = motor2;
+    motor_values[2] = motor3;
+    motor_values[3] = motor4;
+
+    // a binary stream picks the values up with its next frame, old firmware
+    // reads fixed 20 byte records, one per motors_receipt
+    if ( state == state_motors && motors_enabled && motors_receipt )
+    {
+        memset(record, 0, sizeof(record));
+        snprintf(record, sizeof(record), "%d,%d,%d,%d", motor1, motor2, motor3, motor4);
+        write_port(record, sizeof(record));
+        motors_receipt = false;
+    }
+}
+
+void SerialWorker::update_motor_rate(int rate_hz)
+{
+    motor_rate = qBound((int) motor_rate_min, rate_hz, (int) motor_rate_max);
+}
+
+void SerialWorker::motor_tick()
+{
+    qint64 now = monotonic_ns();
+    qint64 period = 1000000000LL / qMin(motor_rate, motor_rate_limit);
+
+    if ( state != state_motors_binary || !motors_enabled )
+    {
+        return;
+    }
+
+    if ( now >= motor_due_ns - motor_tick_slack_ns )
+    {
+        write_motor_frame();
+        motor_due_ns += period;
+
+        // the thread was held up for more than a period, don't send a burst to catch up
+        if ( motor_due_ns < now )
+        {
+            motor_due_ns = now + period;
+        }
+    }
+
+    motor_timer->start((motor_due_ns - now + 500000) / 1000000);
+}
+
+void SerialWorker::write_motor_frame()
+{
+    uint8_t out[frame_header_size + sizeof(motor_frame) + frame_crc_size];
+    motor_frame frame;
+    int i;
+
+    frame.seq = ++motor_seq;
+    for ( i = 0; i < 4; i++ )
+    {
+        frame.value[i] = motor_values[i];
+    }
+
+    // a port that can't keep up gets no backlog of stale commands, the seq shows the gap
+    if ( port->bytesToWrite() < (qint64) sizeof(out) * 4 )
+    {
+        write_port((const char *) out, frame_encode(frame_motor, &frame, sizeof(frame), out));
+    }
+}
+
+void SerialWorker::write_live_settings(QByteArray data)
+{
+    // frames can only be mixed into a binary stream
+    if ( state != state_live_binary )
+    {
+        return;
+    }
+
+    if ( live_settings.size() != data.size() )
+    {
+        if ( device_settings.size() != data.size() )
+        {
+            return;
+        }
+        live_settings = device_settings;
+        live_unacked.clear();
+    }
+
+    live_target = data;
+    send_live_deltas();
+}
+
+void SerialWorker::send_live_deltas()
+{
+    QByteArray from = live_settings;
+    live_delta delta;
+    delta_frame frame;
+    int size;
+    int used;
+    int length;
+
+    // a range in flight keeps its bytes until acked, newer values there go
+    // out after the ack, so an ack always matches exactly one frame
+    foreach ( const live_delta &sent, live_unacked )
+    {
+        memcpy(from.data() + sent.offset, live_target.constData() + sent.offset, sent.data.size());
+    }
+
+    size = delta_encode((const uint8_t *) from.constData(), (const uint8_t *) live_target.constData(),
+                        live_target.size(), delta_buffer, sizeof(delta_buffer));
+    if ( size <= 0 )
+    {
+        return;
+    }
+
+    // remember each frame with the bytes it carries
+    for ( used = 0; used < size; used += length )
+    {
+        length = frame_header_size + delta_buffer[used + 3] + frame_crc_size;
+        memcpy(&frame, delta_buffer + used + frame_header_size, delta_buffer[used + 3]);
+
+        delta.offset = frame.offset;
+        delta.data = QByteArray((const char *) frame.data, frame.length);
+        delta.frame = QByteArray((const char *) delta_buffer + used, length);
+        delta.sent_ns = monotonic_ns();
+        delta.sends = 1;
+        delta.unacked = 1;
+        delta.acked = false;
+        live_unacked << delta;
+    }
+
+    tuning_clock.start();
+    write_port((const char *) delta_buffer, size);
+
+    if ( !live_resend_timer->isActive() )
+    {
+        live_resend_timer->start(live_resend_ms);
+    }
+}
+
+void SerialWorker::live_delta_acked(const delta_ack &ack)
+{
+    int i;
+
+    for ( i = 0; i < live_unacked.size(); i++ )
+    {
+        live_delta &delta = live_unacked[i];
+
+        if ( delta.offset != ack.offset || delta.data.size() != ack.length )
+        {
+            continue;
+        }
+
+        // the device runs what this frame carried, not necessarily the target
+        if ( !delta.acked && delta.offset + delta.data.size() <= live_settings.size() )
+        {
+            memcpy(live_settings.data() + delta.offset, delta.data.constData(), delta.data.size());
+            emit live_settings_acked(tuning_clock.nsecsElapsed() / 1000);
+        }
+        delta.acked = true;
+
+        // a resent frame is acked once per copy, the range stays held until the last one
+        if ( --delta.unacked <= 0 )
+        {
+            live_unacked.removeAt(i);
+        }
+        send_live_deltas();
+        return;
+    }
+}
+
+void SerialWorker::resend_live_deltas()
+{
+    qint64 now = monotonic_ns();
+    bool freed = false;
+    int i = 0;
+
+    while ( i < live_unacked.size() )
+    {
+        live_delta &delta = live_unacked[i];
+
+        if ( now - delta.sent_ns < live_resend_ms * 1000000LL )
+        {
+            i++;
+            continue;
+        }
+
+        // an acked frame doesn't wait for the acks of lost copies, an unacked
+        // one is given up after the last try, its bytes then differ again
+        if ( delta.acked || delta.sends >= live_resend_tries )
+        {
+            live_unacked.removeAt(i);
+            freed = true;
+            continue;
+        }
+
+        write_port(delta.frame.constData(), delta.frame.size());
+        delta.sent_ns = now;
+        delta.sends++;
+        delta.unacked++;
+        i++;
+    }
+
+    if ( freed )
+    {
+        send_live_deltas();
+    }
+    if ( !live_unacked.isEmpty() && !live_resend_timer->isActive() )
+    {
+        live_resend_timer->start(live_resend_ms);
+    }
+}
+
+void SerialWorker::start_next_command()
+{
+    const command_desc *desc;
+    int frames_size = 0;    // of the frames following the request
+
+    if ( command_active || queue.isEmpty() || !port->isOpen() )
+    {
+        return;
+    }
+
+    current = queue.dequeue();
+
+    if ( current.command == cmd_push_delta )
+    {
+        frames_size = encode_delta();
+        if ( frames_size == 0 )
+        {
+            // the device has this block already, the GUI waits for a state change
+            emit command_finished(cmd_push_delta, true, 0);
+            emit state_changed(state);
+            start_next_command();
+            return;
+        }
+        if ( frames_size < 0 )
+        {
+            current.command = cmd_push_settings;
+        }
+    }
+
+    desc = &commands[current.command];
+
+    if ( current.command <= cmd_suspend )
+    {
+        tab_command = current.command;
+    }
+
+    if ( desc->clear )
+    {
+        clear_port();
+    }
+
+    if ( current.command == cmd_config_tab )
+    {
+        // the stream rate follows the request, old firmware ignores both
+        rc_subscribe subscribe = { (uint16_t) rc_stream_rate, 0 };
+        frames_size = frame_encode(frame_rc_subscribe, &subscribe, sizeof(subscribe), delta_buffer);
+    }
+
+    if ( write_port(desc->request, desc->length) < 0 ||
+         (frames_size > 0 && write_port((const char *) delta_buffer, frames_size) < 0) )
+    {
+        command_active = true;
+        finish_command(false);
+        return;
+    }
+
+    command_active = true;
+    waiting_response = desc->response;
+    command_clock.start();
+    pull_input_ns = input_ns();
+
+    if ( desc->state >= 0 )
+    {
+        set_state(desc->state);
+    }
+
+    // the device answers after the last frame, however long they take to get there
+    if ( state == state_delta_wait_rcvd )
+    {
+        timeout_timer->start(state_timeouts[state] + frames_size * link_us_per_byte / 1000);
+    }
+}
+
+int SerialWorker::encode_delta()
+{
+    // against what the device holds, unknown after opening until the first pull
+    if ( !delta_supported || device_settings.size() != current.data.size() )
+    {
+        return -1;
+    }
+
+    return delta_encode((const uint8_t *) device_settings.constData(), (const uint8_t *) current.data.constData(),
+                        current.data.size(), delta_buffer, sizeof(delta_buffer));
+}
+
+void SerialWorker::finish_command(bool ok)
+{
+    int command = current.command;
+
+    command_active = false;
+    waiting_response = false;
+    current.data.clear();
+
+    emit command_finished(command, ok, command_clock.nsecsElapsed() / 1000);
+
+    // the device stops streaming for pull/push, ask for the tab data again
+    if ( command == cmd_pull_settings || command == cmd_push_settings || command == cmd_push_delta )
+    {
+        resume_tab();
+    }
+
+    start_next_command();
+}
+
+void SerialWorker::resume_tab()
+{
+    int i;
+    queued_command item;
+
+    for ( i = 0; i < queue.size(); i++ )
+    {
+        if ( queue.at(i).command <= cmd_suspend )
+        {
+            // a tab switch is queued anyway
+            return;
+        }
+    }
+
+    item.command = tab_command;
+    queue.prepend(item);
+}
+
+void SerialWorker::set_state(int new_state)
+{
+    state = new_state;
+
+    // motors only run while the motor tab stays on, start_motors() again after that
+    if ( state != state_motors && state != state_motors_negotiate && state != state_motors_binary )
+    {
+        motors_enabled = false;
+    }
+    if ( state != state_motors_binary )
+    {
+        motor_timer->stop();
+    }
+
+    // live deltas only go out and get acked in the binary live stream
+    if ( state != state_live_binary )
+    {
+        live_unacked.clear();
+        live_resend_timer->stop();
+    }
+
+    if ( state_timeouts[state] > 0 )
+    {
+        timeout_timer->start(state_timeouts[state]);
+    }
+    else
+    {
+        timeout_timer->stop();
+    }
+
+    emit state_changed(state);
+}
+
+void SerialWorker::state_timeout()
+{
+    handle_input(input_timeout);
+}
+
+void SerialWorker::handle_input(int input)
+{
+    unsigned i;
+    const transition *t = 0;
+
+    for ( i = 0; i < sizeof(transitions) / sizeof(transitions[0]); i++ )
+    {
+        if ( transitions[i].state == state && transitions[i].input == input )
+        {
+            t = &transitions[i];
+            break;
+        }
+    }
+
+    if ( t == 0 )
+    {
+        // input not expected in this state
+        return;
+    }
+
+    if ( t->next != state )
+    {
+        set_state(t->next);
+    }
+
+    switch ( t->action )
+    {
+    case act_pulled:
+        device_settings = settings_buffer.left(1024);
+        live_settings = device_settings;
+        emit settings_received(settings_buffer.left(1024));
+        settings_buffer.clear();
+        finish_command(true);
+        break;
+
+    case act_pull_failed:
+    case act_push_failed:
+        // a failed push may have left anything on the device
+        if ( t->action == act_push_failed )
+        {
+            device_settings.clear();
+            live_settings.clear();
+        }
+        settings_buffer.clear();
+        finish_command(false);
+        break;
+
+    case act_write_settings:
+        // start streaming right away, serialBytesWritten() keeps it going
+        push_offset = 0;
+        write_settings_chunk();
+        break;
+
+    case act_pushed:
+    case act_delta_pushed:
+        device_settings = current.data;
+        live_settings = current.data;
+        finish_command(true);
+        break;
+
+    case act_delta_ignored:
+    {
+        // maybe just slow, push the whole block this time, only old firmware
+        // (found out by the tab negotiation) stops the deltas
+        queued_command item = current;
+
+        item.command = cmd_push_settings;
+        command_active = false;
+        waiting_response = false;
+        queue.prepend(item);
+        start_next_command();
+        break;
+    }
+
+    case act_binary:
+        // firmware with frames, it takes push_delta too
+        delta_supported = true;
+        break;
+
+    case act_live_ascii:
+        // old firmware ignored live_bin_tab, and push_delta as well
+        delta_supported = false;
+        clear_port();
+        write_port("live_tab", 9);
+        break;
+
+    case act_channels_ascii:
+        // old firmware ignored rc_bin_tab, lines with receipts then
+        delta_supported = false;
+        clear_port();
+        write_port("config_tab", 11);
+        break;
+
+    case act_motors_receipt:
+        motors_receipt = true;
+        break;
+
+    case act_motors_binary:
+        // a new stream, the device counts from the first frame
+        delta_supported = true;
+        motor_seq = 0;
+        if ( motors_enabled )
+        {
+            motor_due_ns = monotonic_ns();
+            motor_tick();
+        }
+        break;
+
+    case act_motors_ascii:
+        // old firmware ignored motors_bin_tab, records with receipts then
+        delta_supported = false;
+        clear_port();
+        write_port("motors_tab", 11);
+        break;
+    }
+}
+
+void SerialWorker::write_settings_chunk()
+{
+    qint64 count;
+    int size = current.data.size();
+
+    // top up the port's write buffer, never more than two chunks ahead
+    while ( push_offset < size && port->bytesToWrite() < push_chunk )
+    {
+        count = write_port(current.data.constData() + push_offset, qMin(push_chunk, size - push_offset));
+        if ( count < 0 )
+        {
+            handle_input(input_write_error);
+            return;
+        }
+        push_offset += count;
+    }
+}
+
+void SerialWorker::serialBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+
+    if ( state == state_push_write )
+    {
+        write_settings_chunk();
+
+        if ( state == state_push_write && push_offset >= current.data.size() && port->bytesToWrite() == 0 )
+        {
+            handle_input(input_written);
+        }
+        return;
+    }
+
+    // commands the device doesn't answer are done once on the wire
+    if ( command_active && !waiting_response && port->bytesToWrite() == 0 )
+    {
+        finish_command(true);
+    }
+}
+
+void SerialWorker::serialReadyRead()
+{
+    record_input();
+
+    switch ( state )
+    {
+    case state_pull_wait:
+    {
+        // the block is the first input after the quiet gap, anything
+        // before that is left over stream data
+        qint64 now = input_ns();
+        QByteArray data = port->readAll();
+
+        if ( now - pull_input_ns >= pull_gap_ns && data.startsWith((char) settings_magic) )
+        {
+            settings_buffer = data.left(1024);
+            handle_input(input_magic);
+            read_settings();
+        }
+        pull_input_ns = now;
+        break;
+    }
+
+    case state_pull_read:
+        read_settings();
+        break;
+
+    case state_live_negotiate:
+    case state_live_binary:
+        read_live_frames();
+        break;
+
+    case state_channels_negotiate:
+    case state_channels_binary:
+        read_rc_frames();
+        break;
+
+    case state_motors_negotiate:
+    case state_motors_binary:
+        read_motor_ack();
+        break;
+
+    case state_idle:
+        port->readAll();
+        break;
+
+    default:
+        read_lines();
+        break;
+    }
+
+    recorded_input = port->bytesAvailable();
+}
+
+void SerialWorker::read_settings()
+{
+    settings_buffer.append(port->read(1024 - settings_buffer.size()));
+
+    if ( settings_buffer.size() >= 1024 )
+    {
+        handle_input(input_settings_done);
+    }
+}
+
+void SerialWorker::read_lines()
+{
+    int i;
+    qint64 length;
+    char line[101];
+    serial_event event;
+
+    while ( port->canReadLine() )
+    {
+        if ( state == state_channels )
+        {
+            // straight into a stack buffer, no QString/QStringList per line
+            length = port->readLine(line, 62);
+
+            if ( length > 0 && parse_numbers(line, length, event.values, 12) == 12 )
+            {
+                event.type = event_channels;
+                event.time_ns = monotonic_ns();
+                event.seq = -1;
+
+                ring.push(event);
+
+                write_port("channels_receipt", 17);
+            }
+        }
+        else if ( state == state_live_ascii )
+        {
+            length = port->readLine(line, 101);
+
+            if ( length > 0 && parse_numbers(line, length, event.values, 9) == 9 )
+            {
+                event.type = event_live;
+                event.time_ns = monotonic_ns();
+
+                for (i=6; i<9; i++)
+                {
+                    event.values[i] *= 180/M_PI;
+                    // no sticks in live lines, centred means no set point
+                    event.values[i + 3] = 2048;
+                }
+
+                ring.push(event);
+
+                write_port("live_receipt", 13);
+            }
+        }
+        else
+        {
+            // receipts, this also eats up spurious lines from the previous state
+            // so it has to read up to the channels line length
+            QByteArray receipt_string = port->readLine(61).trimmed();
+
+            if ( receipt_string == "motors_receipt" )
+            {
+                handle_input(input_motors_receipt);
+            }
+            else if ( receipt_string == "ok_push" )
+            {
+                handle_input(input_ok_push);
+            }
+            else if ( receipt_string == "settings_rcvd" )
+            {
+                handle_input(input_settings_rcvd);
+            }
+            else if ( receipt_string == "delta_rcvd" )
+            {
+                handle_input(input_delta_rcvd);
+            }
+        }
+
+        // a transition may have switched to a binary state
+        if ( state == state_idle || state == state_pull_wait || state == state_pull_read ||
+             state == state_live_negotiate || state == state_live_binary ||
+             state == state_channels_negotiate || state == state_channels_binary ||
+             state == state_motors_negotiate || state == state_motors_binary )
+        {
+            break;
+        }
+    }
+}
+
+void SerialWorker::read_live_frames()
+{
+    const uint8_t *payload;
+    int length;
+    int type;
+    int i;
+    qint64 count;
+    live_frame frame;
+    delta_ack ack;
+    serial_event event;
+
+    // read straight into the decoder buffer, no per sample allocation
+    // and no receipt, the firmware streams frames on its own
+    while ( frame_decoder.free_space() > 0 )
+    {
+        count = port->read(frame_decoder.write_ptr(), frame_decoder.free_space());
+        if ( count <= 0 )
+        {
+            break;
+        }
+        frame_decoder.commit(count);
+
+        while ( (type = frame_decoder.next_frame(&payload, &length)) != 0 )
+        {
+            if ( type == frame_delta_ack && length == sizeof(delta_ack) )
+            {
+                memcpy(&ack, payload, sizeof(ack));
+                live_delta_acked(ack);
+                continue;
+            }
+
+            if ( type != frame_live || length != sizeof(live_frame) )
+            {
+                continue;
+            }
+
+            handle_input(input_frame);
+
+            memcpy(&frame, payload, sizeof(live_frame));
+
+            event.type = event_live;
+            event.time_ns = monotonic_ns();
+
+            for (i=0; i<3; i++)
+            {
+                event.values[i] = frame.acc[i];
+                event.values[i + 3] = frame.gyro[i];
+                event.values[i + 6] = frame.angle[i] * 180/M_PI;
+                event.values[i + 9] = frame.sticks[i];
+            }
+
+            ring.push(event);
+        }
+    }
+}
+
+void SerialWorker::read_rc_frames()
+{
+    const uint8_t *payload;
+    int length;
+    int type;
+    int i;
+    qint64 count;
+    rc_frame frame;
+    serial_event event;
+
+    while ( frame_decoder.free_space() > 0 )
+    {
+        count = port->read(frame_decoder.write_ptr(), frame_decoder.free_space());
+        if ( count <= 0 )
+        {
+            break;
+        }
+        frame_decoder.commit(count);
+
+        // a stray frame of another type must not stall the rc frames behind it
+        while ( (type = frame_decoder.next_frame(&payload, &length)) != 0 )
+        {
+            if ( type != frame_rc || length != sizeof(rc_frame) )
+            {
+                continue;
+            }
+
+            handle_input(input_frame);
+
+            memcpy(&frame, payload, sizeof(rc_frame));
+
+            event.type = event_channels;
+            event.time_ns = monotonic_ns();
+            event.seq = frame.seq;
+
+            for (i=0; i<12; i++)
+            {
+                event.values[i] = frame.channels[i];
+            }
+
+            ring.push(event);
+        }
+    }
+}
+
+void SerialWorker::read_motor_ack()
+{
+    const uint8_t *payload;
+    int length;
+    int type;
+    qint64 count;
+    motor_ack ack;
+
+    // the device only answers motors_bin_tab, anything else is dropped
+    while ( frame_decoder.free_space() > 0 )
+    {
+        count = port->read(frame_decoder.write_ptr(), frame_decoder.free_space());
+        if ( count <= 0 )
+        {
+            break;
+        }
+        frame_decoder.commit(count);
+
+        while ( (type = frame_decoder.next_frame(&payload, &length)) != 0 )
+        {
+            if ( type != frame_motor_ack || length != sizeof(motor_ack) )
+            {
+                continue;
+            }
+
+            memcpy(&ack, payload, sizeof(motor_ack));
+            motor_rate_limit = ack.max_rate_hz > 0 ? ack.max_rate_hz : (int) motor_rate_max;
+
+            handle_input(input_frame);
+        }
+    }
+}
+
+void SerialWorker::serialPortError(QSerialPort::SerialPortError error)
+{
+    if ( error != QSerialPort::NoError )
+    {
+        // the GUI decides about closing, see MainWindow::serialPortError()
+        emit port_error(error);
+    }
+}
@@ -0,0 +1,209 @@
+#ifndef SERIALWORKER_H
+#define SERIALWORKER_H
+
+#include <QObject>
+#include <QtSerialPort/QtSerialPort>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <atomic>
+#include <chrono>
+
+#include "protocol.h"
+#include "sessionlog.h"
+#include "spscring.h"
+
+enum { // protocol engine commands, the tab commands match the tab index
+    cmd_fw_tab,
+    cmd_config_tab,
+    cmd_motors_tab,
+    cmd_flight_tab,
+    cmd_live_tab,
+    cmd_suspend,
+    cmd_pull_settings,
+    cmd_push_settings,
+    cmd_push_delta,         // data is the whole block, only the changes are sent
+    cmd_load_defaults,
+    cmd_cal_acc,
+    cmd_reboot,
+    cmd_bootloader,
+    cmd_count
+};
+
+enum { // protocol engine states
+    state_idle,             // nothing streamed
+    state_channels,         // rc lines, each answered with channels_receipt
+    state_channels_negotiate, // rc_bin_tab sent, waiting for the first rc frame
+    state_channels_binary,  // rc frames, no receipts
+    state_motors,           // motor records, each answered with motors_receipt
+    state_motors_negotiate, // motors_bin_tab sent, waiting for the motor_ack frame
+    state_motors_binary,    // motor frames streamed at motor_rate, no receipts
+    state_live_negotiate,   // live_bin_tab sent, waiting for the first frame
+    state_live_ascii,       // live lines, each answered with live_receipt
+    state_live_binary,      // live frames, no receipts
+    state_pull_wait,        // pull_settings sent, waiting for the quiet gap and the magic byte
+    state_pull_read,        // collecting the settings blob
+    state_push_wait_ok,     // push_settings sent, waiting for ok_push
+    state_push_write,       // streaming the blob, paced by bytesWritten
+    state_push_wait_rcvd,   // blob written, waiting for settings_rcvd
+    state_delta_wait_rcvd,  // push_delta and its frames written, waiting for delta_rcvd
+    state_count
+};
+
+enum { event_live, event_channels }; // serial_event type
+
+enum { motor_rate_min = 50, motor_rate_max = 400 }; // motor frames per second
+
+typedef struct
+{
+    int type;
+    qint64 time_ns;     // arrival, monotonic
+    double values[12];  // 9 live values and roll nick gier sticks, or 12 rc channels
+    qint64 seq;         // of an rc frame, -1 for rc lines
+} serial_event;
+
+typedef SpscRing<serial_event, 1024> SerialEventRing;
+
+// time base of serial_event::time_ns, usable from any thread
+inline qint64 monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Owns the QSerialPort and runs the protocol engine in its own thread.
+// Commands are queued and sent one at a time, each one is finished by the
+// device response (or by being written if the device doesn't answer) and
+// guarded by a timeout instead of fixed delays.
+// Decoded samples are pushed into the events() ring which the GUI drains
+// once per frame. The public functions may be called from the GUI thread,
+// they are marshalled into the worker thread.
+// Instead of the serial port the engine can run on a recorded session,
+// and the traffic of either can be recorded to a session file.
+class SerialWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SerialWorker(QObject *parent = 0);
+
+    bool open(const QString &port_name);
+    void close();
+    bool isOpen() const { return port_open; }
+    bool open_replay(const QString &path, double speed);
+    bool isReplaying() const { return replaying; }
+    bool start_recording(const QString &path);
+    void stop_recording();
+    void enqueue(int command, const QByteArray &data = QByteArray());
+    void start_motors();
+    // motor 1 to 4, 4000 stop .. 8000 full, streamed or sent as a record
+    void set_motors(int motor1, int motor2, int motor3, int motor4);
+    void set_motor_rate(int rate_hz);
+    // live tuning, only the changes against the running settings go out
+    void stream_settings(const QByteArray &data);
+
+    SerialEventRing *events() { return &ring; }
+
+signals:
+    void state_changed(int state);
+    void settings_received(QByteArray data);
+    void command_finished(int command, bool ok, qint64 elapsed_us);
+    void port_error(int error);
+    void replay_finished();
+    void live_settings_acked(qint64 elapsed_us);
+
+private slots:
+    bool open_port(QString port_name);
+    void close_port();
+    bool open_replay_port(QString path, double speed);
+    bool start_recorder(QString path);
+    void stop_recorder();
+    void replay_outbound(QByteArray data);
+    void clear_port();
+    void add_command(int command, QByteArray data);
+    void enable_motors();
+    void update_motors(int motor1, int motor2, int motor3, int motor4);
+    void update_motor_rate(int rate_hz);
+    void motor_tick();
+    void write_live_settings(QByteArray data);
+    void serialReadyRead();
+    void serialBytesWritten(qint64 bytes);
+    void serialPortError(QSerialPort::SerialPortError error);
+    void state_timeout();
+    void resend_live_deltas();
+
+private:
+    typedef struct
+    {
+        int command;
+        QByteArray data;
+    } queued_command;
+
+    typedef struct
+    {
+        int offset;
+        QByteArray data;        // the bytes the frame carries, not the current target
+        QByteArray frame;       // encoded, resent as it is
+        qint64 sent_ns;         // last time written
+        int sends;
+        int unacked;            // copies written without an ack so far
+        bool acked;
+    } live_delta;
+
+    void handle_input(int input);
+    void set_state(int state);
+    void start_next_command();
+    void finish_command(bool ok);
+    void resume_tab();
+    qint64 write_port(const char *data, qint64 length);
+    void record_input();
+    qint64 input_ns() const;
+    void read_lines();
+    void read_live_frames();
+    void read_rc_frames();
+    void read_motor_ack();
+    void write_motor_frame();
+    void send_live_deltas();
+    void live_delta_acked(const delta_ack &ack);
+    void read_settings();
+    void write_settings_chunk();
+    int encode_delta();
+
+    QSerialPort *serial;
+    SessionReplay *replay;
+    QIODevice *port;            // serial or replay
+    SessionRecorder recorder;
+    qint64 recorded_input;      // unread bytes of the port already recorded
+    QTimer *timeout_timer;
+    QTimer *motor_timer;        // paces the motor frames, not tied to the GUI timer
+    SerialEventRing ring;
+    FrameDecoder frame_decoder;     // live and rc frames
+    QByteArray settings_buffer;
+    qint64 pull_input_ns;       // last stale input, or the request, while waiting for the block
+    QByteArray device_settings; // block last pulled from or pushed to the device
+    bool delta_supported;       // cleared while the device answers the tab negotiation like old firmware
+    QByteArray live_settings;   // running settings, device_settings plus acked live changes
+    QByteArray live_target;     // last block streamed while live
+    QList<live_delta> live_unacked; // delta frames in flight while live, ranges don't repeat
+    QTimer *live_resend_timer;
+    QElapsedTimer tuning_clock;
+    uint8_t delta_buffer[16 * (frame_header_size + frame_max_payload + frame_crc_size)];
+    QElapsedTimer command_clock;
+    std::atomic<bool> port_open;
+    std::atomic<bool> replaying;
+
+    QQueue<queued_command> queue;
+    queued_command current;
+    bool command_active;
+    bool waiting_response;  // current command is finished by the device, not by being written
+    int push_offset;        // settings bytes handed to the port so far
+    int state;
+    int tab_command;        // resent after pull/push so the device streams again
+    bool motors_receipt;
+    bool motors_enabled;        // by start_motors() until the motor tab is left
+    uint16_t motor_values[4];
+    uint32_t motor_seq;
+    int motor_rate;             // asked for, capped by motor_rate_limit
+    int motor_rate_limit;       // from the device's motor_ack
+    qint64 motor_due_ns;        // next motor frame
+};
+
+#endif // SERIALWORKER_H
@@ -0,0 +1,314 @@
+#include "sessionlog.h"
+
+#include <string.h>
+
+namespace {
+
+const char session_magic[8] = { 'C', '1', '0', '1', 'S', 'L', 'O', 'G' };
+
+bool valid_header(const session_file_header &header)
+{
+    return memcmp(header.magic, session_magic, sizeof(session_magic)) == 0 && header.version == session_version;
+}
+
+}
+
+bool SessionRecorder::open(const QString &path)
+{
+    session_file_header header;
+    SessionLog log;
+    const session_record *record;
+    const char *data;
+    qint64 end;
+
+    close();
+
+    file.setFileName(path);
+
+    // a new session is appended to an existing log of the same format
+    if ( file.exists() && file.size() > 0 )
+    {
+        if ( !log.open(path) )
+        {
+            return false;
+        }
+
+        end = SessionLog::first_offset();
+        while ( log.record_at(end, &record, &data) )
+        {
+            end = SessionLog::next_offset(end, record);
+        }
+        log.close();
+
+        // a record cut off by a crash would swallow the new ones, it goes,
+        // and missing padding of the last complete record is filled in
+        if ( !file.resize(end) )
+        {
+            return false;
+        }
+
+        return file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Append) )
+    {
+        return false;
+    }
+
+    memcpy(header.magic, session_magic, sizeof(header.magic));
+    header.version = session_version;
+    header.reserved = 0;
+    file.write((const char *) &header, sizeof(header));
+
+    return true;
+}
+
+void SessionRecorder::close()
+{
+    if ( file.isOpen() )
+    {
+        file.close();
+    }
+}
+
+void SessionRecorder::record(int direction, qint64 time_ns, const char *data, qint64 length)
+{
+    static const char padding[8] = { 0 };
+    session_record record;
+
+    if ( !file.isOpen() || length <= 0 )
+    {
+        return;
+    }
+
+    record.time_ns = time_ns;
+    record.length = length;
+    record.direction = direction;
+
+    // QFile buffers, so this is a memcpy unless the buffer is full
+    file.write((const char *) &record, sizeof(record));
+    file.write(data, length);
+    file.write(padding, -length & 7);
+}
+
+bool SessionLog::open(const QString &path)
+{
+    close();
+
+    file.setFileName(path);
+    if ( !file.open(QIODevice::ReadOnly) )
+    {
+        return false;
+    }
+
+    size = file.size();
+    if ( size < (qint64) sizeof(session_file_header) )
+    {
+        close();
+        return false;
+    }
+
+    map = file.map(0, size);
+    if ( map == 0 || !valid_header(*(const session_file_header *) map) )
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SessionLog::close()
+{
+    if ( map != 0 )
+    {
+        file.unmap((uchar *) map);
+        map = 0;
+    }
+    size = 0;
+    file.close();
+}
+
+bool SessionLog::record_at(qint64 offset, const session_record **record, const char **data) const
+{
+    const session_record *r;
+
+    if ( map == 0 || offset + (qint64) sizeof(session_record) > size )
+    {
+        return false;
+    }
+
+    r = (const session_record *) (map + offset);
+    if ( offset + (qint64) sizeof(session_record) + r->length > size )
+    {
+        // cut off by a crash while recording
+        return false;
+    }
+
+    *record = r;
+    *data = (const char *) (map + offset + sizeof(session_record));
+    return true;
+}
+
+qint64 SessionLog::next_offset(qint64 offset, const session_record *record)
+{
+    return offset + sizeof(session_record) + ((record->length + 7) & ~7u);
+}
+
+SessionReplay::SessionReplay(QObject *parent) :
+    QIODevice(parent),
+    pending_offset(0),
+    offset(0),
+    first_ns(0),
+    last_ns(0),
+    speed(1)
+{
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, SIGNAL(timeout()), this, SLOT(tick()));
+}
+
+bool SessionReplay::start(const QString &path, double replay_speed)
+{
+    const session_record *record;
+    const char *data;
+
+    stop();
+
+    if ( !log.open(path) )
+    {
+        return false;
+    }
+
+    offset = SessionLog::first_offset();
+    first_ns = log.record_at(offset, &record, &data) ? record->time_ns : 0;
+    last_ns = first_ns;
+    speed = replay_speed;
+    pending.clear();
+    pending_offset = 0;
+
+    // unbuffered, the bytes are read straight out of pending
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    clock.start();
+    timer->start(0);
+
+    return true;
+}
+
+void SessionReplay::stop()
+{
+    timer->stop();
+    log.close();
+    pending.clear();
+    pending_offset = 0;
+
+    if ( isOpen() )
+    {
+        QIODevice::close();
+    }
+}
+
+qint64 SessionReplay::bytesAvailable() const
+{
+    return pending.size() - pending_offset + QIODevice::bytesAvailable();
+}
+
+bool SessionReplay::canReadLine() const
+{
+    return pending.indexOf('\n', pending_offset) >= 0 || QIODevice::canReadLine();
+}
+
+qint64 SessionReplay::readData(char *data, qint64 maxlen)
+{
+    qint64 count = qMin(maxlen, (qint64) (pending.size() - pending_offset));
+
+    memcpy(data, pending.constData() + pending_offset, count);
+    pending_offset += count;
+
+    return count;
+}
+
+qint64 SessionReplay::readLineData(char *data, qint64 maxlen)
+{
+    int end = pending.indexOf('\n', pending_offset);
+
+    if ( end >= 0 && end + 1 - pending_offset < maxlen )
+    {
+        maxlen = end + 1 - pending_offset;
+    }
+
+    return readData(data, maxlen);
+}
+
+qint64 SessionReplay::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+
+    // there is no device, report it written so the engine carries on
+    QMetaObject::invokeMethod(this, "bytesWritten", Qt::QueuedConnection, Q_ARG(qint64, len));
+    return len;
+}
+
+void SessionReplay::tick()
+{
+    const session_record *record;
+    const char *data;
+    qint64 due;
+    bool delivered = false;
+
+    if ( pending_offset == pending.size() )
+    {
+        pending.clear();
+        pending_offset = 0;
+    }
+
+    while ( log.record_at(offset, &record, &data) )
+    {
+        // the time went backwards (e.g. appended sessions), pace the rest
+        // from now on instead of delivering it all at once
+        if ( record->time_ns < last_ns )
+        {
+            first_ns = record->time_ns - (qint64) (clock.nsecsElapsed() * speed);
+        }
+
+        if ( speed > 0 )
+        {
+            due = (record->time_ns - first_ns) / speed;
+            if ( due > clock.nsecsElapsed() )
+            {
+                timer->start((due - clock.nsecsElapsed()) / 1000000);
+                break;
+            }
+        }
+        else if ( delivered )
+        {
+            // as fast as possible, but one inbound record per readyRead() like the port does
+            timer->start(0);
+            break;
+        }
+
+        offset = SessionLog::next_offset(offset, record);
+        last_ns = record->time_ns;
+
+        if ( record->direction == session_in )
+        {
+            pending.append(data, record->length);
+            delivered = true;
+        }
+        else
+        {
+            emit outbound(QByteArray(data, record->length));
+        }
+    }
+
+    if ( delivered )
+    {
+        emit readyRead();
+    }
+
+    if ( !timer->isActive() && isOpen() )
+    {
+        emit finished();
+    }
+}
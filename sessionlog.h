@@ -0,0 +1,122 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include <QIODevice>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <stdint.h>
+
+// Raw serial session files
+//
+//   file header   "C101SLOG" version(u32) reserved(u32)
+//   records       time_ns(i64) length(u32) direction(u32) data, padded to 8 bytes
+//
+// Everything is little endian and 8 byte aligned, so a mapped file can be
+// walked in place. Records are only ever appended, sessions can be appended
+// to an existing file. A truncated last record (crash) is ignored, and cut
+// off before the next session is appended.
+
+enum { session_in, session_out }; // record direction, seen from the host
+
+enum { session_version = 1 };
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} session_file_header;
+
+typedef struct
+{
+    int64_t time_ns;    // monotonic_ns() when read from or written to the port
+    uint32_t length;
+    uint32_t direction;
+} session_record;
+
+static_assert(sizeof(session_file_header) == 16, "session file header layout");
+static_assert(sizeof(session_record) == 16, "session record layout");
+
+// Appends the bytes going over the port to a session file.
+class SessionRecorder
+{
+public:
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    void record(int direction, qint64 time_ns, const char *data, qint64 length);
+
+private:
+    QFile file;
+};
+
+// Read-only walk over a mapped session file.
+class SessionLog
+{
+public:
+    SessionLog() : map(0), size(0) {}
+
+    bool open(const QString &path);
+    void close();
+
+    // record at offset, false at the end or on a truncated record
+    bool record_at(qint64 offset, const session_record **record, const char **data) const;
+    static qint64 next_offset(qint64 offset, const session_record *record);
+    static qint64 first_offset() { return sizeof(session_file_header); }
+
+private:
+    QFile file;
+    const uchar *map;
+    qint64 size;
+};
+
+// Plays a session file back as if it were the serial port.
+//
+// Inbound records become readable with their recorded spacing divided by
+// speed (0 = as fast as the reader takes them). Outbound records are handed
+// out through outbound() so the protocol engine can repeat the host side,
+// anything written to the device is dropped.
+class SessionReplay : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit SessionReplay(QObject *parent = 0);
+
+    bool start(const QString &path, double speed);
+    void stop();
+
+    // recorded time of the last record handed out
+    qint64 time_ns() const { return last_ns; }
+
+    bool isSequential() const { return true; }
+    qint64 bytesAvailable() const;
+    bool canReadLine() const;
+
+signals:
+    void outbound(QByteArray data);
+    void finished();
+
+protected:
+    qint64 readData(char *data, qint64 maxlen);
+    qint64 readLineData(char *data, qint64 maxlen);
+    qint64 writeData(const char *data, qint64 len);
+
+private slots:
+    void tick();
+
+private:
+    SessionLog log;
+    QTimer *timer;
+    QElapsedTimer clock;
+    QByteArray pending;     // delivered, not read yet
+    int pending_offset;
+    qint64 offset;          // next record
+    qint64 first_ns;
+    qint64 last_ns;         // time of the last record handed out
+    double speed;
+};
+
+#endif // SESSIONLOG_H
@@ -0,0 +1,127 @@
+#include "settings.h"
+
+#include <sstream>
+#include <stdio.h>
+
+const settings_layout *settings_find_layout(const char *block, int size)
+{
+    unsigned i;
+
+    if ( size < (int) sizeof(settings) )
+    {
+        return 0;
+    }
+
+    for ( i = 0; i < settings_layout_count; i++ )
+    {
+        if ( (uint8_t) block[0] == settings_layouts[i].magic )
+        {
+            return &settings_layouts[i];
+        }
+    }
+    return 0;
+}
+
+const settings_field *settings_find_field(const settings_layout &layout, const char *name)
+{
+    unsigned i;
+
+    for ( i = 0; i < layout.count; i++ )
+    {
+        if ( strcmp(layout.fields[i].name, name) == 0 )
+        {
+            return &layout.fields[i];
+        }
+    }
+    return 0;
+}
+
+std::string settings_to_text(const char *block, const settings_layout &layout)
+{
+    std::string text;
+    char value[32];
+    unsigned i;
+    int j;
+
+    snprintf(value, sizeof(value), "# settings version %d\n", layout.version);
+    text = value;
+
+    for ( i = 0; i < layout.count; i++ )
+    {
+        text += layout.fields[i].name;
+        text += " =";
+        for ( j = 0; j < layout.fields[i].count; j++ )
+        {
+            // %.9g round trips a float
+            snprintf(value, sizeof(value), " %.9g", settings_get(block, layout.fields[i], j));
+            text += value;
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+bool settings_from_text(char *block, const settings_layout &layout, const std::string &text)
+{
+    std::istringstream lines(text);
+    std::string line;
+    std::string name;
+    std::string equals;
+    const settings_field *field;
+    double value;
+    int j;
+
+    while ( std::getline(lines, line) )
+    {
+        std::istringstream words(line);
+
+        if ( !(words >> name) || name[0] == '#' )
+        {
+            continue;
+        }
+
+        if ( !(words >> equals) || equals != "=" )
+        {
+            return false;
+        }
+
+        // fields of other versions are skipped
+        field = settings_find_field(layout, name.c_str());
+        if ( field == 0 )
+        {
+            continue;
+        }
+
+        for ( j = 0; j < field->count; j++ )
+        {
+            if ( !(words >> value) )
+            {
+                return false;
+            }
+            settings_set(block, *field, j, value);
+        }
+    }
+    return true;
+}
+
+void settings_migrate(const char *from, const settings_layout &from_layout, char *to, const settings_layout &to_layout)
+{
+    const settings_field *target;
+    unsigned i;
+    int j;
+
+    for ( i = 0; i < from_layout.count; i++ )
+    {
+        target = settings_find_field(to_layout, from_layout.fields[i].name);
+        if ( target == 0 || strcmp(target->name, "magic") == 0 )
+        {
+            continue;
+        }
+
+        for ( j = 0; j < from_layout.fields[i].count && j < target->count; j++ )
+        {
+            settings_set(to, *target, j, settings_get(from, from_layout.fields[i], j));
+        }
+    }
+    to[0] = to_layout.magic;
+}
@@ -0,0 +1,251 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <float.h>
+#include <string.h>
+#include <string>
+
+// Settings block as stored by the firmware, shared with the simulator
+
+typedef struct
+{
+    int8_t  rotational_direction;
+    uint8_t tim_ch;
+} motor;
+
+typedef struct
+{
+    uint8_t number;
+    uint8_t rev;
+} rc_channel;
+
+typedef int8_t matrix[3][3];
+
+typedef struct {
+    uint8_t magic;
+    uint8_t pad1[7];    // 1 + 7 = 8
+    float pidvars[9];
+    uint8_t pad2[4];	// 9 * 4 + 4 = 40
+    float l_pidvars[9];
+    uint8_t pad3[4];    // 9 * 4 + 4 = 40
+    float rate[3];      // 3 * 4 + 4 = 16
+    uint8_t pad4[4];
+    motor motor_1;
+    motor motor_2;
+    motor motor_3;
+    motor motor_4;      // 4 * 2 = 8
+    matrix sensor_orient;
+    uint8_t pad5[7];    // 3 * 3 + 7 = 16
+    float aspect_ratio;
+    uint8_t pad6[4];    // 4 + 4 = 8
+    rc_channel rc_func[13];
+    uint8_t pad7[6];    // 2 * 13 + 6 = 32
+    rc_channel rc_ch[13];
+    int8_t pad8[6];     // 2 * 13 + 6 = 32
+    uint8_t receiver;
+    int8_t pad9[7];     // 1 + 7 = 8
+    float low_voltage;
+    int8_t pad10[4];    // 4 + 4 = 8
+    int32_t acc_offset[3];
+    int8_t pad11[4];    // 3 * 4 + 4 = 16
+    uint8_t esc_mode;
+    int8_t pad12[7];    // 1 + 7 = 8
+
+} settings;
+
+// Layout of the firmware, the offsets are what it reads from flash
+static_assert(offsetof(settings, pidvars) == 8, "settings layout");
+static_assert(offsetof(settings, l_pidvars) == 48, "settings layout");
+static_assert(offsetof(settings, rate) == 88, "settings layout");
+static_assert(offsetof(settings, motor_1) == 104, "settings layout");
+static_assert(offsetof(settings, sensor_orient) == 112, "settings layout");
+static_assert(offsetof(settings, aspect_ratio) == 128, "settings layout");
+static_assert(offsetof(settings, rc_func) == 136, "settings layout");
+static_assert(offsetof(settings, rc_ch) == 168, "settings layout");
+static_assert(offsetof(settings, receiver) == 200, "settings layout");
+static_assert(offsetof(settings, low_voltage) == 208, "settings layout");
+static_assert(offsetof(settings, acc_offset) == 216, "settings layout");
+static_assert(offsetof(settings, esc_mode) == 232, "settings layout");
+static_assert(sizeof(settings) == 240, "settings layout");
+
+enum { settings_block_size = 1024 };    // pulled and pushed as a whole
+static_assert(sizeof(settings) <= settings_block_size, "settings block size");
+enum { field_u8, field_i8, field_i32, field_f32 }; // settings_field type
+
+// One value or array of the settings block, described by its place in the
+// raw buffer. Array elements are stride bytes apart, so struct arrays like
+// rc_func are one field per member.
+typedef struct
+{
+    const char *name;   // text export key
+    uint16_t offset;
+    uint8_t type;
+    uint8_t count;
+    uint8_t stride;
+} settings_field;
+
+constexpr unsigned settings_type_size(int type)
+{
+    return type == field_u8 || type == field_i8 ? 1 : 4;
+}
+
+constexpr bool settings_field_fits(const settings_field &field, unsigned size)
+{
+    return field.count > 0 && field.offset + (field.count - 1) * field.stride + settings_type_size(field.type) <= size;
+}
+
+#define SETTINGS_FIELD(name, member, type, count, stride) { name, offsetof(settings, member), type, count, stride }
+
+// Version 1, the firmware marks it with magic 0xdb
+constexpr settings_field settings_fields_v1[] = {
+    SETTINGS_FIELD("magic", magic, field_u8, 1, 1),
+    SETTINGS_FIELD("pidvars", pidvars, field_f32, 9, 4),
+    SETTINGS_FIELD("l_pidvars", l_pidvars, field_f32, 9, 4),
+    SETTINGS_FIELD("rate", rate, field_f32, 3, 4),
+    SETTINGS_FIELD("motor.rotational_direction", motor_1.rotational_direction, field_i8, 4, sizeof(motor)),
+    SETTINGS_FIELD("motor.tim_ch", motor_1.tim_ch, field_u8, 4, sizeof(motor)),
+    SETTINGS_FIELD("sensor_orient", sensor_orient, field_i8, 9, 1),
+    SETTINGS_FIELD("aspect_ratio", aspect_ratio, field_f32, 1, 4),
+    SETTINGS_FIELD("rc_func.number", rc_func[0].number, field_u8, 13, sizeof(rc_channel)),
+    SETTINGS_FIELD("rc_func.rev", rc_func[0].rev, field_u8, 13, sizeof(rc_channel)),
+    SETTINGS_FIELD("rc_ch.number", rc_ch[0].number, field_u8, 13, sizeof(rc_channel)),
+    SETTINGS_FIELD("rc_ch.rev", rc_ch[0].rev, field_u8, 13, sizeof(rc_channel)),
+    SETTINGS_FIELD("receiver", receiver, field_u8, 1, 1),
+    SETTINGS_FIELD("low_voltage", low_voltage, field_f32, 1, 4),
+    SETTINGS_FIELD("acc_offset", acc_offset, field_i32, 3, 4),
+    SETTINGS_FIELD("esc_mode", esc_mode, field_u8, 1, 1)
+};
+
+constexpr bool settings_fields_fit(const settings_field *fields, unsigned count, unsigned size)
+{
+    return count == 0 || (settings_field_fits(fields[0], size) && settings_fields_fit(fields + 1, count - 1, size));
+}
+
+static_assert(settings_fields_fit(settings_fields_v1, sizeof(settings_fields_v1) / sizeof(settings_fields_v1[0]), sizeof(settings)),
+              "settings field outside the block");
+
+typedef struct
+{
+    int version;
+    uint8_t magic;      // first byte of the block
+    const settings_field *fields;
+    unsigned count;
+} settings_layout;
+
+// every layout a firmware has used, the last one is what this program writes
+constexpr settings_layout settings_layouts[] = {
+    { 1, 0xdb, settings_fields_v1, sizeof(settings_fields_v1) / sizeof(settings_fields_v1[0]) }
+};
+
+constexpr unsigned settings_layout_count = sizeof(settings_layouts) / sizeof(settings_layouts[0]);
+static constexpr const settings_layout &settings_current = settings_layouts[settings_layout_count - 1];
+
+constexpr bool settings_names_equal(const char *a, const char *b)
+{
+    return *a == *b && (*a == 0 || settings_names_equal(a + 1, b + 1));
+}
+
+// settings_find_field() at compile time, the index into layout.fields or -1
+constexpr int settings_field_index(const settings_layout &layout, const char *name, unsigned i = 0)
+{
+    return i == layout.count ? -1 : settings_names_equal(layout.fields[i].name, name) ? (int) i : settings_field_index(layout, name, i + 1);
+}
+
+// Element i of a field, read and written in place. memcpy keeps the
+// unaligned and type punned access defined, it compiles to a plain load.
+inline double settings_get(const char *block, const settings_field &field, int i)
+{
+    const char *p = block + field.offset + i * field.stride;
+    uint8_t u8;
+    int8_t i8;
+    int32_t i32;
+    float f32;
+
+    switch ( field.type )
+    {
+    case field_u8:
+        memcpy(&u8, p, 1);
+        return u8;
+    case field_i8:
+        memcpy(&i8, p, 1);
+        return i8;
+    case field_i32:
+        memcpy(&i32, p, 4);
+        return i32;
+    default:
+        memcpy(&f32, p, 4);
+        return f32;
+    }
+}
+
+// NaN becomes 0, the integer conversions are only defined inside the range
+inline double settings_clamp(double value, double low, double high)
+{
+    return value != value ? 0 : value < low ? low : value > high ? high : value;
+}
+
+// value is converted for the field's type only, clamped to its range
+inline void settings_set(char *block, const settings_field &field, int i, double value)
+{
+    char *p = block + field.offset + i * field.stride;
+    uint8_t u8;
+    int8_t i8;
+    int32_t i32;
+    float f32;
+
+    switch ( field.type )
+    {
+    case field_u8:
+        u8 = settings_clamp(value, 0, UINT8_MAX);
+        memcpy(p, &u8, 1);
+        break;
+    case field_i8:
+        i8 = settings_clamp(value, INT8_MIN, INT8_MAX);
+        memcpy(p, &i8, 1);
+        break;
+    case field_i32:
+        i32 = settings_clamp(value, INT32_MIN, INT32_MAX);
+        memcpy(p, &i32, 4);
+        break;
+    default:
+        f32 = value != value ? value : settings_clamp(value, -FLT_MAX, FLT_MAX);
+        memcpy(p, &f32, 4);
+        break;
+    }
+}
+
+// layout of a block by its magic, 0 if it is no settings block
+const settings_layout *settings_find_layout(const char *block, int size);
+const settings_field *settings_find_field(const settings_layout &layout, const char *name);
+
+// "name = v1 v2 ..." per field, in schema order
+std::string settings_to_text(const char *block, const settings_layout &layout);
+// fields missing from the text are left as they are, false on a syntax error
+bool settings_from_text(char *block, const settings_layout &layout, const std::string &text);
+
+// copies every field both layouts have by name, the rest of to is untouched
+void settings_migrate(const char *from, const settings_layout &from_layout, char *to, const settings_layout &to_layout);
+
+enum { RKp, RKi, RKd, NKp, NKi, NKd, GKp, GKi, GKd }; // pidvars index
+enum { th, ro, ni, gi }; // motor index
+enum { roll, nick, gier }; // rate axis index
+enum { SBUS, SRXL };
+enum { CW = 1, CCW = -1 };
+enum { STD, ONES }; // ESC type index
+enum { r_thrust = 1,
+       r_roll = 2,
+       r_nick = 3,
+       r_gier = 4,
+       r_arm = 5,
+       r_mode = 6,
+       r_beep = 7,
+       r_prog = 8,
+       r_var = 9,
+       r_aux1 = 10,
+       r_aux2 = 11,
+       r_aux3 = 12
+     };
+
+#endif // SETTINGS_H
@@ -0,0 +1,837 @@
+// Flight controller simulator
+//
+// Emulates the firmware side of the configurator protocol on a pseudo
+// terminal, so every protocol path can be exercised without a board:
+// tab commands, rc lines with channels_receipt, streamed rc frames, motor records with
+// motors_receipt, streamed motor frames, ASCII live lines with live_receipt, binary live frames,
+// pull_settings and push_settings with the 1024 byte settings block,
+// push_delta with settings delta frames, delta frames while live.
+//
+// usage: fcsim [options]
+//   --live-rate HZ     live samples per second (default 500)
+//   --rc-rate HZ       rc lines per second, rc frames until subscribed (default 50)
+//   --link BYTES       output limit in bytes per second, 0 = none (default 0)
+//   --pull-delay MS    pause before the settings are sent (default 400)
+//   --ascii            behave like old firmware, ignore live_bin_tab, rc_bin_tab, motors_bin_tab and push_delta
+//   --symlink PATH     also make the terminal available as PATH
+//   --verbose          log every command
+//
+// Start the configurator with CONFIGURATOR101_PORT set to the printed
+// device name, the pseudo terminal isn't found by the port enumeration.
+// Several simulators can be given comma separated for the device dashboard.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "protocol.h"
+#include "settings.h"
+
+namespace {
+
+enum { settings_size = 1024, settings_magic = 0xdb };
+
+enum { // what the firmware is doing
+    mode_idle,
+    mode_channels,
+    mode_channels_binary,
+    mode_motors,
+    mode_motors_binary,
+    mode_live_ascii,
+    mode_live_binary,
+    mode_push_read,
+    mode_delta_read
+};
+
+// bytes that may wait in the output before stream samples are dropped,
+// like the firmware does when the USB IN endpoint is busy
+const size_t output_limit = 4096;
+
+// motor frames per second the simulated firmware takes, reported in the motor_ack
+const int motor_rate_limit = 400;
+
+// the simulated rates follow the sticks this late, s, and reach this at
+// full stick, rad/s (about 200 deg/s), so there is a step response to show
+const double live_stick_lag = 0.02;
+const double live_stick_rate = 3.5;
+
+typedef struct
+{
+    double live_rate;
+    double rc_rate;
+    double link_rate;
+    int pull_delay_ms;
+    bool ascii_only;
+    const char *symlink_path;
+    bool verbose;
+} options;
+
+typedef struct
+{
+    int mode;
+    bool live_receipt;
+    bool channels_receipt;
+    uint8_t settings[settings_size];
+    uint8_t push_buffer[settings_size];
+    int push_received;
+    FrameDecoder delta_decoder;
+    double pull_due;        // 0 = no pull pending
+    double next_live;
+    double next_rc;
+    double rc_stream_rate;  // of the rc frames, from the subscribe frame
+    uint32_t rc_seq;
+    std::string input;
+    std::string output;
+    double link_credit;     // bytes that may be sent now
+    double link_time;
+    unsigned long live_sent;
+    unsigned long live_dropped;
+    unsigned long rc_sent;
+    uint32_t motor_seq;     // of the last motor frame
+    unsigned long motor_frames;
+    unsigned long motor_lost;
+} simulator;
+
+volatile sig_atomic_t quit = 0;
+
+void on_signal(int sig)
+{
+    (void) sig;
+    quit = 1;
+}
+
+double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void load_defaults(simulator *sim)
+{
+    settings *ps = (settings *) sim->settings;
+    int i;
+
+    memset(sim->settings, 0, sizeof(sim->settings));
+
+    ps->magic = settings_magic;
+    for ( i = 0; i < 9; i++ )
+    {
+        ps->pidvars[i] = i % 3 == 0 ? 1.2f : i % 3 == 1 ? 0.05f : 0.3f;
+        ps->l_pidvars[i] = i % 3 == 0 ? 4.0f : 0.0f;
+    }
+    ps->rate[roll] = 200;
+    ps->rate[nick] = 200;
+    ps->rate[gier] = 150;
+    ps->motor_1.rotational_direction = CW;
+    ps->motor_1.tim_ch = 1;
+    ps->motor_2.rotational_direction = CW;
+    ps->motor_2.tim_ch = 2;
+    ps->motor_3.rotational_direction = CW;
+    ps->motor_3.tim_ch = 3;
+    ps->motor_4.rotational_direction = CW;
+    ps->motor_4.tim_ch = 4;
+    for ( i = 0; i < 3; i++ )
+    {
+        ps->sensor_orient[i][i] = 1;
+    }
+    ps->aspect_ratio = 1.0f;
+    for ( i = 0; i < 13; i++ )
+    {
+        ps->rc_func[i].number = i;
+        ps->rc_ch[i].number = i;
+    }
+    ps->receiver = SBUS;
+    ps->low_voltage = 10.5f;
+    ps->esc_mode = STD;
+}
+
+void send(simulator *sim, const char *data, size_t length)
+{
+    sim->output.append(data, length);
+}
+
+void send_text(simulator *sim, const char *text)
+{
+    send(sim, text, strlen(text));
+}
+
+void rc_values(double t, int *v)
+{
+    int i;
+
+    // sticks sweep around the centre, switches toggle every few seconds
+    for ( i = 0; i < 12; i++ )
+    {
+        if ( i < 4 )
+        {
+            v[i] = 2048 + (int) (1500 * sin(t * (0.5 + 0.25 * i)));
+        }
+        else
+        {
+            v[i] = ((int) (t / (2 + i)) & 1) ? 3500 : 600;
+        }
+    }
+}
+
+void send_live_frame(simulator *sim, double t)
+{
+    live_frame frame;
+    uint8_t out[frame_header_size + sizeof(live_frame) + frame_crc_size];
+    int sticks[12];
+    int late[12];
+    int i, size;
+
+    rc_values(t, sticks);
+    rc_values(t - live_stick_lag, late);
+
+    // slow attitude changes, the rates follow the sticks (channels by
+    // function, roll nick gier from 2) a bit late, vibration on top
+    for ( i = 0; i < 3; i++ )
+    {
+        frame.angle[i] = 0.5 * sin(t * (0.3 + 0.2 * i));
+        frame.gyro[i] = (late[i + 1] - 2048) / 2048.0 * live_stick_rate + 0.05 * sin(t * 2 * M_PI * 80);
+        frame.acc[i] = (i == 2 ? 1.0 : 0.0) + 0.1 * sin(t * 2 * M_PI * (40 + 15 * i));
+        frame.sticks[i] = sticks[i + 1];
+    }
+    frame.reserved = 0;
+
+    size = frame_encode(frame_live, &frame, sizeof(frame), out);
+    send(sim, (const char *) out, size);
+}
+
+void send_live_line(simulator *sim, double t)
+{
+    char line[128];
+    double v[9];
+    int i;
+
+    for ( i = 0; i < 3; i++ )
+    {
+        v[i] = (i == 2 ? 1.0 : 0.0) + 0.1 * sin(t * 2 * M_PI * (40 + 15 * i));
+        v[i + 3] = 0.5 * (0.3 + 0.2 * i) * cos(t * (0.3 + 0.2 * i));
+        v[i + 6] = 0.5 * sin(t * (0.3 + 0.2 * i));
+    }
+
+    snprintf(line, sizeof(line), "%.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f\n",
+             v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+    send_text(sim, line);
+}
+
+void send_rc_line(simulator *sim, double t)
+{
+    char line[96];
+    int v[12];
+
+    rc_values(t, v);
+    snprintf(line, sizeof(line), "%d %d %d %d %d %d %d %d %d %d %d %d\n",
+             v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11]);
+    send_text(sim, line);
+}
+
+void send_rc_frame(simulator *sim, double t)
+{
+    rc_frame frame;
+    uint8_t out[frame_header_size + sizeof(rc_frame) + frame_crc_size];
+    int v[12];
+    int i;
+
+    rc_values(t, v);
+    frame.seq = sim->rc_seq;
+    for ( i = 0; i < 12; i++ )
+    {
+        frame.channels[i] = v[i];
+    }
+
+    send(sim, (const char *) out, frame_encode(frame_rc, &frame, sizeof(frame), out));
+}
+
+void set_mode(simulator *sim, int mode, double t)
+{
+    sim->mode = mode;
+    sim->live_receipt = true;
+    sim->channels_receipt = true;
+    sim->next_live = t;
+    sim->next_rc = t;
+}
+
+void handle_command(simulator *sim, const options *opt, const std::string &command, double t)
+{
+    if ( opt->verbose )
+    {
+        fprintf(stderr, "< %s\n", command.c_str());
+    }
+
+    if ( command == "fw_tab" || command == "flight_tab" || command == "suspend" )
+    {
+        set_mode(sim, mode_idle, t);
+    }
+    else if ( command == "config_tab" )
+    {
+        set_mode(sim, mode_channels, t);
+    }
+    else if ( command == "rc_bin_tab" )
+    {
+        if ( !opt->ascii_only )
+        {
+            // streams at --rc-rate until the subscribe frame is in
+            set_mode(sim, mode_channels_binary, t);
+            sim->rc_stream_rate = opt->rc_rate;
+            sim->rc_seq = 0;
+        }
+    }
+    else if ( command == "motors_tab" )
+    {
+        set_mode(sim, mode_motors, t);
+    }
+    else if ( command == "motors_bin_tab" )
+    {
+        if ( !opt->ascii_only )
+        {
+            uint8_t out[frame_header_size + sizeof(motor_ack) + frame_crc_size];
+            motor_ack ack = { (uint16_t) motor_rate_limit, 0 };
+
+            set_mode(sim, mode_motors_binary, t);
+            sim->motor_seq = 0;
+            send(sim, (const char *) out, frame_encode(frame_motor_ack, &ack, sizeof(ack), out));
+        }
+    }
+    else if ( command == "live_bin_tab" )
+    {
+        if ( !opt->ascii_only )
+        {
+            set_mode(sim, mode_live_binary, t);
+        }
+    }
+    else if ( command == "live_tab" )
+    {
+        set_mode(sim, mode_live_ascii, t);
+    }
+    else if ( command == "channels_receipt" )
+    {
+        sim->channels_receipt = true;
+    }
+    else if ( command == "live_receipt" )
+    {
+        sim->live_receipt = true;
+    }
+    else if ( command == "pull_settings" )
+    {
+        // the firmware stops streaming and takes a while to answer
+        set_mode(sim, mode_idle, t);
+        sim->pull_due = t + opt->pull_delay_ms / 1000.0;
+    }
+    else if ( command == "push_settings" )
+    {
+        set_mode(sim, mode_push_read, t);
+        sim->push_received = 0;
+        send_text(sim, "ok_push\n");
+    }
+    else if ( command == "push_delta" && !opt->ascii_only )
+    {
+        // the firmware keeps the stream paused until the last frame is in
+        set_mode(sim, mode_delta_read, t);
+        sim->delta_decoder.reset();
+    }
+    else if ( command == "load_defaults" )
+    {
+        load_defaults(sim);
+    }
+    else if ( command == "cal_acc" )
+    {
+    }
+    else if ( command == "reboot" || command == "bootloader" )
+    {
+        set_mode(sim, mode_idle, t);
+        sim->output.clear();
+        fprintf(stderr, "%s requested\n", command.c_str());
+    }
+    else if ( sim->mode == mode_motors && command.find(',') != std::string::npos )
+    {
+        // motor record, the values aren't used
+        send_text(sim, "motors_receipt\n");
+    }
+    else
+    {
+        fprintf(stderr, "unknown command \"%s\"\n", command.c_str());
+    }
+}
+
+// returns the bytes taken, the rest is left for the command parser
+size_t read_delta(simulator *sim, const char *data, size_t length, double t)
+{
+    const uint8_t *payload;
+    int size;
+    int type;
+    delta_frame frame;
+    size_t count = length;
+
+    if ( count > (size_t) sim->delta_decoder.free_space() )
+    {
+        count = sim->delta_decoder.free_space();
+    }
+    memcpy(sim->delta_decoder.write_ptr(), data, count);
+    sim->delta_decoder.commit(count);
+
+    while ( (type = sim->delta_decoder.next_frame(&payload, &size)) != 0 )
+    {
+        if ( type != frame_settings_delta || size < delta_header_size )
+        {
+            continue;
+        }
+
+        memset(&frame, 0, sizeof(frame));
+        memcpy(&frame, payload, size);
+        if ( frame.length == size - delta_header_size && frame.offset + frame.length <= settings_size && frame.offset > 0 )
+        {
+            memcpy(sim->settings + frame.offset, frame.data, frame.length);
+        }
+
+        if ( frame.last )
+        {
+            set_mode(sim, mode_idle, t);
+            send_text(sim, "delta_rcvd\n");
+            break;
+        }
+    }
+
+    return count;
+}
+
+// one frame between the commands of a binary mode, 0 while it is incomplete
+size_t read_frame(simulator *sim, const char *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    uint8_t out[frame_header_size + sizeof(delta_ack) + frame_crc_size];
+    delta_frame frame;
+    delta_ack ack;
+    rc_subscribe subscribe;
+    motor_frame motor;
+    size_t size;
+    int payload;
+
+    if ( length < frame_header_size )
+    {
+        return 0;
+    }
+
+    payload = bytes[3];
+    size = frame_header_size + payload + frame_crc_size;
+    if ( length < size )
+    {
+        return 0;
+    }
+
+    if ( bytes[1] != frame_sync2 || payload > (int) sizeof(frame) ||
+         crc16_ccitt(bytes + 2, payload + 2) != (bytes[size - 2] | bytes[size - 1] << 8) )
+    {
+        return 1;   // resync on the next byte
+    }
+
+    if ( bytes[2] == frame_rc_subscribe && sim->mode == mode_channels_binary && payload == sizeof(subscribe) )
+    {
+        memcpy(&subscribe, bytes + frame_header_size, sizeof(subscribe));
+        if ( subscribe.rate_hz > 0 )
+        {
+            sim->rc_stream_rate = subscribe.rate_hz;
+        }
+        return size;
+    }
+
+    if ( bytes[2] == frame_motor && sim->mode == mode_motors_binary && payload == sizeof(motor) )
+    {
+        // the values aren't used, only what arrived is counted
+        memcpy(&motor, bytes + frame_header_size, sizeof(motor));
+        if ( motor.seq > sim->motor_seq + 1 )
+        {
+            sim->motor_lost += motor.seq - sim->motor_seq - 1;
+        }
+        sim->motor_seq = motor.seq;
+        sim->motor_frames++;
+        return size;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    memcpy(&frame, bytes + frame_header_size, payload);
+    if ( bytes[2] == frame_settings_delta && sim->mode == mode_live_binary && frame.length == payload - delta_header_size &&
+         frame.offset > 0 && frame.offset + frame.length <= settings_size )
+    {
+        // the simulator doesn't tell running from saved settings
+        memcpy(sim->settings + frame.offset, frame.data, frame.length);
+
+        ack.offset = frame.offset;
+        ack.length = frame.length;
+        ack.reserved = 0;
+        send(sim, (const char *) out, frame_encode(frame_delta_ack, &ack, sizeof(ack), out));
+    }
+
+    return size;
+}
+
+void handle_input(simulator *sim, const options *opt, double t)
+{
+    size_t start = 0;
+    size_t end;
+    int count;
+
+    while ( start < sim->input.size() )
+    {
+        if ( sim->mode == mode_push_read )
+        {
+            // raw settings block, no terminator
+            count = settings_size - sim->push_received;
+            if ( count > (int) (sim->input.size() - start) )
+            {
+                count = sim->input.size() - start;
+            }
+            memcpy(sim->push_buffer + sim->push_received, sim->input.data() + start, count);
+            sim->push_received += count;
+            start += count;
+
+            if ( sim->push_received == settings_size )
+            {
+                if ( sim->push_buffer[0] == settings_magic )
+                {
+                    memcpy(sim->settings, sim->push_buffer, settings_size);
+                }
+                set_mode(sim, mode_idle, t);
+                send_text(sim, "settings_rcvd\n");
+            }
+            continue;
+        }
+
+        if ( sim->mode == mode_delta_read )
+        {
+            start += read_delta(sim, sim->input.data() + start, sim->input.size() - start, t);
+            continue;
+        }
+
+        // frames between the commands while streaming, a command never starts with the sync byte
+        if ( (sim->mode == mode_live_binary || sim->mode == mode_channels_binary || sim->mode == mode_motors_binary) &&
+             (uint8_t) sim->input[start] == frame_sync1 )
+        {
+            count = read_frame(sim, sim->input.data() + start, sim->input.size() - start);
+            if ( count == 0 )
+            {
+                break;
+            }
+            start += count;
+            continue;
+        }
+
+        // every command and the motor records end with a NUL
+        end = sim->input.find('\0', start);
+        if ( end == std::string::npos )
+        {
+            break;
+        }
+
+        if ( end > start )
+        {
+            handle_command(sim, opt, sim->input.substr(start, end - start), t);
+        }
+        start = end + 1;
+    }
+
+    sim->input.erase(0, start);
+}
+
+void produce(simulator *sim, const options *opt, double t)
+{
+    if ( sim->pull_due > 0 && t >= sim->pull_due )
+    {
+        send(sim, (const char *) sim->settings, settings_size);
+        sim->pull_due = 0;
+    }
+
+    switch ( sim->mode )
+    {
+    case mode_live_binary:
+        while ( t >= sim->next_live )
+        {
+            if ( sim->output.size() < output_limit )
+            {
+                send_live_frame(sim, sim->next_live);
+                sim->live_sent++;
+            }
+            else
+            {
+                sim->live_dropped++;
+            }
+            sim->next_live += 1 / opt->live_rate;
+        }
+        break;
+
+    case mode_live_ascii:
+        if ( sim->live_receipt && t >= sim->next_live )
+        {
+            send_live_line(sim, t);
+            sim->live_sent++;
+            sim->live_receipt = false;
+            sim->next_live = fmax(sim->next_live + 1 / opt->live_rate, t);
+        }
+        break;
+
+    case mode_channels_binary:
+        // a full output drops the frame, its seq is used up all the same
+        while ( t >= sim->next_rc )
+        {
+            if ( sim->output.size() < output_limit )
+            {
+                send_rc_frame(sim, sim->next_rc);
+                sim->rc_sent++;
+            }
+            sim->rc_seq++;
+            sim->next_rc += 1 / sim->rc_stream_rate;
+        }
+        break;
+
+    case mode_channels:
+        if ( sim->channels_receipt && t >= sim->next_rc )
+        {
+            send_rc_line(sim, t);
+            sim->rc_sent++;
+            sim->channels_receipt = false;
+            sim->next_rc = fmax(sim->next_rc + 1 / opt->rc_rate, t);
+        }
+        break;
+    }
+}
+
+void flush_output(simulator *sim, const options *opt, int fd, double t)
+{
+    size_t length = sim->output.size();
+    ssize_t count;
+
+    if ( opt->link_rate > 0 )
+    {
+        // token bucket, at most 10 ms worth of burst
+        sim->link_credit += (t - sim->link_time) * opt->link_rate;
+        if ( sim->link_credit > opt->link_rate / 100 )
+        {
+            sim->link_credit = opt->link_rate / 100;
+        }
+        if ( length > sim->link_credit )
+        {
+            length = sim->link_credit;
+        }
+    }
+    sim->link_time = t;
+
+    if ( length == 0 )
+    {
+        return;
+    }
+
+    count = write(fd, sim->output.data(), length);
+    if ( count > 0 )
+    {
+        sim->output.erase(0, count);
+        sim->link_credit -= count;
+    }
+}
+
+double next_event(const simulator *sim, const options *opt)
+{
+    double next = now() + 0.1;
+
+    if ( sim->pull_due > 0 && sim->pull_due < next )
+    {
+        next = sim->pull_due;
+    }
+    if ( ( sim->mode == mode_live_binary || ( sim->mode == mode_live_ascii && sim->live_receipt ) ) && sim->next_live < next )
+    {
+        next = sim->next_live;
+    }
+    if ( ( sim->mode == mode_channels_binary || ( sim->mode == mode_channels && sim->channels_receipt ) ) && sim->next_rc < next )
+    {
+        next = sim->next_rc;
+    }
+    if ( !sim->output.empty() && opt->link_rate > 0 )
+    {
+        next = now() + 0.001;
+    }
+
+    return next;
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--live-rate HZ] [--rc-rate HZ] [--link BYTES_PER_S] [--pull-delay MS] [--ascii] [--symlink PATH] [--verbose]\n", name);
+}
+
+bool parse_options(int argc, char *argv[], options *opt)
+{
+    int i;
+
+    opt->live_rate = 500;
+    opt->rc_rate = 50;
+    opt->link_rate = 0;
+    opt->pull_delay_ms = 400;
+    opt->ascii_only = false;
+    opt->symlink_path = 0;
+    opt->verbose = false;
+
+    for ( i = 1; i < argc; i++ )
+    {
+        if ( strcmp(argv[i], "--ascii") == 0 )
+        {
+            opt->ascii_only = true;
+        }
+        else if ( strcmp(argv[i], "--verbose") == 0 )
+        {
+            opt->verbose = true;
+        }
+        else if ( i + 1 < argc && strcmp(argv[i], "--live-rate") == 0 )
+        {
+            opt->live_rate = atof(argv[++i]);
+        }
+        else if ( i + 1 < argc && strcmp(argv[i], "--rc-rate") == 0 )
+        {
+            opt->rc_rate = atof(argv[++i]);
+        }
+        else if ( i + 1 < argc && strcmp(argv[i], "--link") == 0 )
+        {
+            opt->link_rate = atof(argv[++i]);
+        }
+        else if ( i + 1 < argc && strcmp(argv[i], "--pull-delay") == 0 )
+        {
+            opt->pull_delay_ms = atoi(argv[++i]);
+        }
+        else if ( i + 1 < argc && strcmp(argv[i], "--symlink") == 0 )
+        {
+            opt->symlink_path = argv[++i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return opt->live_rate > 0 && opt->rc_rate > 0 && opt->link_rate >= 0 && opt->pull_delay_ms >= 0;
+}
+
+int open_terminal(char *name, size_t size)
+{
+    int master, slave;
+    struct termios tio;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ( master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || ptsname_r(master, name, size) != 0 )
+    {
+        return -1;
+    }
+
+    // raw like the CDC ACM port, set through the slave side
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if ( slave < 0 )
+    {
+        return -1;
+    }
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    // the slave stays open, otherwise the master reads EIO
+    // whenever the configurator closes the port
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    return master;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    options opt;
+    static simulator sim;
+    char name[128];
+    char buffer[4096];
+    struct pollfd pfd;
+    double t, stats_time;
+    int fd, timeout;
+    ssize_t count;
+
+    if ( !parse_options(argc, argv, &opt) )
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    fd = open_terminal(name, sizeof(name));
+    if ( fd < 0 )
+    {
+        perror("pseudo terminal");
+        return 1;
+    }
+
+    if ( opt.symlink_path )
+    {
+        unlink(opt.symlink_path);
+        if ( symlink(name, opt.symlink_path) < 0 )
+        {
+            perror(opt.symlink_path);
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    printf("%s\n", name);
+    fflush(stdout);
+
+    load_defaults(&sim);
+    t = now();
+    set_mode(&sim, mode_idle, t);
+    sim.link_time = t;
+    stats_time = t;
+
+    while ( !quit )
+    {
+        timeout = (int) ((next_event(&sim, &opt) - now()) * 1000);
+        pfd.fd = fd;
+        pfd.events = POLLIN | ( sim.output.empty() || opt.link_rate > 0 ? 0 : POLLOUT );
+        poll(&pfd, 1, timeout > 0 ? timeout : 0);
+
+        t = now();
+
+        if ( pfd.revents & POLLIN )
+        {
+            count = read(fd, buffer, sizeof(buffer));
+            if ( count > 0 )
+            {
+                sim.input.append(buffer, count);
+                handle_input(&sim, &opt, t);
+            }
+        }
+
+        produce(&sim, &opt, t);
+        flush_output(&sim, &opt, fd, t);
+
+        if ( opt.verbose && t - stats_time >= 1 )
+        {
+            fprintf(stderr, "live %lu dropped %lu rc %lu motors %lu lost %lu\n",
+                    sim.live_sent, sim.live_dropped, sim.rc_sent, sim.motor_frames, sim.motor_lost);
+            stats_time = t;
+        }
+    }
+
+    if ( opt.symlink_path )
+    {
+        unlink(opt.symlink_path);
+    }
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Flight controller simulator on a pseudo terminal,
+# see main.cpp for usage
+#
+#-------------------------------------------------
+
+TARGET = fcsim
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= qt app_bundle
+CONFIG += c++17
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    ../protocol.cpp
+
+HEADERS  += ../protocol.h \
+    ../settings.h
@@ -0,0 +1,39 @@
+#include "slidingrange.h"
+
+void SlidingRange::clear()
+{
+    lows.clear();
+    highs.clear();
+}
+
+void SlidingRange::add(double key, double value)
+{
+    point p = { key, value };
+
+    // a newer sample beats every older one it is below (or above),
+    // those can't be the minimum (maximum) anymore before they expire
+    while ( !lows.empty() && lows.back().value >= value )
+    {
+        lows.pop_back();
+    }
+    lows.push_back(p);
+
+    while ( !highs.empty() && highs.back().value <= value )
+    {
+        highs.pop_back();
+    }
+    highs.push_back(p);
+}
+
+void SlidingRange::expire(double from)
+{
+    while ( !lows.empty() && lows.front().key < from )
+    {
+        lows.pop_front();
+    }
+
+    while ( !highs.empty() && highs.front().key < from )
+    {
+        highs.pop_front();
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef SLIDINGRANGE_H
+#define SLIDINGRANGE_H
+
+#include <deque>
+
+// Running min/max of the samples inside a sliding key window.
+//
+// Two monotonic deques hold only the samples that can still become the
+// minimum or the maximum. Every sample is pushed and popped at most once,
+// so add() and expire() are O(1) amortised and min()/max() are O(1).
+// Keys must be ascending.
+class SlidingRange
+{
+public:
+    void clear();
+    void add(double key, double value);
+    void expire(double from);   // drops samples with key < from
+
+    bool isEmpty() const { return lows.empty(); }
+    double min() const { return lows.front().value; }
+    double max() const { return highs.front().value; }
+
+private:
+    typedef struct
+    {
+        double key;
+        double value;
+    } point;
+
+    std::deque<point> lows;     // values ascending
+    std::deque<point> highs;    // values descending
+};
+
+#endif // SLIDINGRANGE_H
@@ -0,0 +1,376 @@
+#include "spectrum.h"
+
+#include <math.h>
+
+namespace {
+
+void hann(std::vector<float> &window, int n)
+{
+    int i;
+
+    window.resize(n);
+    for ( i = 0; i < n; i++ )
+    {
+        window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+    }
+}
+
+}
+
+RealFft::RealFft(int size) :
+    n(size)
+{
+    int m = n / 2;
+    int bits = 0;
+    int i, j;
+
+    while ( (1 << bits) < m )
+    {
+        bits++;
+    }
+
+    reversed.resize(m);
+    for ( i = 0; i < m; i++ )
+    {
+        reversed[i] = 0;
+        for ( j = 0; j < bits; j++ )
+        {
+            reversed[i] |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+    }
+
+    cos_table.resize(m / 2);
+    sin_table.resize(m / 2);
+    for ( i = 0; i < m / 2; i++ )
+    {
+        cos_table[i] = cos(2 * M_PI * i / m);
+        sin_table[i] = -sin(2 * M_PI * i / m);
+    }
+
+    unpack_cos.resize(m);
+    unpack_sin.resize(m);
+    for ( i = 0; i < m; i++ )
+    {
+        unpack_cos[i] = cos(2 * M_PI * i / n);
+        unpack_sin[i] = -sin(2 * M_PI * i / n);
+    }
+
+    work_re.resize(m);
+    work_im.resize(m);
+}
+
+void RealFft::transform(float *re, float *im)
+{
+    int m = n / 2;
+    int size, half, step, start, k;
+    float t_re, t_im, w_re, w_im;
+
+    for ( k = 0; k < m; k++ )
+    {
+        if ( k < reversed[k] )
+        {
+            t_re = re[k]; re[k] = re[reversed[k]]; re[reversed[k]] = t_re;
+            t_im = im[k]; im[k] = im[reversed[k]]; im[reversed[k]] = t_im;
+        }
+    }
+
+    for ( size = 2; size <= m; size *= 2 )
+    {
+        half = size / 2;
+        step = m / size;
+
+        for ( start = 0; start < m; start += size )
+        {
+            // independent butterflies over contiguous elements
+            for ( k = 0; k < half; k++ )
+            {
+                w_re = cos_table[k * step];
+                w_im = sin_table[k * step];
+                t_re = re[start + half + k] * w_re - im[start + half + k] * w_im;
+                t_im = re[start + half + k] * w_im + im[start + half + k] * w_re;
+                re[start + half + k] = re[start + k] - t_re;
+                im[start + half + k] = im[start + k] - t_im;
+                re[start + k] += t_re;
+                im[start + k] += t_im;
+            }
+        }
+    }
+}
+
+void RealFft::forward(const float *in, float *re, float *im)
+{
+    int m = n / 2;
+    int k;
+    float e_re, e_im, o_re, o_im;
+
+    // even samples as real, odd samples as imaginary part
+    for ( k = 0; k < m; k++ )
+    {
+        work_re[k] = in[2 * k];
+        work_im[k] = in[2 * k + 1];
+    }
+
+    transform(work_re.data(), work_im.data());
+
+    re[0] = work_re[0] + work_im[0];
+    im[0] = 0;
+    re[m] = work_re[0] - work_im[0];
+    im[m] = 0;
+
+    for ( k = 1; k < m; k++ )
+    {
+        // spectra of the even and odd samples from Z[k] and Z[m - k]
+        e_re = 0.5f * (work_re[k] + work_re[m - k]);
+        e_im = 0.5f * (work_im[k] - work_im[m - k]);
+        o_re = 0.5f * (work_im[k] + work_im[m - k]);
+        o_im = -0.5f * (work_re[k] - work_re[m - k]);
+
+        re[k] = e_re + o_re * unpack_cos[k] - o_im * unpack_sin[k];
+        im[k] = e_im + o_re * unpack_sin[k] + o_im * unpack_cos[k];
+    }
+}
+
+void RealFft::inverse(const float *re, const float *im, float *out)
+{
+    int m = n / 2;
+    int k;
+    float e_re, e_im, d_re, d_im, o_re, o_im;
+
+    for ( k = 0; k < m; k++ )
+    {
+        // X[k + m] = conj(X[m - k]) for a real signal
+        e_re = 0.5f * (re[k] + re[m - k]);
+        e_im = 0.5f * (im[k] - im[m - k]);
+        d_re = 0.5f * (re[k] - re[m - k]);
+        d_im = 0.5f * (im[k] + im[m - k]);
+
+        // odd spectrum = difference / W^k
+        o_re = d_re * unpack_cos[k] + d_im * unpack_sin[k];
+        o_im = d_im * unpack_cos[k] - d_re * unpack_sin[k];
+
+        // Z = E + i O, conjugated for the inverse through the forward transform
+        work_re[k] = e_re - o_im;
+        work_im[k] = -(e_im + o_re);
+    }
+
+    transform(work_re.data(), work_im.data());
+
+    for ( k = 0; k < m; k++ )
+    {
+        out[2 * k] = work_re[k] / m;
+        out[2 * k + 1] = -work_im[k] / m;
+    }
+}
+
+WelchPsd::WelchPsd(int segment, int segments) :
+    fft(segment),
+    average(segments)
+{
+    int i;
+
+    hann(window, segment);
+    window_power = 0;
+    for ( i = 0; i < segment; i++ )
+    {
+        window_power += window[i] * window[i];
+    }
+
+    re.resize(fft.bins());
+    im.resize(fft.bins());
+    frame.resize(segment);
+    clear();
+}
+
+void WelchPsd::clear()
+{
+    pending.clear();
+    history.clear();
+    sum.assign(fft.bins(), 0);
+}
+
+void WelchPsd::add(const float *samples, int count)
+{
+    int n = fft.size();
+    int i;
+    std::vector<float> power(fft.bins());
+
+    pending.insert(pending.end(), samples, samples + count);
+
+    while ( (int) pending.size() >= n )
+    {
+        for ( i = 0; i < n; i++ )
+        {
+            frame[i] = pending[i] * window[i];
+        }
+        fft.forward(frame.data(), re.data(), im.data());
+
+        for ( i = 0; i < fft.bins(); i++ )
+        {
+            power[i] = re[i] * re[i] + im[i] * im[i];
+            sum[i] += power[i];
+        }
+        history.push_back(power);
+
+        if ( (int) history.size() > average )
+        {
+            for ( i = 0; i < fft.bins(); i++ )
+            {
+                sum[i] -= history.front()[i];
+            }
+            history.pop_front();
+        }
+
+        // 50 % overlap
+        pending.erase(pending.begin(), pending.begin() + n / 2);
+    }
+}
+
+void WelchPsd::psd(double rate, std::vector<double> &out) const
+{
+    int i;
+    double scale;
+
+    out.assign(fft.bins(), 0);
+    if ( history.empty() )
+    {
+        return;
+    }
+
+    scale = 1.0 / (rate * window_power * history.size());
+    for ( i = 0; i < fft.bins(); i++ )
+    {
+        // one sided, everything but DC and Nyquist counts twice
+        out[i] = sum[i] * scale * (i == 0 || i == fft.bins() - 1 ? 1 : 2);
+    }
+}
+
+StepResponse::StepResponse(int segment, int segments, float min_excitation) :
+    fft(segment),
+    average(segments),
+    min_input(min_excitation)
+{
+    hann(window, segment);
+    in_re.resize(fft.bins());
+    in_im.resize(fft.bins());
+    out_re.resize(fft.bins());
+    out_im.resize(fft.bins());
+    frame.resize(segment);
+    impulse.resize(segment);
+}
+
+void StepResponse::clear()
+{
+    pending_in.clear();
+    pending_out.clear();
+    history.clear();
+}
+
+void StepResponse::add(const float *input, const float *output, int count)
+{
+    int n = fft.size();
+    int i;
+    double mean, variance;
+    cross c;
+
+    pending_in.insert(pending_in.end(), input, input + count);
+    pending_out.insert(pending_out.end(), output, output + count);
+
+    while ( (int) pending_in.size() >= n )
+    {
+        mean = 0;
+        for ( i = 0; i < n; i++ )
+        {
+            mean += pending_in[i];
+        }
+        mean /= n;
+        variance = 0;
+        for ( i = 0; i < n; i++ )
+        {
+            variance += (pending_in[i] - mean) * (pending_in[i] - mean);
+        }
+
+        // without stick movement the loop only sees noise
+        if ( sqrt(variance / n) >= min_input )
+        {
+            for ( i = 0; i < n; i++ )
+            {
+                frame[i] = pending_in[i] * window[i];
+            }
+            fft.forward(frame.data(), in_re.data(), in_im.data());
+            for ( i = 0; i < n; i++ )
+            {
+                frame[i] = pending_out[i] * window[i];
+            }
+            fft.forward(frame.data(), out_re.data(), out_im.data());
+
+            c.xx.resize(fft.bins());
+            c.xy_re.resize(fft.bins());
+            c.xy_im.resize(fft.bins());
+            for ( i = 0; i < fft.bins(); i++ )
+            {
+                // conj(X) * Y
+                c.xx[i] = in_re[i] * in_re[i] + in_im[i] * in_im[i];
+                c.xy_re[i] = in_re[i] * out_re[i] + in_im[i] * out_im[i];
+                c.xy_im[i] = in_re[i] * out_im[i] - in_im[i] * out_re[i];
+            }
+            history.push_back(c);
+            if ( (int) history.size() > average )
+            {
+                history.pop_front();
+            }
+        }
+
+        pending_in.erase(pending_in.begin(), pending_in.begin() + n / 2);
+        pending_out.erase(pending_out.begin(), pending_out.begin() + n / 2);
+    }
+}
+
+void StepResponse::response(int length, std::vector<double> &out)
+{
+    int bins = fft.bins();
+    int i;
+    unsigned s;
+    double xx, noise, sum;
+
+    out.clear();
+    if ( history.empty() )
+    {
+        return;
+    }
+
+    // the few segments kept are summed on demand, cheaper than keeping sums exact
+    std::vector<double> sxx(bins, 0), sxy_re(bins, 0), sxy_im(bins, 0);
+    for ( s = 0; s < history.size(); s++ )
+    {
+        for ( i = 0; i < bins; i++ )
+        {
+            sxx[i] += history[s].xx[i];
+            sxy_re[i] += history[s].xy_re[i];
+            sxy_im[i] += history[s].xy_im[i];
+        }
+    }
+
+    // regularisation against bins the input never excited
+    xx = 0;
+    for ( i = 0; i < bins; i++ )
+    {
+        xx += sxx[i];
+    }
+    noise = 1e-4 * xx / bins;
+
+    for ( i = 0; i < bins; i++ )
+    {
+        out_re[i] = sxy_re[i] / (sxx[i] + noise);
+        out_im[i] = sxy_im[i] / (sxx[i] + noise);
+    }
+    fft.inverse(out_re.data(), out_im.data(), impulse.data());
+
+    length = length < fft.size() ? length : fft.size();
+    out.resize(length);
+    sum = 0;
+    for ( i = 0; i < length; i++ )
+    {
+        sum += impulse[i];
+        out[i] = sum;
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <vector>
+#include <deque>
+
+// Radix-2 FFT of real signals, n a power of two >= 4.
+//
+// The real input is packed as n/2 complex values and transformed with an
+// iterative complex FFT on split re/im arrays, then unpacked into the
+// n/2 + 1 bins of the one sided spectrum. Twiddles and the bit reversal
+// table are computed once, the butterfly loops run over contiguous floats
+// without branches so the compiler can vectorise them.
+class RealFft
+{
+public:
+    explicit RealFft(int n);
+
+    int size() const { return n; }
+    int bins() const { return n / 2 + 1; }
+
+    // re and im get bins() values
+    void forward(const float *in, float *re, float *im);
+    // inverse of forward(), out gets size() values
+    void inverse(const float *re, const float *im, float *out);
+
+private:
+    void transform(float *re, float *im);   // complex, size n/2, in place
+
+    int n;
+    std::vector<int> reversed;
+    std::vector<float> cos_table;   // twiddles of the n/2 point transform
+    std::vector<float> sin_table;
+    std::vector<float> unpack_cos;  // e^(-2 pi i k / n), k < n/2
+    std::vector<float> unpack_sin;
+    std::vector<float> work_re;
+    std::vector<float> work_im;
+};
+
+// Welch power spectral density, updated one segment at a time.
+//
+// Samples are added as they arrive. Every hop (half a segment) a Hann
+// windowed segment is transformed once and its power added to a running
+// sum over the last `average` segments, so the estimate is refreshed
+// incrementally instead of recomputing the whole history.
+class WelchPsd
+{
+public:
+    WelchPsd(int segment, int average);
+
+    void clear();
+    void add(const float *samples, int count);
+    int segments() const { return (int) history.size(); }
+
+    // one sided density in units^2/Hz for bins 0..segment/2
+    void psd(double rate, std::vector<double> &out) const;
+
+private:
+    RealFft fft;
+    std::vector<float> window;
+    double window_power;            // sum of window^2
+    std::vector<float> pending;     // samples not in a complete segment yet
+    std::deque<std::vector<float> > history;
+    std::vector<double> sum;
+    int average;
+    std::vector<float> re, im, frame;
+};
+
+// Step response of a loop from its input (stick, set point) and output
+// (gyro rate) by Wiener deconvolution, as tuning tools for multicopters do.
+//
+// Per segment the cross spectrum S_xy and input power S_xx are added up,
+// only over segments where the input moved enough to excite the loop. The
+// transfer function H = S_xy / (S_xx + noise) is turned into the impulse
+// response, its running sum is the step response.
+class StepResponse
+{
+public:
+    // segments whose input standard deviation stays below min_input are skipped
+    StepResponse(int segment, int average, float min_input);
+
+    void clear();
+    void add(const float *input, const float *output, int count);
+    int segments() const { return (int) history.size(); }
+
+    // step response over the first length samples, empty without excited segments
+    void response(int length, std::vector<double> &out);
+
+private:
+    typedef struct
+    {
+        std::vector<float> xx;
+        std::vector<float> xy_re;
+        std::vector<float> xy_im;
+    } cross;
+
+    RealFft fft;
+    std::vector<float> window;
+    std::vector<float> pending_in;
+    std::vector<float> pending_out;
+    std::deque<cross> history;
+    int average;
+    float min_input;
+    std::vector<float> in_re, in_im, out_re, out_im, frame, impulse;
+};
+
+#endif // SPECTRUM_H
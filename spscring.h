@@ -0,0 +1,57 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// Size must be a power of two, one slot is kept free to tell full from empty.
+template <typename T, int Size>
+class SpscRing
+{
+    static_assert((Size & (Size - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : dropped(0), head(0), tail(0) {}
+
+    // producer side, returns false if the consumer fell behind
+    bool push(const T &item)
+    {
+        int t = tail.load(std::memory_order_relaxed);
+        int next = (t + 1) & (Size - 1);
+
+        if ( next == head.load(std::memory_order_acquire) )
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        items[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false if empty
+    bool pop(T &item)
+    {
+        int h = head.load(std::memory_order_relaxed);
+
+        if ( h == tail.load(std::memory_order_acquire) )
+        {
+            return false;
+        }
+
+        item = items[h];
+        head.store((h + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    std::atomic<unsigned> dropped;
+
+private:
+    T items[Size];
+    // keep producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<int> head;
+    alignas(64) std::atomic<int> tail;
+};
+
+#endif // SPSCRING_H
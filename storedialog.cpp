@@ -0,0 +1,149 @@
+#include "storedialog.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QFile>
+
+StoreDialog::StoreDialog(ImageStore *image_store, QWidget *parent) :
+    QDialog(parent),
+    store(image_store)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QHBoxLayout *buttons = new QHBoxLayout;
+    QPushButton *button;
+
+    setWindowTitle(tr("Image store"));
+    resize(720, 360);
+
+    kind_comboBox = new QComboBox(this);
+    kind_comboBox->addItem(tr("Firmware"), store_firmware);
+    kind_comboBox->addItem(tr("Settings"), store_settings);
+    connect(kind_comboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(refresh()));
+    layout->addWidget(kind_comboBox);
+
+    table = new QTableWidget(0, col_count, this);
+    table->setHorizontalHeaderLabels(QStringList() << tr("Stored") << tr("Device") << tr("Label")
+                                     << tr("Size") << tr("SHA-256"));
+    table->horizontalHeader()->setStretchLastSection(true);
+    table->verticalHeader()->hide();
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->setSelectionMode(QAbstractItemView::SingleSelection);
+    connect(table, SIGNAL(cellDoubleClicked(int,int)), this, SLOT(use_selected()));
+    layout->addWidget(table);
+
+    use_button = new QPushButton(this);
+    connect(use_button, SIGNAL(clicked()), this, SLOT(use_selected()));
+    buttons->addWidget(use_button);
+    button = new QPushButton(tr("Export..."), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(export_selected()));
+    buttons->addWidget(button);
+    button = new QPushButton(tr("Remove"), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(remove_selected()));
+    buttons->addWidget(button);
+    buttons->addStretch();
+    button = new QPushButton(tr("Close"), this);
+    connect(button, SIGNAL(clicked()), this, SLOT(reject()));
+    buttons->addWidget(button);
+    layout->addLayout(buttons);
+
+    refresh();
+}
+
+void StoreDialog::refresh()
+{
+    int kind = kind_comboBox->currentData().toInt();
+    int row;
+
+    use_button->setText(kind == store_firmware ? tr("Flash") : tr("Load settings"));
+
+    rows = store->entries(kind);
+    table->setRowCount(rows.size());
+    for ( row = 0; row < rows.size(); row++ )
+    {
+        const store_entry &entry = rows.at(row);
+
+        table->setItem(row, col_time, new QTableWidgetItem(entry.time.toString("yyyy-MM-dd hh:mm")));
+        table->setItem(row, col_device, new QTableWidgetItem(entry.device));
+        table->setItem(row, col_label, new QTableWidgetItem(entry.label));
+        table->setItem(row, col_size, new QTableWidgetItem(QString::number(entry.size)));
+        table->setItem(row, col_hash, new QTableWidgetItem(entry.hash.left(16)));
+        table->item(row, col_hash)->setToolTip(entry.hash);
+    }
+    table->resizeColumnsToContents();
+}
+
+QString StoreDialog::selected_hash() const
+{
+    int row = table->currentRow();
+
+    return row >= 0 && row < rows.size() ? rows.at(row).hash : QString();
+}
+
+void StoreDialog::use_selected()
+{
+    QString hash = selected_hash();
+    QByteArray data;
+
+    if ( hash.isEmpty() )
+    {
+        return;
+    }
+
+    // a damaged object must not reach the device
+    data = store->get(hash);
+    if ( data.isEmpty() )
+    {
+        QMessageBox::warning(this, windowTitle(), tr("The stored image is missing or damaged."));
+        return;
+    }
+
+    if ( kind_comboBox->currentData().toInt() == store_firmware )
+    {
+        emit flash(store->path(hash));
+        accept();
+        return;
+    }
+
+    emit load_settings(data);
+    accept();
+}
+
+void StoreDialog::export_selected()
+{
+    QString hash = selected_hash();
+    QString filename;
+
+    if ( hash.isEmpty() )
+    {
+        return;
+    }
+
+    filename = QFileDialog::getSaveFileName(this, tr("Export"), rows.at(table->currentRow()).label);
+    if ( filename.isEmpty() )
+    {
+        return;
+    }
+
+    QFile::remove(filename);
+    if ( !QFile::copy(store->path(hash), filename) )
+    {
+        QMessageBox::warning(this, windowTitle(), tr("'%1' cannot be written.").arg(filename));
+    }
+}
+
+void StoreDialog::remove_selected()
+{
+    QString hash = selected_hash();
+
+    if ( hash.isEmpty() )
+    {
+        return;
+    }
+
+    store->remove(hash);
+    refresh();
+}
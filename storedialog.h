@@ -0,0 +1,42 @@
+#ifndef STOREDIALOG_H
+#define STOREDIALOG_H
+
+#include <QDialog>
+#include <QTableWidget>
+#include <QComboBox>
+#include <QPushButton>
+
+#include "imagestore.h"
+
+// Lists the firmware images and settings snapshots in the store. A firmware
+// is flashed and a snapshot loaded straight from the store, no device read.
+class StoreDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit StoreDialog(ImageStore *store, QWidget *parent = 0);
+
+signals:
+    void flash(QString path);
+    void load_settings(QByteArray data);
+
+private slots:
+    void refresh();
+    void use_selected();
+    void export_selected();
+    void remove_selected();
+
+private:
+    enum { col_time, col_device, col_label, col_size, col_hash, col_count };
+
+    QString selected_hash() const;
+
+    ImageStore *store;
+    QComboBox *kind_comboBox;
+    QTableWidget *table;
+    QPushButton *use_button;
+    QList<store_entry> rows;
+};
+
+#endif // STOREDIALOG_H
@@ -0,0 +1,214 @@
+#include "telemetrystore.h"
+
+namespace {
+
+// fold src into the partial bucket dst
+template <typename B>
+void merge(B &dst, const B &src, int channels)
+{
+    int i;
+
+    if ( dst.count == 0 )
+    {
+        dst = src;
+        dst.count = 1;
+        return;
+    }
+
+    for ( i = 0; i < channels; i++ )
+    {
+        if ( src.min[i] < dst.min[i] ) dst.min[i] = src.min[i];
+        if ( src.max[i] > dst.max[i] ) dst.max[i] = src.max[i];
+    }
+    dst.key_last = src.key_last;
+    dst.count++;
+}
+
+}
+
+TelemetryStore::TelemetryStore()
+{
+    int level;
+
+    raw.resize(raw_capacity);
+    for ( level = 1; level < levels; level++ )
+    {
+        buckets[level].resize(bucket_capacity);
+    }
+
+    clear();
+}
+
+void TelemetryStore::clear()
+{
+    int level;
+
+    for ( level = 0; level < levels; level++ )
+    {
+        written[level] = 0;
+        pending[level].count = 0;
+    }
+    last = 0;
+}
+
+void TelemetryStore::append(double key, const double *values)
+{
+    int i;
+    sample &s = raw[written[0] & (raw_capacity - 1)];
+    bucket b;
+
+    s.key = key;
+    b.key_first = key;
+    b.key_last = key;
+    b.count = 1;
+    for ( i = 0; i < channels; i++ )
+    {
+        s.value[i] = values[i];
+        b.min[i] = values[i];
+        b.max[i] = values[i];
+    }
+    written[0]++;
+    last = key;
+
+    merge(pending[1], b, channels);
+    if ( pending[1].count == factor )
+    {
+        add_bucket(1, pending[1]);
+        pending[1].count = 0;
+    }
+}
+
+void TelemetryStore::add_bucket(int level, const bucket &b)
+{
+    buckets[level][written[level] & (bucket_capacity - 1)] = b;
+    written[level]++;
+
+    if ( level + 1 < levels )
+    {
+        merge(pending[level + 1], b, channels);
+        if ( pending[level + 1].count == factor )
+        {
+            add_bucket(level + 1, pending[level + 1]);
+            pending[level + 1].count = 0;
+        }
+    }
+}
+
+int TelemetryStore::size(int level) const
+{
+    return written[level] < capacity(level) ? (int) written[level] : capacity(level);
+}
+
+const TelemetryStore::sample &TelemetryStore::raw_at(int index) const
+{
+    // index 0 is the oldest sample still held
+    int64_t first = written[0] - size(0);
+    return raw[(first + index) & (raw_capacity - 1)];
+}
+
+const TelemetryStore::bucket &TelemetryStore::bucket_at(int level, int index) const
+{
+    int64_t first = written[level] - size(level);
+    return buckets[level][(first + index) & (bucket_capacity - 1)];
+}
+
+double TelemetryStore::key_at(int level, int index) const
+{
+    return level == 0 ? raw_at(index).key : bucket_at(level, index).key_last;
+}
+
+int TelemetryStore::lower_bound(int level, double key) const
+{
+    // first index whose (last) key is >= key, keys are ascending
+    int low = 0;
+    int high = size(level);
+    int mid;
+
+    while ( low < high )
+    {
+        mid = low + (high - low) / 2;
+        if ( key_at(level, mid) < key )
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+void TelemetryStore::emit_bucket(int channel, const bucket &b, QVector<QCPGraphData> &out) const
+{
+    double key = (b.key_first + b.key_last) / 2;
+
+    out.append(QCPGraphData(key, b.min[channel]));
+    if ( b.max[channel] != b.min[channel] )
+    {
+        out.append(QCPGraphData(key, b.max[channel]));
+    }
+}
+
+void TelemetryStore::window(int channel, double from, double to, int max_points, QVector<QCPGraphData> &out) const
+{
+    int level, i;
+    int first = 0;
+    int last = 0;
+    int points;
+    bool covered;
+
+    out.clear();
+
+    if ( isEmpty() )
+    {
+        return;
+    }
+
+    for ( level = 0; level < levels; level++ )
+    {
+        // one point beyond each edge keeps the line running out of the view
+        first = lower_bound(level, from);
+        if ( first > 0 )
+        {
+            first--;
+        }
+        last = lower_bound(level, to);
+        if ( last < size(level) )
+        {
+            last++;
+        }
+
+        points = level == 0 ? last - first : 2 * (last - first + level);
+        covered = written[level] <= capacity(level) || key_at(level, 0) <= from;
+
+        if ( level == levels - 1 || ( points <= max_points && covered ) )
+        {
+            break;
+        }
+    }
+
+    if ( level == 0 )
+    {
+        for ( i = first; i < last; i++ )
+        {
+            out.append(QCPGraphData(raw_at(i).key, raw_at(i).value[channel]));
+        }
+        return;
+    }
+
+    for ( i = first; i < last; i++ )
+    {
+        emit_bucket(channel, bucket_at(level, i), out);
+    }
+
+    // the newest samples are still in partial buckets, oldest first
+    for ( i = level; i >= 1; i-- )
+    {
+        if ( pending[i].count > 0 && pending[i].key_last >= from )
+        {
+            emit_bucket(channel, pending[i], out);
+        }
+    }
+}
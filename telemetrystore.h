@@ -0,0 +1,72 @@
+#ifndef TELEMETRYSTORE_H
+#define TELEMETRYSTORE_H
+
+#include <QVector>
+#include <stdint.h>
+
+#include "qcustomplot.h"
+
+// Fixed size history of the 9 live channels.
+//
+// Level 0 keeps the raw samples, every level above keeps min/max buckets
+// of `factor` buckets of the level below. All levels are rings, so memory
+// stays flat no matter how long the session runs, while older history is
+// still available as exact min/max envelopes from the upper levels.
+//
+//   level 0   65536 samples
+//   level 1    8192 buckets of 8 samples         65536 samples
+//   level 2    8192 buckets of 64 samples       524288 samples
+//   ...
+//   level 5    8192 buckets of 32768 samples    268 M samples
+class TelemetryStore
+{
+public:
+    enum { channels = 9, levels = 6, factor = 8 };
+    enum { raw_capacity = 65536, bucket_capacity = 8192 };
+
+    TelemetryStore();
+
+    void clear();
+    void append(double key, const double *values);
+
+    bool isEmpty() const { return written[0] == 0; }
+    double last_key() const { return last; }
+
+    // Points of one channel between from and to, picked from the finest level
+    // that fits into max_points and still holds that part of the history.
+    // Cost is O(max_points + log n), out is reused to avoid reallocation.
+    void window(int channel, double from, double to, int max_points, QVector<QCPGraphData> &out) const;
+
+private:
+    typedef struct
+    {
+        double key;
+        float value[channels];
+    } sample;
+
+    typedef struct
+    {
+        double key_first;
+        double key_last;
+        float min[channels];
+        float max[channels];
+        int count;
+    } bucket;
+
+    int size(int level) const;
+    int capacity(int level) const { return level == 0 ? raw_capacity : bucket_capacity; }
+    double key_at(int level, int index) const;
+    int lower_bound(int level, double key) const;
+    const sample &raw_at(int index) const;
+    const bucket &bucket_at(int level, int index) const;
+    void add_bucket(int level, const bucket &b);
+    void emit_bucket(int channel, const bucket &b, QVector<QCPGraphData> &out) const;
+
+    QVector<sample> raw;
+    QVector<bucket> buckets[levels];    // [0] unused
+    bucket pending[levels];             // partial bucket being built for each level
+    int64_t written[levels];
+    double last;
+};
+
+#endif // TELEMETRYSTORE_H
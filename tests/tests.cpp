@@ -0,0 +1,212 @@
+// Tests of the protocol engine and the session files
+//
+// usage: tests [QtTest options]
+//
+// The engine runs on session files written by the tests, so no device
+// is needed.
+
+#include <QtTest>
+#include <QCoreApplication>
+#include <string.h>
+
+#include "protocol.h"
+#include "serialworker.h"
+#include "sessionlog.h"
+
+namespace {
+
+const qint64 ms = 1000000;
+
+// the frame encoded, starting at its first magic byte
+QByteArray from_magic(const QByteArray &frame)
+{
+    return frame.mid(frame.indexOf((char) 0xdb));
+}
+
+QByteArray encode(uint8_t type, const void *payload, int length)
+{
+    uint8_t out[frame_header_size + frame_max_payload + frame_crc_size];
+
+    return QByteArray((const char *) out, frame_encode(type, payload, length, out));
+}
+
+}
+
+class Tests : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void settings_received(QByteArray data);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void pull_after_stale_frames();
+    void append_after_truncated_record_data();
+    void append_after_truncated_record();
+
+private:
+    bool replay(const QString &path);
+
+    QTemporaryDir dir;
+    QThread serial_thread;
+    SerialWorker *serial;
+    QList<QByteArray> received;
+};
+
+void Tests::settings_received(QByteArray data)
+{
+    received << data;
+}
+
+void Tests::initTestCase()
+{
+    QVERIFY(dir.isValid());
+
+    // like the configurator, the engine runs in its own thread
+    serial = new SerialWorker;
+    serial->moveToThread(&serial_thread);
+    serial_thread.start();
+
+    connect(serial, SIGNAL(settings_received(QByteArray)), this, SLOT(settings_received(QByteArray)));
+}
+
+void Tests::cleanupTestCase()
+{
+    serial->close();
+    serial_thread.quit();
+    serial_thread.wait();
+    delete serial;
+}
+
+// the session through the engine at full speed, false if it didn't finish
+bool Tests::replay(const QString &path)
+{
+    QEventLoop loop;
+    QTimer guard;
+
+    guard.setSingleShot(true);
+    connect(serial, SIGNAL(replay_finished()), &loop, SLOT(quit()));
+    connect(&guard, SIGNAL(timeout()), &loop, SLOT(quit()));
+
+    received.clear();
+    if ( !serial->open_replay(path, 0) )
+    {
+        return false;
+    }
+    guard.start(10000);
+    loop.exec();
+    serial->close();
+
+    return guard.isActive();
+}
+
+// the stream runs on for a while after pull_settings, its frames may hold
+// the magic byte anywhere, the block is what follows the quiet gap
+void Tests::pull_after_stale_frames()
+{
+    QString path = dir.filePath("pull.c101log");
+    SessionRecorder recorder;
+    QByteArray block(1024, 0);
+    QByteArray live;
+    QByteArray rc;
+    QByteArray tail;
+    live_frame frame;
+    rc_frame channels;
+    uint32_t bits = 0x3fdb0000;     // 1.71 as a float
+    int i;
+
+    for ( i = 0; i < block.size(); i++ )
+    {
+        block[i] = i * 7;
+    }
+    block[0] = (char) 0xdb;
+
+    memset(&frame, 0, sizeof(frame));
+    memcpy(&frame.gyro[1], &bits, sizeof(bits));
+    live = encode(frame_live, &frame, sizeof(frame));
+
+    memset(&channels, 0, sizeof(channels));
+    channels.seq = 0xdb;
+    rc = encode(frame_rc, &channels, sizeof(channels));
+
+    // a read that starts right on a magic byte in the middle of a frame
+    tail = from_magic(live.mid(live.size() / 2) + rc);
+
+    QVERIFY(live.contains((char) 0xdb));
+    QVERIFY(rc.contains((char) 0xdb));
+    QVERIFY(tail.startsWith((char) 0xdb));
+
+    QVERIFY(recorder.open(path));
+    recorder.record(session_out, 0, "pull_settings", 14);
+    recorder.record(session_in, 4 * ms, live.constData(), live.size());
+    recorder.record(session_in, 9 * ms, rc.constData(), rc.size());
+    recorder.record(session_in, 15 * ms, live.constData(), live.size() / 2);
+    recorder.record(session_in, 16 * ms, tail.constData(), tail.size());
+    recorder.record(session_in, 350 * ms, block.constData(), block.size());
+    recorder.close();
+
+    QVERIFY(replay(path));
+    QCOMPARE(received.size(), 1);
+    QCOMPARE(received.first(), block);
+}
+
+void Tests::append_after_truncated_record_data()
+{
+    QTest::addColumn<int>("cut");           // bytes of the third record left
+    QTest::addColumn<QByteArray>("input");
+
+    QTest::newRow("header") << 5 << QByteArray("a1 a2 b1 b2");
+    QTest::newRow("payload") << (int) sizeof(session_record) + 1 << QByteArray("a1 a2 b1 b2");
+    QTest::newRow("padding") << (int) sizeof(session_record) + 3 << QByteArray("a1 a2 a3 b1 b2");
+}
+
+// a crash cuts off the last record, the next session is appended after the
+// last complete one and both replay
+void Tests::append_after_truncated_record()
+{
+    QFETCH(int, cut);
+    QFETCH(QByteArray, input);
+    QString path = dir.filePath(QString("append_%1.c101log").arg(QTest::currentDataTag()));
+    SessionRecorder recorder;
+    SessionReplay replay;
+    QEventLoop loop;
+    QTimer guard;
+    qint64 size;
+
+    QVERIFY(recorder.open(path));
+    recorder.record(session_in, 1 * ms, "a1 ", 3);
+    recorder.record(session_in, 2 * ms, "a2 ", 3);
+    recorder.close();
+    size = QFileInfo(path).size();
+
+    QVERIFY(recorder.open(path));
+    recorder.record(session_in, 3 * ms, "a3 ", 3);
+    recorder.close();
+    QVERIFY(QFile::resize(path, size + cut));
+
+    // the second session starts its clock anew
+    QVERIFY(recorder.open(path));
+    recorder.record(session_in, 1 * ms, "b1 ", 3);
+    recorder.record(session_in, 2 * ms, "b2", 2);
+    recorder.close();
+    QCOMPARE(QFileInfo(path).size() % 8, 0);
+
+    guard.setSingleShot(true);
+    connect(&replay, SIGNAL(finished()), &loop, SLOT(quit()));
+    connect(&guard, SIGNAL(timeout()), &loop, SLOT(quit()));
+
+    QVERIFY(replay.start(path, 0));
+    guard.start(10000);
+    loop.exec();
+    QVERIFY(guard.isActive());
+
+    QCOMPARE(replay.readAll(), input);
+    replay.stop();
+}
+
+QTEST_GUILESS_MAIN(Tests)
+
+#include "tests.moc"
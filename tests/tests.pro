@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Tests of the protocol engine and the session files,
+# see tests.cpp for usage
+#
+#-------------------------------------------------
+
+QT       += core serialport testlib
+QT       -= gui
+
+TARGET = tests
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++17
+
+INCLUDEPATH += ..
+
+SOURCES += tests.cpp \
+    ../protocol.cpp \
+    ../serialworker.cpp \
+    ../sessionlog.cpp
+
+HEADERS  += ../protocol.h \
+    ../serialworker.h \
+    ../sessionlog.h \
+    ../spscring.h
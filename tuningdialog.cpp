@@ -0,0 +1,81 @@
+#include "tuningdialog.h"
+
+#include <QGridLayout>
+
+TuningDialog::TuningDialog(const QList<QDoubleSpinBox *> &gains, QWidget *parent) :
+    QDialog(parent),
+    sources(gains),
+    syncing(false)
+{
+    QGridLayout *layout = new QGridLayout(this);
+    const char *axes[] = { "Roll", "Nick", "Gier", "Level roll", "Level nick", "Level gier" };
+    const char *terms[] = { "Kp", "Ki", "Kd" };
+    QDoubleSpinBox *box;
+    int i;
+
+    setWindowTitle(tr("Live tuning"));
+
+    for ( i = 0; i < 3; i++ )
+    {
+        layout->addWidget(new QLabel(terms[i], this), 0, i + 1, Qt::AlignHCenter);
+    }
+
+    for ( i = 0; i < sources.size(); i++ )
+    {
+        if ( i % 3 == 0 )
+        {
+            layout->addWidget(new QLabel(tr(axes[i / 3]), this), i / 3 + 1, 0);
+        }
+
+        box = new QDoubleSpinBox(this);
+        box->setRange(sources.at(i)->minimum(), sources.at(i)->maximum());
+        box->setDecimals(sources.at(i)->decimals());
+        box->setSingleStep(sources.at(i)->singleStep());
+        // every wheel step is streamed, no need to wait for editing to finish
+        box->setKeyboardTracking(false);
+        connect(box, SIGNAL(valueChanged(double)), this, SLOT(gain_edited(double)));
+        layout->addWidget(box, i / 3 + 1, i % 3 + 1);
+        mirrors.append(box);
+    }
+
+    status_label = new QLabel(this);
+    layout->addWidget(status_label, sources.size() / 3 + 1, 0, 1, 4);
+
+    sync();
+}
+
+void TuningDialog::sync()
+{
+    int i;
+
+    syncing = true;
+    for ( i = 0; i < sources.size(); i++ )
+    {
+        mirrors.at(i)->setValue(sources.at(i)->value());
+    }
+    syncing = false;
+}
+
+void TuningDialog::set_status(const QString &text)
+{
+    status_label->setText(text);
+}
+
+void TuningDialog::showEvent(QShowEvent *event)
+{
+    sync();
+    QDialog::showEvent(event);
+}
+
+void TuningDialog::gain_edited(double value)
+{
+    int i = mirrors.indexOf(qobject_cast<QDoubleSpinBox *>(sender()));
+
+    if ( syncing || i < 0 )
+    {
+        return;
+    }
+
+    sources.at(i)->setValue(value);
+    emit gains_changed();
+}
@@ -0,0 +1,39 @@
+#ifndef TUNINGDIALOG_H
+#define TUNINGDIALOG_H
+
+#include <QDialog>
+#include <QDoubleSpinBox>
+#include <QList>
+#include <QLabel>
+
+// PID gains next to the live plots. Every gain mirrors one spin box of the
+// configuration tab, edits are written through to it and reported by
+// gains_changed() so they can be streamed while the plots keep running.
+class TuningDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    // 18 gains, Kp Ki Kd of roll nick gier, rate loop then level loop
+    TuningDialog(const QList<QDoubleSpinBox *> &gains, QWidget *parent = 0);
+
+    void sync();    // take over the configuration tab values
+    void set_status(const QString &text);
+
+signals:
+    void gains_changed();
+
+protected:
+    void showEvent(QShowEvent *event);
+
+private slots:
+    void gain_edited(double value);
+
+private:
+    QList<QDoubleSpinBox *> sources;
+    QList<QDoubleSpinBox *> mirrors;
+    QLabel *status_label;
+    bool syncing;
+};
+
+#endif // TUNINGDIALOG_H